@@ -2,6 +2,11 @@
 #include <SDL/SDL.h>
 // iostream is so we can output error messages to console
 #include <iostream>
+// vector holds the framebuffer
+#include <vector>
+#include <algorithm>
+// fstream is for writing image files
+#include <fstream>
 
 #include "MCG_GFX_Lib.h"
 
@@ -10,13 +15,29 @@ namespace MCG
 {
 	SDL_Renderer *_renderer;
 	SDL_Window *_window;
+	// The framebuffer is copied into this texture once per frame, then the texture is drawn to the window
+	SDL_Texture *_texture;
+	std::vector<uint32_t> _framebuffer;
 	glm::ivec2 _winSize;
 	unsigned int _lastTime;
+	// True when there is no window, only the framebuffer
+	bool _headless;
+
+	/// Copies the framebuffer to the window and shows it
+	void PresentFramebuffer();
+
+	/// Writers for each image format SaveImage supports
+	bool SavePPM( std::ofstream &file );
+	bool SavePNG( std::ofstream &file );
+	/// Appends one length, type, data and CRC chunk to a PNG file
+	void WritePNGChunk( std::ofstream &file, const char *type, const std::vector<uint8_t> &data );
 }
 
 
 bool MCG::Init( glm::ivec2 windowSize )
 {
+	_headless = false;
+
 	if( SDL_Init( SDL_INIT_VIDEO ) < 0 )
 	{
 		// Something went very wrong in initialisation, all we can do is exit
@@ -70,38 +91,104 @@ bool MCG::Init( glm::ivec2 windowSize )
 	}
 
 
+	// The streaming texture is what the framebuffer gets uploaded into
+	// Streaming means SDL expects it to be updated often, so keeps it somewhere that's quick to write to
+	_texture = SDL_CreateTexture( _renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, _winSize.x, _winSize.y );
+
+	if( !_texture )
+	{
+		// Something went very wrong in initialisation, all we can do is exit
+		std::cout << "MCG Framework: Whoops! Something went very wrong, cannot create framebuffer texture :(" << std::endl;
+		return false;
+	}
+
+	// Starts with a black framebuffer
+	_framebuffer.assign( _winSize.x * _winSize.y, PackColour( glm::vec3( 0, 0, 0 ) ) );
+
+
 
 	_lastTime = SDL_GetTicks();
 
 	return true;
 }
 
-void MCG::SetBackground( glm::vec3 colour )
+bool MCG::InitHeadless( glm::ivec2 windowSize )
 {
-	// Set the colour for drawing
-	colour = glm::clamp(colour, 0.0f, 1.0f) * 255.0f;
-	SDL_SetRenderDrawColor( _renderer, colour.r, colour.g, colour.b, 255 );
-	// Clear the entire screen to our selected colour
-	SDL_RenderClear( _renderer );
+	if( windowSize.x <= 0 || windowSize.y <= 0 )
+	{
+		std::cout << "MCG Framework: Whoops! Something went very wrong, the framebuffer can't be " << windowSize.x << "x" << windowSize.y << " :(" << std::endl;
+		return false;
+	}
+
+	// No SDL at all, just somewhere to draw
+	_headless = true;
+	_winSize = windowSize;
+	_framebuffer.assign( _winSize.x * _winSize.y, PackColour( glm::vec3( 0, 0, 0 ) ) );
 
+	return true;
+}
+
+void MCG::SetBackground( glm::vec3 colour )
+{
+	// Clear the entire framebuffer to our selected colour
+	std::fill( _framebuffer.begin(), _framebuffer.end(), PackColour( colour ) );
 }
 
 void MCG::DrawPixel( glm::ivec2 position, glm::vec3 colour )
 {
-	// Set the colour for drawing
-	colour = glm::clamp(colour, 0.0f, 1.0f) * 255.0f;
-	SDL_SetRenderDrawColor( _renderer, colour.r, colour.g, colour.b, 255 );
+	// Ignore pixels outside the window
+	if( position.x < 0 || position.y < 0 || position.x >= _winSize.x || position.y >= _winSize.y )
+	{
+		return;
+	}
+
 	// Draw our pixel
-	SDL_RenderDrawPoint( _renderer, position.x, position.y );
+	_framebuffer[ position.y * _winSize.x + position.x ] = PackColour( colour );
 }
 
+uint32_t *MCG::GetFramebuffer()
+{
+	return _framebuffer.data();
+}
 
-bool MCG::ProcessFrame()
+glm::ivec2 MCG::GetFramebufferSize()
 {
+	return _winSize;
+}
+
+uint32_t MCG::PackColour( glm::vec3 colour )
+{
+	// Scale to 0-255, dropping the fraction like SDL's colour functions do
+	colour = glm::clamp(colour, 0.0f, 1.0f) * 255.0f;
+
+	// RGBA8888 is packed with red in the highest byte and alpha in the lowest
+	return ( (uint32_t)colour.r << 24 ) | ( (uint32_t)colour.g << 16 ) | ( (uint32_t)colour.b << 8 ) | 255u;
+}
+
+void MCG::PresentFramebuffer()
+{
+	// Upload the whole framebuffer in one go, the pitch is the number of bytes in a row
+	SDL_UpdateTexture( _texture, NULL, _framebuffer.data(), _winSize.x * sizeof( uint32_t ) );
+
+	// Draw the texture over the whole window
+	SDL_RenderCopy( _renderer, _texture, NULL, NULL );
+
 	// This tells the renderer to actually show its contents to the screen
-	// This is specific to the SDL drawing commands. When we start with OpenGL we will need to use a different command here
-	// This is to do with something called 'double buffering', where we have an off-screen buffer that we draw to and then swap once we finish (this function is the 'swap')
 	SDL_RenderPresent( _renderer );
+}
+
+
+bool MCG::ProcessFrame()
+{
+	// Nothing to show and nobody to ask us to quit
+	if( _headless )
+	{
+		return true;
+	}
+
+	// This uploads the framebuffer and tells the renderer to actually show its contents to the screen
+	// This is to do with something called 'double buffering', where we have an off-screen buffer that we draw to and then swap once we finish (this function is the 'swap')
+	PresentFramebuffer();
 
 
 	SDL_Event incomingEvent;
@@ -171,6 +258,13 @@ bool MCG::ProcessFrame()
 
 void MCG::Cleanup()
 {
+	if( _headless )
+	{
+		return;
+	}
+
+	SDL_DestroyTexture( _texture );
+	SDL_DestroyRenderer( _renderer );
 	SDL_DestroyWindow( _window );
 	SDL_Quit();
 }
@@ -178,12 +272,17 @@ void MCG::Cleanup()
 
 int MCG::ShowAndHold()
 {
+	// There is no window to hold open
+	if( _headless )
+	{
+		return 0;
+	}
+
 	// Show
 
-	// This tells the renderer to actually show its contents to the screen
-	// This is specific to the SDL drawing commands. When we start with OpenGL we will need to use a different command here
+	// This uploads the framebuffer and tells the renderer to actually show its contents to the screen
 	// This is to do with something called 'double buffering', where we have an off-screen buffer that we draw to and then swap once we finish (this function is the 'swap')
-	SDL_RenderPresent( _renderer );
+	PresentFramebuffer();
 
 
 
@@ -248,3 +347,146 @@ int MCG::ShowAndHold()
 	return 0;
 }
 
+
+bool MCG::SaveImage( std::string path )
+{
+	std::ofstream file( path, std::ios::binary );
+
+	if( !file )
+	{
+		std::cout << "MCG Framework: Whoops! Cannot open " << path << " for writing :(" << std::endl;
+		return false;
+	}
+
+	// Picks the format from the extension
+	bool png = path.size() >= 4 && path.compare( path.size() - 4, 4, ".png" ) == 0;
+	bool written = png ? SavePNG( file ) : SavePPM( file );
+
+	if( !written )
+	{
+		std::cout << "MCG Framework: Whoops! Something went wrong writing " << path << " :(" << std::endl;
+	}
+	return written;
+}
+
+bool MCG::SavePPM( std::ofstream &file )
+{
+	// Binary PPM is a short text header followed by plain RGB bytes, top row first
+	file << "P6\n" << _winSize.x << " " << _winSize.y << "\n255\n";
+
+	std::vector<uint8_t> row( _winSize.x * 3 );
+	for( int y = 0; y < _winSize.y; y++ )
+	{
+		for( int x = 0; x < _winSize.x; x++ )
+		{
+			uint32_t pixel = _framebuffer[ y * _winSize.x + x ];
+			row[ x * 3 + 0 ] = (uint8_t)( pixel >> 24 );
+			row[ x * 3 + 1 ] = (uint8_t)( pixel >> 16 );
+			row[ x * 3 + 2 ] = (uint8_t)( pixel >> 8 );
+		}
+		file.write( (const char*)row.data(), row.size() );
+	}
+
+	return (bool)file;
+}
+
+bool MCG::SavePNG( std::ofstream &file )
+{
+	// Every PNG starts with this signature
+	const uint8_t signature[ 8 ] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+	file.write( (const char*)signature, 8 );
+
+	// Header: width, height (big-endian), 8 bits per channel, colour type 2 (RGB), default compression, filter and no interlacing
+	std::vector<uint8_t> header;
+	for( int value : { _winSize.x, _winSize.y } )
+	{
+		header.push_back( (uint8_t)( value >> 24 ) );
+		header.push_back( (uint8_t)( value >> 16 ) );
+		header.push_back( (uint8_t)( value >> 8 ) );
+		header.push_back( (uint8_t)value );
+	}
+	header.insert( header.end(), { 8, 2, 0, 0, 0 } );
+	WritePNGChunk( file, "IHDR", header );
+
+	// The image data is each row prefixed with filter type 0 (none)
+	std::vector<uint8_t> raw;
+	raw.reserve( _winSize.y * ( 1 + _winSize.x * 3 ) );
+	for( int y = 0; y < _winSize.y; y++ )
+	{
+		raw.push_back( 0 );
+		for( int x = 0; x < _winSize.x; x++ )
+		{
+			uint32_t pixel = _framebuffer[ y * _winSize.x + x ];
+			raw.push_back( (uint8_t)( pixel >> 24 ) );
+			raw.push_back( (uint8_t)( pixel >> 16 ) );
+			raw.push_back( (uint8_t)( pixel >> 8 ) );
+		}
+	}
+
+	// That is wrapped in a zlib stream made of uncompressed deflate blocks, which keeps this simple at the cost of file size
+	std::vector<uint8_t> compressed = { 0x78, 0x01 };
+	size_t offset = 0;
+	do
+	{
+		size_t blockSize = std::min( raw.size() - offset, (size_t)65535 );
+		bool last = offset + blockSize == raw.size();
+
+		// Block header is the final flag and type 0 (stored), then the length and its complement, little-endian
+		compressed.push_back( last ? 1 : 0 );
+		compressed.push_back( (uint8_t)blockSize );
+		compressed.push_back( (uint8_t)( blockSize >> 8 ) );
+		compressed.push_back( (uint8_t)~blockSize );
+		compressed.push_back( (uint8_t)( ~blockSize >> 8 ) );
+		compressed.insert( compressed.end(), raw.begin() + offset, raw.begin() + offset + blockSize );
+
+		offset += blockSize;
+	} while( offset < raw.size() );
+
+	// zlib ends with an Adler-32 checksum of the uncompressed data, big-endian
+	uint32_t adlerA = 1, adlerB = 0;
+	for( uint8_t byte : raw )
+	{
+		adlerA = ( adlerA + byte ) % 65521;
+		adlerB = ( adlerB + adlerA ) % 65521;
+	}
+	uint32_t adler = ( adlerB << 16 ) | adlerA;
+	compressed.insert( compressed.end(), { (uint8_t)( adler >> 24 ), (uint8_t)( adler >> 16 ), (uint8_t)( adler >> 8 ), (uint8_t)adler } );
+	WritePNGChunk( file, "IDAT", compressed );
+
+	WritePNGChunk( file, "IEND", std::vector<uint8_t>() );
+
+	return (bool)file;
+}
+
+void MCG::WritePNGChunk( std::ofstream &file, const char *type, const std::vector<uint8_t> &data )
+{
+	// Length of the data, big-endian
+	uint32_t length = (uint32_t)data.size();
+	uint8_t lengthBytes[ 4 ] = { (uint8_t)( length >> 24 ), (uint8_t)( length >> 16 ), (uint8_t)( length >> 8 ), (uint8_t)length };
+	file.write( (const char*)lengthBytes, 4 );
+	file.write( type, 4 );
+	file.write( (const char*)data.data(), data.size() );
+
+	// The CRC covers the type and data
+	uint32_t crc = 0xFFFFFFFFu;
+	auto addToCRC = [&]( uint8_t byte )
+	{
+		crc ^= byte;
+		for( int bit = 0; bit < 8; bit++ )
+		{
+			crc = ( crc >> 1 ) ^ ( 0xEDB88320u & ( 0u - ( crc & 1u ) ) );
+		}
+	};
+	for( int i = 0; i < 4; i++ )
+	{
+		addToCRC( (uint8_t)type[ i ] );
+	}
+	for( uint8_t byte : data )
+	{
+		addToCRC( byte );
+	}
+	crc ^= 0xFFFFFFFFu;
+
+	uint8_t crcBytes[ 4 ] = { (uint8_t)( crc >> 24 ), (uint8_t)( crc >> 16 ), (uint8_t)( crc >> 8 ), (uint8_t)crc };
+	file.write( (const char*)crcBytes, 4 );
+}
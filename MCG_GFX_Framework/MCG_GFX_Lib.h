@@ -5,6 +5,10 @@
 // The GLM library contains vector and matrix functions and classes for us to use
 #include <GLM/glm.hpp> // This is the main GLM header
 #include <GLM/gtc/matrix_transform.hpp> // This one lets us use matrix transformations
+// Fixed size integer types for the framebuffer
+#include <cstdint>
+// For image file paths
+#include <string>
 
 /// The MCG namespace provides all the functions to draw a pixel to the screen.
 /// You should not be modifying this code for your assignment, you must use it as-is.
@@ -15,6 +19,12 @@ namespace MCG
 	/// \return False if something went wrong
 	bool Init( glm::ivec2 windowSize );
 
+	/// Initialises just the framebuffer, without SDL or a window, for rendering on machines with no display
+	/// The windowSize parameter specifies how many pixels wide and high the framebuffer should be
+	/// Everything else works as normal, except ProcessFrame and ShowAndHold have nothing to show. Use SaveImage to get the result.
+	/// \return False if something went wrong
+	bool InitHeadless( glm::ivec2 windowSize );
+
 	/// Sets every pixel to specified colour
 	/// The colour parameter ranges from 0 to 1. Values outside this range are clamped.
 	void SetBackground( glm::vec3 colour );
@@ -22,8 +32,21 @@ namespace MCG
 	/// Draws a single pixel to screen
 	/// The position parameter is in pixel-coordinates, ranging from 0,0 to the size of the screen set with the Init function. If coordinates are out of bounds, does nothing.
 	/// The colour parameter ranges from 0 to 1. Values outside this range are clamped.
+	/// This writes into the framebuffer, see GetFramebuffer
 	void DrawPixel( glm::ivec2 position, glm::vec3 colour );
 
+	/// Gets the CPU-side framebuffer: one packed RGBA8 value per pixel (see PackColour), in rows of the window's width, top row first
+	/// Write pixels into this directly, it is uploaded to the window in one go by ProcessFrame and ShowAndHold
+	/// Separate threads may write separate pixels at the same time, but must be finished before the next upload
+	uint32_t *GetFramebuffer();
+
+	/// \return The framebuffer's width and height in pixels (the window size given to Init)
+	glm::ivec2 GetFramebufferSize();
+
+	/// Converts a colour to the framebuffer's packed RGBA8 format
+	/// The colour parameter ranges from 0 to 1. Values outside this range are clamped.
+	uint32_t PackColour( glm::vec3 colour );
+
 	/// Displays graphics to screen and keeps window open until user requests exit (pressing escape key or closing window)
 	int ShowAndHold();
 
@@ -33,6 +56,11 @@ namespace MCG
 	/// For cleanly shutting down the graphics system
 	void Cleanup();
 
+	/// Writes the framebuffer to an image file
+	/// The format is picked from the path's extension: .png gives a PNG, anything else gives a binary PPM
+	/// \return False if the file couldn't be written
+	bool SaveImage( std::string path );
+
 };
 
 
@@ -1,36 +1,411 @@
 ﻿
 #include <cmath>
+#include <vector>
+#include <string>
+#include <limits>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <deque>
 #include <list>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <sstream>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <algorithm>
 
 #include "MCG_GFX_Lib.h"
 
-// HitData prototype
+// Memory mapping and memory usage are done differently on each platform
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NOGDI	// Keeps wingdi's Rectangle function from clashing with the Rectangle shape
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// SIMD kernels are only built for x86, other targets just use the scalar versions
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC lets any function use any instruction set's intrinsics
+#define TARGET_SSE41
+#define TARGET_AVX2
+#else
+// GCC and Clang have to be told which functions can use instructions beyond the ones the build targets
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Enum prototypes
+enum class SimdLevel;
+enum class BVHBuilder;
+enum class SceneMix;
+enum class HeatmapMetric;
+
+// Struct prototypes
 struct HitData;
+struct AABB;
+struct BVHNode;
+struct SceneCacheHeader;
+struct ShapeHit;
+struct PixelHit;
+struct SceneEdit;
+struct Keyframe;
+struct AnimationTrack;
+struct PlanarLayer;
+struct SphereBlock;
+struct RectangleBlock;
+struct CircleBlock;
+struct TriangleBlock;
+struct MeshBlock;
+struct TriangleRay;
+struct RayPacket;
+struct ProfileEvent;
+struct ProfileThreadLog;
 
 // Class prototypes
 class Ray;
-class Sphere;
+class PrimitiveArrayBase;
+class Arena;
+class MappedFile;
 class Scene;
 class RayTracer;
 class Camera;
+class BVH;
+class PlanarLayerIndex;
+class UniformGrid;
+class WorkerPool;
+class TileRenderer;
+class SceneFileParser;
+class ObjFileReader;
+class ProfileScope;
+class ProfilePhaseTimer;
 
 // Function prototypes
 void display_vec3(glm::vec3 vec);
-float area_of_triangle(int x1, int y1, int x2, int y2, int x3, int y3);
-bool point_inside_triangle(int x1, int y1, int x2, int y2, int x3, int y3, int px, int py);
-HitData get_ray_triangle_intersection(Ray ray, float z, glm::vec2 pointA, glm::vec2 pointB, glm::vec2 pointC);
+TriangleRay get_triangle_ray(Ray ray);
+float get_ray_triangle_distance(const TriangleRay& ray, glm::vec3 pointA, glm::vec3 pointB, glm::vec3 pointC);
+HitData get_ray_triangle_intersection(const TriangleRay& ray, glm::vec3 pointA, glm::vec3 pointB, glm::vec3 pointC);
+glm::vec3 get_triangle_normal(glm::vec3 pointA, glm::vec3 pointB, glm::vec3 pointC);
 HitData get_ray_rectangle_intersection(Ray ray, glm::vec3 rect_pos, float rect_width, float rect_height);
 HitData get_ray_circle_intersection(Ray ray, glm::vec3 circle_pos, float circle_radius);
+bool is_point_in_rectangle(glm::vec3 point, glm::vec3 centre, float width, float height);
+bool is_point_in_circle(glm::vec3 point, glm::vec3 centre, float radius);
 glm::vec3 get_point_at_z(Ray ray, float z);
 float get_direction_difference(glm::vec3 dir1, glm::vec3 dir2);
-glm::vec3 get_normal_on_sphere(Sphere sphere, glm::vec3 queryPoint);
-bool check_inside_sphere(Sphere sphere, glm::vec3 queryPoint);
-bool check_ahead_ray(Ray ray, glm::vec3 queryPoint);
-glm::vec3 get_closest_point_on_line(Ray line, glm::vec3 queryPoint);
-HitData get_ray_sphere_intersection(Ray ray, Sphere sphere);
+glm::vec3 get_normal_on_sphere(glm::vec3 sphereCentre, glm::vec3 queryPoint);
+float get_ray_sphere_distance(glm::vec3 origin, glm::vec3 direction, float directionLength, glm::vec3 sphereCentre, float sphereRadius);
+HitData get_ray_sphere_intersection(Ray ray, glm::vec3 sphereCentre, float sphereRadius);
+SimdLevel get_supported_simd_level();
+int get_nearest_sphere_hit_scalar(Ray ray, const float* centreX, const float* centreY, const float* centreZ, const float* radius, size_t count, float& nearestDistance);
+int get_nearest_sphere_hit(Ray ray, const float* centreX, const float* centreY, const float* centreZ, const float* radius, size_t count, float& nearestDistance);
+int get_lane_count(int laneMask);
+int get_packet_sphere_hits_scalar(const RayPacket& packet, int laneMask, glm::vec3 sphereCentre, float sphereRadius, float* distances);
+int get_packet_sphere_hits(const RayPacket& packet, int laneMask, glm::vec3 sphereCentre, float sphereRadius, float* distances);
 float get_length_between_points(glm::vec3 point1, glm::vec3 point2);
+const char* read_decimal(const char* cursor, float& value);
+AABB get_empty_aabb();
+AABB get_aabb_union(AABB box1, AABB box2);
+AABB get_aabb_from_points(glm::vec3 point1, glm::vec3 point2);
+float get_aabb_surface_area(AABB box);
+glm::vec3 get_aabb_centre(AABB box);
+AABB get_transformed_aabb(AABB box, const glm::mat4x3& transform);
+uint32_t get_spread_bits(uint32_t value);
+uint32_t get_morton_code(glm::vec3 position);
+glm::vec3 get_safe_inverse_direction(glm::vec3 direction);
+bool get_ray_aabb_entry(glm::vec3 origin, glm::vec3 inverseDirection, AABB box, float maxDistance, float& entryDistance);
+int get_packet_aabb_mask_scalar(const RayPacket& packet, AABB box, int laneMask, const float* maxDistances, float* entryDistances);
+int get_packet_aabb_mask(const RayPacket& packet, AABB box, int laneMask, const float* maxDistances, float* entryDistances);
+glm::vec2 get_sample_offset(int sample, int gridSize, glm::vec2 jitter);
+float get_colour_contrast(uint32_t colourA, uint32_t colourB);
+void add_random_shapes(Scene& scene, int shapeCount, glm::ivec2 windowSize, std::mt19937& generator);
+void add_layered_shapes(Scene& scene, int layerCount, int shapesPerLayer, glm::ivec2 windowSize, std::mt19937& generator);
+void add_particle_spheres(Scene& scene, int sphereCount, bool clustered, glm::ivec2 windowSize, std::mt19937& generator);
+void add_generated_shapes(Scene& scene, SceneMix mix, int shapeCount, glm::ivec2 windowSize, std::mt19937& generator);
+size_t get_peak_memory_usage();
+bool load_scene_file(std::string path, Scene& scene, glm::ivec2& windowSize, glm::ivec2& viewingSize);
+bool load_obj_file(std::string path, Scene& scene, glm::vec3 centre, float size, glm::vec3 colour);
+std::vector<AABB> get_scene_shape_bounds(const Scene& scene);
+void build_scene_bvh(const Scene& scene, BVH& bvh, BVHBuilder builder);
+void run_in_parallel(int taskCount, const std::function<void(int)>& task);
+bool is_scene_cache_file(std::string path);
+bool write_scene_cache(std::string path, const Scene& scene, glm::ivec2 windowSize, glm::ivec2 viewingSize);
+bool load_scene_cache(std::string path, Scene& scene, glm::ivec2& windowSize, glm::ivec2& viewingSize);
+bool write_random_scene_file(std::string path, int shapeCount, glm::ivec2 windowSize, std::mt19937& generator);
+bool write_grid_obj_file(std::string path, int gridSize);
+bool write_profile_trace(std::string path);
+std::string get_numbered_path(std::string path, int number);
+bool write_float_image(std::string path, const float* values, glm::ivec2 size);
+glm::vec3 get_heat_colour(float heat);
+bool write_heatmap(const Camera& camera, const RayTracer& rayTracer, glm::ivec2 windowSize, HeatmapMetric metric, std::string pathPrefix);
+void keep_traced_colours(glm::vec3 colourSum);
+std::string format_count_per_ray(bool counted, double countPerRay);
+int run_bvh_benchmark();
+int run_allocation_benchmark();
+int run_thread_scaling_benchmark();
+int run_scene_load_benchmark();
+int run_startup_benchmark();
+int run_layout_benchmark();
+int run_sphere_kernel_benchmark();
+int run_triangle_benchmark();
+int run_mesh_benchmark();
+int run_packet_benchmark();
+int run_benchmark_suite(const std::vector<glm::ivec2>& resolutions);
+int run_shadow_benchmark();
+int run_antialiasing_benchmark();
+int run_layer_benchmark();
+int run_grid_benchmark();
+int run_scene_edit_benchmark();
+int run_bvh_build_benchmark();
+int run_animation_benchmark();
+int run_instancing_benchmark();
+
+
+// Counts every heap allocation made by the program, so benchmarks can check hot loops don't allocate
+// Only compiled in when RAYTRACER_COUNT_ALLOCATIONS is defined, as every allocation on every thread would otherwise pay for the count
+std::atomic<long long> gHeapAllocationCount(0);
+
+#ifdef RAYTRACER_COUNT_ALLOCATIONS
+const bool kCountsHeapAllocations = true;
+
+// GCC warns that memory from operator new goes to free wherever it inlines a delete, so they're kept out of line
+#ifdef _MSC_VER
+#define NO_INLINE __declspec(noinline)
+#else
+#define NO_INLINE __attribute__((noinline))
+#endif
+
+void* operator new(std::size_t size)
+{
+	gHeapAllocationCount++;
+
+	void* memory = std::malloc(size > 0 ? size : 1);
+	if (!memory)
+	{
+		throw std::bad_alloc();
+	};
+
+	return memory;
+};
+
+NO_INLINE void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+};
+
+NO_INLINE void operator delete(void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+};
+#else
+const bool kCountsHeapAllocations = false;
+#endif
+
+
+// Instruction sets the sphere kernel comes in, narrowest first
+enum class SimdLevel
+{
+	Scalar,	// One sphere at a time
+	SSE41,	// 4 spheres at a time
+	AVX2	// 8 spheres at a time
+};
+
+// Instruction set the sphere kernel uses, the widest this CPU supports unless a benchmark changes it
+SimdLevel gSphereKernelLevel = get_supported_simd_level();
+// Instruction set the ray packet box and sphere tests use, the widest this CPU supports unless a benchmark changes it
+SimdLevel gPacketKernelLevel = get_supported_simd_level();
+
+
+// Every kind of shape a scene can hold
+enum class ShapeType
+{
+	Sphere,
+	Rectangle,
+	Circle,
+	Triangle,
+	Mesh
+};
+// Number of shape types above
+const int kShapeTypeCount = 5;
+
+// Counts the ray-shape intersection tests made on this thread by shape type (each mesh triangle tested counts as a mesh test), so benchmarks and heatmaps can work out what tests cost and where they go
+thread_local uint64_t gIntersectionTestCounts[kShapeTypeCount] = {};
+// Counts the BVH nodes this thread has visited, mesh hierarchies' nodes included (a packet visiting a node counts once)
+thread_local uint64_t gTraversalStepCount = 0;
+
+// Neither counter counts unless RAYTRACER_COUNT_TESTS is defined, as every test and step would otherwise pay for the count
+#ifdef RAYTRACER_COUNT_TESTS
+const bool kCountsIntersectionTests = true;
+const bool kCountsTraversalSteps = true;
+#define COUNT_TRAVERSAL_STEP() gTraversalStepCount++
+#else
+const bool kCountsIntersectionTests = false;
+const bool kCountsTraversalSteps = false;
+#define COUNT_TRAVERSAL_STEP()
+#endif
+
+// Counts ray-shape intersection tests in gIntersectionTestCounts and the profile's PrimitiveTests counter (see PROFILE_COUNT below), compiling out when neither is built in
+#ifdef RAYTRACER_COUNT_TESTS
+#define COUNT_INTERSECTION_TESTS(type, amount) { uint64_t testCount = (amount); gIntersectionTestCounts[(int)(type)] += testCount; PROFILE_COUNT(PrimitiveTests, testCount); }
+#else
+#define COUNT_INTERSECTION_TESTS(type, amount) PROFILE_COUNT(PrimitiveTests, amount)
+#endif
+
+// Gets the intersection tests this thread has made, of every type
+uint64_t get_intersection_test_count()
+{
+	uint64_t count = 0;
+	for (int type = 0; type < kShapeTypeCount; type++)
+	{
+		count += gIntersectionTestCounts[type];
+	};
+
+	return count;
+};
+
+
+// Per-phase instrumentation, only compiled in when RAYTRACER_PROFILE is defined (e.g. in the project's preprocessor definitions)
+// PROFILE_SCOPE records a span on the calling thread's timeline, for coarse work such as loading, building, frames and tiles
+// PROFILE_PHASE adds the time to the end of the enclosing block to one of the thread's counters, for work done once per ray
+// PROFILE_COUNT adds to one of the thread's counters
+// Each span keeps how much every counter grew while it was open, so a tile's span shows the rays, tests, hits and phase times inside it
+// write_profile_trace saves the spans as Chrome trace-event JSON
+#ifdef RAYTRACER_PROFILE
+// Per-thread counters spans keep the growth of, times are in nanoseconds
+enum class ProfileCounter
+{
+	Rays,
+	BoxTests,
+	PrimitiveTests,
+	Hits,
+	RayGenerationNs,
+	TraversalNs,
+	ShadingNs
+};
+const int kProfileCounterCount = 7;
+
+// One finished span
+struct ProfileEvent
+{
+	const char* mName;
+	int64_t mStartNs;
+	int64_t mDurationNs;
+	uint64_t mCounts[kProfileCounterCount];
+};
+
+// Everything one thread has recorded
+struct ProfileThreadLog
+{
+	int mThreadIndex;
+	uint64_t mCounters[kProfileCounterCount];
+	std::vector<ProfileEvent> mEvents;
+};
+
+// Every thread's log, kept after the thread ends so the trace can still be written
+std::mutex gProfileLogsMutex;
+std::vector<std::unique_ptr<ProfileThreadLog>> gProfileLogs;
+// Span times are measured from here
+const std::chrono::steady_clock::time_point gProfileStart = std::chrono::steady_clock::now();
+// The calling thread's log, made on its first use
+thread_local ProfileThreadLog* gProfileThreadLog = nullptr;
+
+ProfileThreadLog& get_profile_thread_log()
+{
+	if (!gProfileThreadLog)
+	{
+		std::lock_guard<std::mutex> lock(gProfileLogsMutex);
+		gProfileLogs.push_back(std::unique_ptr<ProfileThreadLog>(new ProfileThreadLog()));
+		gProfileThreadLog = gProfileLogs.back().get();
+		gProfileThreadLog->mThreadIndex = (int)gProfileLogs.size() - 1;
+		std::fill(gProfileThreadLog->mCounters, gProfileThreadLog->mCounters + kProfileCounterCount, 0);
+	};
+
+	return *gProfileThreadLog;
+};
+
+int64_t get_profile_time_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - gProfileStart).count();
+};
+
+// Records a span on the thread's timeline from construction to destruction
+class ProfileScope
+{
+private:
+	ProfileThreadLog& mLog;
+	const char* mName;
+	int64_t mStartNs;
+	uint64_t mStartCounts[kProfileCounterCount];
+
+public:
+	ProfileScope(const char* name) : mLog(get_profile_thread_log()), mName(name)
+	{
+		std::copy(mLog.mCounters, mLog.mCounters + kProfileCounterCount, mStartCounts);
+		mStartNs = get_profile_time_ns();
+	};
+	~ProfileScope()
+	{
+		ProfileEvent event;
+		event.mName = mName;
+		event.mStartNs = mStartNs;
+		event.mDurationNs = get_profile_time_ns() - mStartNs;
+		for (int i = 0; i < kProfileCounterCount; i++)
+		{
+			event.mCounts[i] = mLog.mCounters[i] - mStartCounts[i];
+		};
+
+		mLog.mEvents.push_back(event);
+	};
+};
+
+// Adds the time from construction to destruction to one of the thread's counters
+class ProfilePhaseTimer
+{
+private:
+	uint64_t& mCounter;
+	int64_t mStartNs;
+
+public:
+	ProfilePhaseTimer(ProfileCounter counter) : mCounter(get_profile_thread_log().mCounters[(int)counter])
+	{
+		mStartNs = get_profile_time_ns();
+	};
+	~ProfilePhaseTimer()
+	{
+		mCounter += get_profile_time_ns() - mStartNs;
+	};
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_PHASE(counter) ProfilePhaseTimer PROFILE_CONCAT(profilePhase, __LINE__)(ProfileCounter::counter)
+#define PROFILE_COUNT(counter, amount) (get_profile_thread_log().mCounters[(int)ProfileCounter::counter] += (amount))
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_PHASE(counter)
+#define PROFILE_COUNT(counter, amount)
+#endif
 
 
 struct HitData
@@ -42,6 +417,142 @@ struct HitData
 };
 
 
+// The closest hit found so far along a ray, and which shape it was on
+struct ShapeHit
+{
+	HitData mHit;
+	// Stores the distance from the ray origin to the hit
+	float mDistance;
+	ShapeType mType;
+	// Stores the shape's index in its type's arrays
+	size_t mIndex;
+	// Stores which of a mesh's triangles was hit
+	uint32_t mTriangle;
+};
+
+
+// What a pixel's ray hit, kept by TileRenderer so it can anti-alias a frame and bring it up to date after a scene edit without tracing it all again
+struct PixelHit
+{
+	// Stores the ID of the shape hit (see RayTracer::TraceRay)
+	uint32_t mShapeId;
+	// Stores how lit the hit point is, the shape's colour is multiplied by this
+	float mShading;
+	// Stores the colour the ray gave the pixel, packed as in the framebuffer
+	uint32_t mColour;
+};
+
+
+// A ray set up for the watertight triangle test (see get_triangle_ray)
+struct TriangleRay
+{
+	glm::vec3 mOrigin;
+	glm::vec3 mDirection;
+	// Stores the rows of the matrix that moves points into the space where the ray runs straight down z
+	// Each row picks one axis (z being the one the ray moves along most) and shears it by the ray's direction, see get_triangle_ray
+	glm::vec3 mRowX, mRowY, mRowZ;
+};
+
+
+struct AABB
+{
+	// Stores the corner with the smallest coordinates
+	glm::vec3 mMin;
+	// Stores the corner with the largest coordinates
+	glm::vec3 mMax;
+};
+
+
+// What one edit to a ray tracer's scene changed (see RayTracer::MoveShape and the other edits), for TileRenderer::UpdateFrame
+struct SceneEdit
+{
+	// Stores the bounds the edited shape had before and after the edit, empty when it didn't exist then
+	AABB mOldBounds;
+	AABB mNewBounds;
+	// Stores the edited shape's ID (see RayTracer::TraceRay), as it was before the edit if the shape was removed
+	uint32_t mShapeId;
+	// Stores how much the IDs from mShapeId on moved, 1 when a shape was added, -1 when one was removed
+	int mIdShift;
+	// Stores if only the shape's colour changed, so pixels can be shaded again without tracing
+	bool mRecoloured;
+};
+
+
+// Where a keyframed shape is at one frame of a scene's animation, as an offset from where it was added (see Scene::AddKeyframe)
+struct Keyframe
+{
+	float mFrame;
+	glm::vec3 mOffset;
+};
+
+
+// The keyframes of one shape in a scene's animation
+struct AnimationTrack
+{
+	// Stores the shape's type and index in that type's arrays, which unlike its index as a whole don't change as other types gain shapes
+	ShapeType mType;
+	size_t mTypeIndex;
+	// Stores where the shape's keyframes are in the scene's list of them, in frame order
+	int mFirstKey;
+	int mKeyCount;
+	// Stores the offset the shape has been moved by so far
+	glm::vec3 mOffset;
+};
+
+
+struct BVHNode
+{
+	// Stores the bounds of every primitive below this node
+	AABB mBounds;
+	// Stores the first primitive index for leaves, or the left child index for interior nodes (the right child follows it)
+	int mLeftFirst;
+	// Stores the number of primitives in a leaf, zero for interior nodes
+	int mCount;
+};
+
+
+// One z layer of a PlanarLayerIndex, with a grid over its shapes' bounds
+struct PlanarLayer
+{
+	// Stores the z every shape on the layer lies at
+	float mZ;
+	// Stores the corners of the grid, which just covers the layer's shapes
+	glm::vec2 mGridMin;
+	glm::vec2 mGridMax;
+	// Stores the grid's width and height in cells, and how many cells there are per unit along each
+	int mGridX, mGridY;
+	glm::vec2 mCellsPerUnit;
+	// Stores the index of the layer's first cell in the index's cell list
+	int mFirstCell;
+};
+
+
+// Changes whenever the scene cache layout does, caches with other versions have to be rebuilt from their text scene
+const uint32_t kSceneCacheVersion = 5;
+// Most arrays a scene cache can describe
+const int kMaxSceneCacheArrays = 64;
+
+
+// Start of a binary scene cache file, the arrays it describes follow it
+// The arrays are every shape array from Scene::GetArrays (spheres, then rectangles, circles, triangles and meshes), then the mesh pools from Scene::GetMeshPoolArrays, then the BVH's nodes and primitive indices
+// Values are stored in the native (little-endian) layout so the arrays can be used straight from a mapping of the file
+struct SceneCacheHeader
+{
+	// Identifies the file as a scene cache, "RTSCENE" followed by a null
+	char mMagic[8];
+	uint32_t mVersion;
+	int32_t mWindowSize[2];
+	int32_t mViewingSize[2];
+	float mLightDirection[3];
+	// How many arrays follow
+	uint32_t mArrayCount;
+	// Where each array starts (in bytes from the start of the file), how many elements it holds and how big each one is
+	uint64_t mArrayOffsets[kMaxSceneCacheArrays];
+	uint64_t mArrayCounts[kMaxSceneCacheArrays];
+	uint32_t mElementSizes[kMaxSceneCacheArrays];
+};
+
+
 class Ray
 {
 private:
@@ -58,17 +569,50 @@ public:
 	};
 	~Ray() {};
 
-	glm::vec3 GetOrigin()
+	glm::vec3 GetOrigin() const
 	{
 		return mOrigin;
 	};
-	glm::vec3 GetDirection()
+	glm::vec3 GetDirection() const
 	{
 		return mDirection;
 	};
 };
 
 
+// Number of rays in a packet, one per lane of an AVX register
+const int kPacketWidth = 8;
+// Width and height in pixels of the block of primary rays a packet holds
+const int kPacketSizeX = 4;
+const int kPacketSizeY = 2;
+
+
+// Rays traced together as a packet, stored one array per component so a SIMD register can hold the same component of every ray
+struct RayPacket
+{
+	alignas(32) float mOriginX[kPacketWidth];
+	alignas(32) float mOriginY[kPacketWidth];
+	alignas(32) float mOriginZ[kPacketWidth];
+	alignas(32) float mDirectionX[kPacketWidth];
+	alignas(32) float mDirectionY[kPacketWidth];
+	alignas(32) float mDirectionZ[kPacketWidth];
+	// Stores 1 / direction (see get_safe_inverse_direction) and the direction's length, as every box test needs them
+	alignas(32) float mInverseDirectionX[kPacketWidth];
+	alignas(32) float mInverseDirectionY[kPacketWidth];
+	alignas(32) float mInverseDirectionZ[kPacketWidth];
+	alignas(32) float mDirectionLength[kPacketWidth];
+	// Stores which lanes hold a ray to trace, one bit per lane (the others still hold valid numbers)
+	int mActiveMask;
+
+	Ray GetRay(int lane) const
+	{
+		return Ray(glm::vec3(mOriginX[lane], mOriginY[lane], mOriginZ[lane]), glm::vec3(mDirectionX[lane], mDirectionY[lane], mDirectionZ[lane]));
+	};
+};
+
+
+// One heap object per shape, reached through a virtual call
+// Scenes no longer store shapes like this, it's only kept so --bench-layout can compare against it
 class BaseShape
 {
 protected:
@@ -83,17 +627,18 @@ public:
 		mPos = pos;
 		mColour = colour;
 	};
+	virtual ~BaseShape() {};
 
 	// Gets the colour modifier for the pixel (adjusts brightness based on lighting)
-	virtual float GetColourModifier(glm::vec3 lightDirection, glm::vec3 intersectionPoint) { return 0; };
+	virtual float GetColourModifier(glm::vec3 lightDirection, glm::vec3 intersectionPoint) const { return 0; };
 	// Gets data on if the given ray collides with the shape
-	virtual HitData GetHit(Ray ray) { return HitData{ false, glm::vec3(0, 0, 0) }; };
+	virtual HitData GetHit(Ray ray) const { return HitData{ false, glm::vec3(0, 0, 0) }; };
 
-	glm::vec3 GetPos()
+	glm::vec3 GetPos() const
 	{
 		return mPos;
 	};
-	glm::vec3 GetColour()
+	glm::vec3 GetColour() const
 	{
 		return mColour;
 	};
@@ -104,29 +649,26 @@ class Triangle : public BaseShape
 {
 private:
 	// Stores the 3 corner points of the triangle
-	glm::vec2 mAPos, mBPos, mCPos;
+	glm::vec3 mAPos, mBPos, mCPos;
 
 public:
-	Triangle(float z, glm::vec2 aPos, glm::vec2 bPos, glm::vec2 cPos, glm::vec3 colour)
-		: BaseShape(glm::vec3(0, 0, z), colour)
+	Triangle(glm::vec3 aPos, glm::vec3 bPos, glm::vec3 cPos, glm::vec3 colour)
+		: BaseShape(aPos, colour)
 	{
 		mAPos = aPos;
 		mBPos = bPos;
 		mCPos = cPos;
 	};
 
-	float GetColourModifier(glm::vec3 lightDirection, glm::vec3 intersectionPoint)
+	float GetColourModifier(glm::vec3 lightDirection, glm::vec3 intersectionPoint) const
 	{
-		// Basic colour modifier for 2D objects
-		return pow(1 - get_direction_difference(lightDirection, glm::vec3(0, 0, -1)), 2);
+		// Colour modifier based on the triangle's normal
+		return pow(1 - get_direction_difference(lightDirection, get_triangle_normal(mAPos, mBPos, mCPos)), 2);
 	};
-	HitData GetHit(Ray ray)
+	HitData GetHit(Ray ray) const
 	{
-		// Allows for the triangle's points to be moved evenly based on shape position
-		glm::vec2 posAdj(mPos.x, mPos.y);
-
 		// Gets intersection data
-		return get_ray_triangle_intersection(ray, mPos.z, mAPos + posAdj, mBPos + posAdj, mCPos + posAdj);
+		return get_ray_triangle_intersection(get_triangle_ray(ray), mAPos, mBPos, mCPos);
 	};
 };
 
@@ -145,12 +687,12 @@ public:
 		mHeight = height;
 	};
 
-	float GetColourModifier(glm::vec3 lightDirection, glm::vec3 intersectionPoint)
+	float GetColourModifier(glm::vec3 lightDirection, glm::vec3 intersectionPoint) const
 	{
 		// Basic colour modifier for 2D objects
 		return pow(1 - get_direction_difference(lightDirection, glm::vec3(0, 0, -1)), 2);
 	};
-	HitData GetHit(Ray ray)
+	HitData GetHit(Ray ray) const
 	{
 		// Gets intersection data
 		return get_ray_rectangle_intersection(ray, mPos, mWidth, mHeight);
@@ -171,12 +713,12 @@ public:
 		mRadius = radius;
 	};
 
-	float GetColourModifier(glm::vec3 lightDirection, glm::vec3 intersectionPoint)
+	float GetColourModifier(glm::vec3 lightDirection, glm::vec3 intersectionPoint) const
 	{
 		// Basic colour modifier for 2D objects
 		return pow(1 - get_direction_difference(lightDirection, glm::vec3(0, 0, -1)), 2);
 	};
-	HitData GetHit(Ray ray)
+	HitData GetHit(Ray ray) const
 	{
 		// Gets intersection data
 		return get_ray_circle_intersection(ray, mPos, mRadius);
@@ -197,561 +739,8708 @@ public:
 		mRadius = radius;
 	};
 
-	float GetColourModifier(glm::vec3 lightDirection, glm::vec3 intersectionPoint) 
+	float GetColourModifier(glm::vec3 lightDirection, glm::vec3 intersectionPoint) const
 	{
 		// Get normal to the sphere at intersection point
-		glm::vec3 sphereNormal = get_normal_on_sphere(*this, intersectionPoint);
+		glm::vec3 sphereNormal = get_normal_on_sphere(mPos, intersectionPoint);
 
 		// Gets colour modifier based on similarity of normal and light direction
 		return pow(1 - get_direction_difference(lightDirection, sphereNormal), 2);
 	};
-	HitData GetHit(Ray ray)
+	HitData GetHit(Ray ray) const
 	{
 		// Gets intersection data
-		return get_ray_sphere_intersection(ray, *this);
-	};
-	int GetRadius()
-	{
-		return mRadius;
+		return get_ray_sphere_intersection(ray, mPos, mRadius);
 	};
 };
 
 
-class Scene
+// Ways of building a BVH, trading how long the build takes for how fast the tree is to trace
+enum class BVHBuilder
 {
-private:
-	// Stores the vector direction for lighting
-	glm::vec3 mLightDirection;
-	// List of shapes to render
-	std::list<BaseShape*> mShapes;
+	SAH,	// Splits nodes at the cheapest of a set of binned planes by the surface area heuristic
+	Morton	// Sorts primitives along a Morton curve by radix sort and splits nodes where their codes first differ
+};
 
-public:
-	Scene(glm::vec3 lightDirection) 
-	{
-		mLightDirection = lightDirection;
-	};
-	~Scene() {};
 
-	// Adds sphere to shapes list
-	void AddSphere(glm::vec3 centre, float radius, glm::vec3 colour)
-	{
-		mShapes.push_back(new Sphere(centre, radius, colour));
-	};
-	// Adds rectangle to shapes list
-	void AddRectangle(glm::vec3 centre, float width, float height, glm::vec3 colour)
-	{
-		mShapes.push_back(new Rectangle(centre, width, height, colour));
-	};
-	// Addes circle to shapes list
-	void AddCircle(glm::vec3 centre, float radius, glm::vec3 colour)
+class BVH
+{
+private:
+	// Stores the tree, the root is always the first node
+	std::vector<BVHNode> mNodes;
+	// Stores the primitive indices in leaf order (leaves reference ranges of this)
+	std::vector<int> mPrimIndices;
+	// Stores a prebuilt tree owned by someone else (e.g. a mapped scene cache), used instead of the above when set
+	const BVHNode* mExternalNodes;
+	int mExternalNodeCount;
+	const int* mExternalPrimIndices;
+	int mExternalPrimCount;
+	// Stores per-primitive bounds and centres while building
+	std::vector<AABB> mPrimBounds;
+	std::vector<glm::vec3> mPrimCentres;
+	// Stores per-primitive Morton codes in the same order as mPrimIndices while building with BVHBuilder::Morton
+	std::vector<uint32_t> mMortonCodes;
+
+	// Number of buckets primitive centres are sorted into when looking for a split
+	static const int kBinCount = 16;
+	// Leaves are never bigger than this unless the primitives can't be separated
+	static const int kMaxLeafSize = 4;
+	// Keeps the tree shallow enough for the fixed size traversal stack
+	static const int kMaxDepth = 48;
+	// Nodes with more primitives than this are split with the work spread across threads, smaller ones are built whole by one thread each
+	static const int kSubtreeSize = 8192;
+	// Primitives each thread takes at once while splitting a node across threads
+	static const int kBuildChunkSize = 16384;
+
+	// Gets the bounds of a range of primitives
+	AABB GetRangeBounds(int first, int count) const
 	{
-		mShapes.push_back(new Circle(centre, radius, colour));
+		AABB bounds = get_empty_aabb();
+
+		for (int i = first; i < first + count; i++)
+		{
+			bounds = get_aabb_union(bounds, mPrimBounds[mPrimIndices[i]]);
+		};
+
+		return bounds;
 	};
-	// Addes triangle to shapes list
-	void AddTriangle(float z, glm::vec2 pointA, glm::vec2 pointB, glm::vec2 pointC, glm::vec3 colour)
+	// Gets the box around the centres of a range of primitives, splits are chosen within this
+	AABB GetRangeCentreBounds(int first, int count) const
 	{
-		mShapes.push_back(new Triangle(z, pointA, pointB, pointC, colour));
-	};
+		AABB centreBounds = get_empty_aabb();
 
-	// Gets colour modifer from specific shape
-	float GetColourModifier(BaseShape* shape, glm::vec3 intersectionPoint)
-	{
-		return shape->GetColourModifier(mLightDirection, intersectionPoint);
-	};
+		for (int i = first; i < first + count; i++)
+		{
+			glm::vec3 centre = mPrimCentres[mPrimIndices[i]];
+			centreBounds = get_aabb_union(centreBounds, get_aabb_from_points(centre, centre));
+		};
 
-	glm::vec3 GetLightDirection()
-	{
-		return mLightDirection;
+		return centreBounds;
 	};
-	std::list<BaseShape*> GetShapes()
+	// Sorts a range of primitives into buckets along each axis of centreBounds, binBounds and binCounts hold kBinCount buckets per axis
+	// Axes all the centres sit on the same plane of are left empty, they can't separate anything
+	void FillBins(int first, int count, AABB centreBounds, AABB* binBounds, int* binCounts) const
 	{
-		return mShapes;
-	};
-};
+		for (int bin = 0; bin < 3 * kBinCount; bin++)
+		{
+			binBounds[bin] = get_empty_aabb();
+			binCounts[bin] = 0;
+		};
 
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float axisMin = centreBounds.mMin[axis];
+			float axisExtent = centreBounds.mMax[axis] - axisMin;
+			if (axisExtent <= 0)
+			{
+				continue;
+			};
 
-class RayTracer
-{
-private:
-	// Stores current scene
-	Scene mCurrentScene;
+			float binScale = kBinCount / axisExtent;
+			for (int i = first; i < first + count; i++)
+			{
+				int primIndex = mPrimIndices[i];
+				int bin = axis * kBinCount + std::min(kBinCount - 1, (int)((mPrimCentres[primIndex][axis] - axisMin) * binScale));
 
-public:
-	RayTracer() : mCurrentScene(glm::vec3(1, -1, -1)) {};
-	~RayTracer() {};
+				binBounds[bin] = get_aabb_union(binBounds[bin], mPrimBounds[primIndex]);
+				binCounts[bin]++;
+			};
+		};
+	};
 
-	glm::vec3 TraceRay(Ray ray)
+	// Splits a node in two at the cheapest of the binned planes by the surface area heuristic, adding the children to nodes
+	// Returns false if the node stays a leaf
+	bool SplitBinned(std::vector<BVHNode>& nodes, int nodeIndex, int depth, AABB centreBounds, const AABB* binBounds, const int* binCounts)
 	{
-		// Gets shapes list from scene
-		std::list<BaseShape*> shapes = mCurrentScene.GetShapes();
+		int first = nodes[nodeIndex].mLeftFirst;
+		int count = nodes[nodeIndex].mCount;
 
-		// Initialises default closest hit and shape variables
-		HitData closestHit{ false, glm::vec3(0, 0, 0) };
-		BaseShape* closestShape;
+		// Cost of leaving this node as a leaf (every primitive is tested by any ray that reaches it)
+		float nodeArea = get_aabb_surface_area(nodes[nodeIndex].mBounds);
+		float leafCost = nodeArea * count;
+
+		// Finds the cheapest split plane across all three axes, keeping the bounds of both sides for the children
+		float bestCost = std::numeric_limits<float>::max();
+		int bestAxis = -1;
+		int bestSplit = 0;
+		AABB bestLeftBounds;
+		AABB bestRightBounds;
 
-		// Cycle through list
-		for (BaseShape* currentShape : shapes)
+		for (int axis = 0; axis < 3; axis++)
 		{
-			// Check for collision
-			HitData currentHitData = currentShape->GetHit(ray);
+			const AABB* axisBinBounds = binBounds + axis * kBinCount;
+			const int* axisBinCounts = binCounts + axis * kBinCount;
+
+			// Sweeps from the right to get the bounds and count on the right of each plane
+			AABB rightBounds[kBinCount];
+			int rightCounts[kBinCount];
+			AABB bounds = get_empty_aabb();
+			int rightCount = 0;
+			for (int bin = kBinCount - 1; bin > 0; bin--)
+			{
+				bounds = get_aabb_union(bounds, axisBinBounds[bin]);
+				rightCount += axisBinCounts[bin];
+				rightBounds[bin] = bounds;
+				rightCounts[bin] = rightCount;
+			};
 
-			// If collision detected
-			if (currentHitData.mHit)
+			// Sweeps from the left, evaluating the plane after each bucket
+			AABB leftBounds = get_empty_aabb();
+			int leftCount = 0;
+			for (int bin = 1; bin < kBinCount; bin++)
 			{
-				// Check if closest collision
-				if (!closestHit.mHit || get_length_between_points(currentHitData.mFirstIntersection, ray.GetOrigin()) < get_length_between_points(closestHit.mFirstIntersection, ray.GetOrigin()))
+				leftBounds = get_aabb_union(leftBounds, axisBinBounds[bin - 1]);
+				leftCount += axisBinCounts[bin - 1];
+
+				// Planes with an empty side don't split anything (this includes every plane of an axis left unbinned)
+				if (leftCount == 0 || rightCounts[bin] == 0)
+				{
+					continue;
+				};
+
+				float cost = nodeArea + get_aabb_surface_area(leftBounds) * leftCount + get_aabb_surface_area(rightBounds[bin]) * rightCounts[bin];
+				if (cost < bestCost)
 				{
-					// Update closest hit and shape variables
-					closestHit = currentHitData;
-					closestShape = currentShape;
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = bin;
+					bestLeftBounds = leftBounds;
+					bestRightBounds = rightBounds[bin];
 				};
 			};
 		};
 
-		// If collision detected
-		if (closestHit.mHit)
+		// Stays a leaf if nothing separates the primitives, or if splitting costs more and the leaf is small enough
+		if (bestAxis == -1 || depth >= kMaxDepth || (count <= kMaxLeafSize && bestCost >= leafCost))
 		{
-			// Gets colour modifier from closest shape
-			float colourModifier = mCurrentScene.GetColourModifier(closestShape, closestHit.mFirstIntersection);
-
-			// If collision, return colour
-			return closestShape->GetColour() * colourModifier;
+			return false;
 		};
 
-		// If no collision return black
-		return glm::vec3(0, 0, 0);
-	};
-	void SetScene(Scene scene)
-	{
-		mCurrentScene = scene;
-	};
-};
-
+		// Moves primitives left of the chosen plane to the front of the range
+		float axisMin = centreBounds.mMin[bestAxis];
+		float binScale = kBinCount / (centreBounds.mMax[bestAxis] - axisMin);
+		int* middle = std::partition(&mPrimIndices[first], &mPrimIndices[first] + count, [&](int primIndex)
+		{
+			int bin = std::min(kBinCount - 1, (int)((mPrimCentres[primIndex][bestAxis] - axisMin) * binScale));
+			return bin < bestSplit;
+		});
+		int leftCount = (int)(middle - &mPrimIndices[first]);
 
-class Camera
-{
-private:
-	// Window and viewing variables
-	glm::ivec2 mWindowSize;
-	glm::ivec2 mWindowCentre;
-	glm::ivec2 mViewingSize;
+		// Creates the two children, whose bounds are those of the buckets on each side
+		int leftIndex = (int)nodes.size();
+		nodes.push_back(BVHNode{ bestLeftBounds, first, leftCount });
+		nodes.push_back(BVHNode{ bestRightBounds, first + leftCount, count - leftCount });
 
-	// Used for working out ray origins and directions
-	float mXViewMultiplier;
-	float mYViewMultiplier;
-	float mXViewOffset;
-	float mYViewOffset;
+		// Turns this node into an interior node
+		nodes[nodeIndex].mLeftFirst = leftIndex;
+		nodes[nodeIndex].mCount = 0;
 
-public:
-	Camera(glm::ivec2 windowSize, glm::ivec2 viewingSize)
+		return true;
+	};
+	// Splits a node in two using the surface area heuristic, then does the same to its children
+	void Subdivide(std::vector<BVHNode>& nodes, int nodeIndex, int depth)
 	{
-		// Getting window size, centre and viewing size
-		mWindowSize = windowSize;
-		mWindowCentre = windowSize / 2;
-		mViewingSize = viewingSize;
+		int first = nodes[nodeIndex].mLeftFirst;
+		int count = nodes[nodeIndex].mCount;
 
-		// Getting variables for calculating ray data
-		mXViewMultiplier = (float)mViewingSize.x / (float)mWindowSize.x;
-		mYViewMultiplier = (float)mViewingSize.y / (float)mWindowSize.y;
-		mXViewOffset = (float)(mViewingSize.x - mWindowSize.x) / 2;
-		mYViewOffset = (float)(mViewingSize.y - mWindowSize.y) / 2;
-	};
-	~Camera() {};
+		AABB centreBounds = GetRangeCentreBounds(first, count);
+		AABB binBounds[3 * kBinCount];
+		int binCounts[3 * kBinCount];
+		FillBins(first, count, centreBounds, binBounds, binCounts);
 
-	Ray GetRay(glm::ivec2 pixelPosition)
+		if (SplitBinned(nodes, nodeIndex, depth, centreBounds, binBounds, binCounts))
+		{
+			int leftIndex = nodes[nodeIndex].mLeftFirst;
+			Subdivide(nodes, leftIndex, depth + 1);
+			Subdivide(nodes, leftIndex + 1, depth + 1);
+		};
+	};
+	// Splits the nodes near the root like Subdivide, a level at a time with the binning spread across threads over every node in the level
+	// Stops at nodes of kSubtreeSize primitives or fewer, which are added to subtreeRoots (along with their depth) to be built whole afterwards
+	void SubdivideTop(std::vector<glm::ivec2>& subtreeRoots)
 	{
-		// Getting start and end points for reference when creating the ray
-		glm::vec3 source;
-		glm::vec3 lead;
-
-		// Getting coordinates for the ray's origin
-		source.x = (float)pixelPosition.x;
-		source.y = (float)pixelPosition.y;
-		source.z = -1.f;
+		std::vector<glm::ivec2> level(1, glm::ivec2(0, 0));
+		while (!level.empty())
+		{
+			std::vector<glm::ivec2> splitNodes;
+			for (glm::ivec2 node : level)
+			{
+				(mNodes[node.x].mCount <= kSubtreeSize ? subtreeRoots : splitNodes).push_back(node);
+			};
 
-		// Getting coordinates for the ray's path
-		lead.x = (float)(pixelPosition.x) * mXViewMultiplier - mXViewOffset;
-		lead.y = (float)(pixelPosition.y) * mYViewMultiplier - mYViewOffset;
-		lead.z = 20.f;
+			// Cuts every node being split into chunks (node, first, count), each chunk gathers its own centre bounds and then its own buckets
+			std::vector<glm::ivec3> chunks;
+			for (int node = 0; node < (int)splitNodes.size(); node++)
+			{
+				int first = mNodes[splitNodes[node].x].mLeftFirst;
+				int count = mNodes[splitNodes[node].x].mCount;
+				for (int chunkFirst = first; chunkFirst < first + count; chunkFirst += kBuildChunkSize)
+				{
+					chunks.push_back(glm::ivec3(node, chunkFirst, std::min(kBuildChunkSize, first + count - chunkFirst)));
+				};
+			};
 
-		// Creating ray
-		Ray ray(source, glm::normalize(lead - source));
+			// Bounds unions are exact, so combining the chunks gives the same result as Subdivide binning each node in one go
+			std::vector<AABB> chunkCentreBounds(chunks.size());
+			run_in_parallel((int)chunks.size(), [&](int chunk)
+			{
+				chunkCentreBounds[chunk] = GetRangeCentreBounds(chunks[chunk].y, chunks[chunk].z);
+			});
 
-		return ray;
-	};
-};
+			std::vector<AABB> centreBounds(splitNodes.size(), get_empty_aabb());
+			for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+			{
+				centreBounds[chunks[chunk].x] = get_aabb_union(centreBounds[chunks[chunk].x], chunkCentreBounds[chunk]);
+			};
 
+			std::vector<AABB> chunkBinBounds(chunks.size() * 3 * kBinCount);
+			std::vector<int> chunkBinCounts(chunks.size() * 3 * kBinCount);
+			run_in_parallel((int)chunks.size(), [&](int chunk)
+			{
+				FillBins(chunks[chunk].y, chunks[chunk].z, centreBounds[chunks[chunk].x], &chunkBinBounds[chunk * 3 * kBinCount], &chunkBinCounts[chunk * 3 * kBinCount]);
+			});
 
-// Outputs a vec3 to console (used for debugging)
-void display_vec3(glm::vec3 vec)
+			std::vector<AABB> binBounds(splitNodes.size() * 3 * kBinCount, get_empty_aabb());
+			std::vector<int> binCounts(splitNodes.size() * 3 * kBinCount, 0);
+			for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+			{
+				for (int bin = 0; bin < 3 * kBinCount; bin++)
+				{
+					int nodeBin = chunks[chunk].x * 3 * kBinCount + bin;
+					binBounds[nodeBin] = get_aabb_union(binBounds[nodeBin], chunkBinBounds[chunk * 3 * kBinCount + bin]);
+					binCounts[nodeBin] += chunkBinCounts[chunk * 3 * kBinCount + bin];
+				};
+			};
+
+			// Splits each node on its own thread into a tree of its own, then moves the children into this one
+			std::vector<std::vector<BVHNode>> splits(splitNodes.size());
+			run_in_parallel((int)splitNodes.size(), [&](int node)
+			{
+				splits[node].push_back(mNodes[splitNodes[node].x]);
+				SplitBinned(splits[node], 0, splitNodes[node].y, centreBounds[node], &binBounds[node * 3 * kBinCount], &binCounts[node * 3 * kBinCount]);
+			});
+			AddSubtrees(splitNodes, splits);
+
+			// Moves on to the children of the nodes that were split
+			level.clear();
+			for (glm::ivec2 node : splitNodes)
+			{
+				if (mNodes[node.x].mCount == 0)
+				{
+					level.push_back(glm::ivec2(mNodes[node.x].mLeftFirst, node.y + 1));
+					level.push_back(glm::ivec2(mNodes[node.x].mLeftFirst + 1, node.y + 1));
+				};
+			};
+		};
+	};
+
+	// Sorts mPrimIndices and mMortonCodes by code, eight bits at a time with each pass spread across threads by chunks of primitives
+	void SortByMortonCode()
+	{
+		int primCount = (int)mPrimIndices.size();
+		int chunkCount = (primCount + kBuildChunkSize - 1) / kBuildChunkSize;
+
+		std::vector<uint32_t> sortedCodes(primCount);
+		std::vector<int> sortedIndices(primCount);
+		std::vector<int> chunkOffsets(chunkCount * 256);
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			// Counts each chunk's digits
+			run_in_parallel(chunkCount, [&](int chunk)
+			{
+				int* counts = &chunkOffsets[chunk * 256];
+				std::fill(counts, counts + 256, 0);
+				for (int i = chunk * kBuildChunkSize; i < std::min((chunk + 1) * kBuildChunkSize, primCount); i++)
+				{
+					counts[(mMortonCodes[i] >> shift) & 255]++;
+				};
+			});
+
+			// Turns the counts into where each chunk's first primitive with each digit goes, chunks in order within each digit so the sort stays stable
+			int offset = 0;
+			for (int digit = 0; digit < 256; digit++)
+			{
+				for (int chunk = 0; chunk < chunkCount; chunk++)
+				{
+					int count = chunkOffsets[chunk * 256 + digit];
+					chunkOffsets[chunk * 256 + digit] = offset;
+					offset += count;
+				};
+			};
+
+			run_in_parallel(chunkCount, [&](int chunk)
+			{
+				int* offsets = &chunkOffsets[chunk * 256];
+				for (int i = chunk * kBuildChunkSize; i < std::min((chunk + 1) * kBuildChunkSize, primCount); i++)
+				{
+					int destination = offsets[(mMortonCodes[i] >> shift) & 255]++;
+					sortedCodes[destination] = mMortonCodes[i];
+					sortedIndices[destination] = mPrimIndices[i];
+				};
+			});
+
+			mMortonCodes.swap(sortedCodes);
+			mPrimIndices.swap(sortedIndices);
+		};
+	};
+	// Splits a node of primitives sorted by Morton code where their codes first differ, or in half if they all share one, adding the children to nodes
+	// Returns false if the node stays a leaf, the children's bounds are left for the caller to fill in
+	bool SplitMorton(std::vector<BVHNode>& nodes, int nodeIndex, int depth)
+	{
+		int first = nodes[nodeIndex].mLeftFirst;
+		int count = nodes[nodeIndex].mCount;
+
+		if (count <= kMaxLeafSize || depth >= kMaxDepth)
+		{
+			return false;
+		};
+
+		// Codes in the range only differ below the highest bit the first and last differ at, so the ones without that bit come first
+		int split = first + count / 2;
+		uint32_t differentBits = mMortonCodes[first] ^ mMortonCodes[first + count - 1];
+		if (differentBits != 0)
+		{
+			uint32_t splitBit = 1u << 31;
+			while ((differentBits & splitBit) == 0)
+			{
+				splitBit >>= 1;
+			};
+
+			const uint32_t* codes = mMortonCodes.data();
+			split = (int)(std::partition_point(codes + first, codes + first + count, [&](uint32_t code)
+			{
+				return (code & splitBit) == 0;
+			}) - codes);
+		};
+
+		int leftIndex = (int)nodes.size();
+		nodes.push_back(BVHNode{ get_empty_aabb(), first, split - first });
+		nodes.push_back(BVHNode{ get_empty_aabb(), split, first + count - split });
+
+		nodes[nodeIndex].mLeftFirst = leftIndex;
+		nodes[nodeIndex].mCount = 0;
+
+		return true;
+	};
+	// Splits a node by Morton code down to small leaves, then fills in the bounds on the way back up
+	void SubdivideMorton(std::vector<BVHNode>& nodes, int nodeIndex, int depth)
+	{
+		if (SplitMorton(nodes, nodeIndex, depth))
+		{
+			int leftIndex = nodes[nodeIndex].mLeftFirst;
+			SubdivideMorton(nodes, leftIndex, depth + 1);
+			SubdivideMorton(nodes, leftIndex + 1, depth + 1);
+			nodes[nodeIndex].mBounds = get_aabb_union(nodes[leftIndex].mBounds, nodes[leftIndex + 1].mBounds);
+		}
+		else
+		{
+			nodes[nodeIndex].mBounds = GetRangeBounds(nodes[nodeIndex].mLeftFirst, nodes[nodeIndex].mCount);
+		};
+	};
+	// Splits a node like SubdivideMorton down to nodes of kSubtreeSize primitives or fewer, which are added to subtreeRoots (along with their depth) to be built whole afterwards
+	// Interior nodes made here are added to topNodes, parents before children, so their bounds can be filled in once the subtrees are built
+	void SubdivideMortonTop(int nodeIndex, int depth, std::vector<glm::ivec2>& subtreeRoots, std::vector<int>& topNodes)
+	{
+		if (mNodes[nodeIndex].mCount <= kSubtreeSize || !SplitMorton(mNodes, nodeIndex, depth))
+		{
+			subtreeRoots.push_back(glm::ivec2(nodeIndex, depth));
+			return;
+		};
+
+		topNodes.push_back(nodeIndex);
+		int leftIndex = mNodes[nodeIndex].mLeftFirst;
+		SubdivideMortonTop(leftIndex, depth + 1, subtreeRoots, topNodes);
+		SubdivideMortonTop(leftIndex + 1, depth + 1, subtreeRoots, topNodes);
+	};
+
+	// Builds the subtree under each of the given nodes with subdivide(nodes, 0, depth), one thread per subtree at a time, then moves them into the tree
+	// Subtrees cover separate ranges of mPrimIndices so they can be split at the same time
+	void BuildSubtrees(const std::vector<glm::ivec2>& subtreeRoots, void (BVH::*subdivide)(std::vector<BVHNode>&, int, int))
+	{
+		std::vector<std::vector<BVHNode>> subtrees(subtreeRoots.size());
+		run_in_parallel((int)subtreeRoots.size(), [&](int subtree)
+		{
+			subtrees[subtree].push_back(mNodes[subtreeRoots[subtree].x]);
+			(this->*subdivide)(subtrees[subtree], 0, subtreeRoots[subtree].y);
+		});
+		AddSubtrees(subtreeRoots, subtrees);
+	};
+	// Moves trees built on their own into this one, each tree's root replacing the node it was built from
+	// The rest of their nodes are appended, with their child indices moved to match
+	void AddSubtrees(const std::vector<glm::ivec2>& subtreeRoots, std::vector<std::vector<BVHNode>>& subtrees)
+	{
+		for (size_t subtree = 0; subtree < subtrees.size(); subtree++)
+		{
+			std::vector<BVHNode>& nodes = subtrees[subtree];
+			int offset = (int)mNodes.size() - 1;
+			for (BVHNode& node : nodes)
+			{
+				if (node.mCount == 0)
+				{
+					node.mLeftFirst += offset;
+				};
+			};
+
+			mNodes[subtreeRoots[subtree].x] = nodes[0];
+			mNodes.insert(mNodes.end(), nodes.begin() + 1, nodes.end());
+		};
+	};
+
+public:
+	BVH() : mExternalNodes(nullptr), mExternalNodeCount(0), mExternalPrimIndices(nullptr), mExternalPrimCount(0) {};
+	~BVH() {};
+
+	// Builds the tree over the given primitive bounds, primitives are referred to by their index in the list
+	// The bounds are taken by value so callers that are done with them can move them in rather than have them copied
+	// BVHBuilder::SAH gives the faster tree to trace, BVHBuilder::Morton the faster build (see BVHBuilder)
+	void Build(std::vector<AABB> primBounds, BVHBuilder builder = BVHBuilder::SAH)
+	{
+		mNodes.clear();
+		mPrimIndices.clear();
+		mExternalNodes = nullptr;
+		mExternalPrimIndices = nullptr;
+
+		if (primBounds.empty())
+		{
+			return;
+		};
+
+		// Gets the centre of each primitive and starts with every primitive in order
+		int primCount = (int)primBounds.size();
+		int chunkCount = (primCount + kBuildChunkSize - 1) / kBuildChunkSize;
+		mPrimBounds = std::move(primBounds);
+		mPrimCentres.resize(primCount);
+		mPrimIndices.resize(primCount);
+		std::vector<AABB> chunkBounds(chunkCount);
+		run_in_parallel(chunkCount, [&](int chunk)
+		{
+			for (int i = chunk * kBuildChunkSize; i < std::min((chunk + 1) * kBuildChunkSize, primCount); i++)
+			{
+				mPrimCentres[i] = get_aabb_centre(mPrimBounds[i]);
+				mPrimIndices[i] = i;
+			};
+			chunkBounds[chunk] = GetRangeBounds(chunk * kBuildChunkSize, std::min(kBuildChunkSize, primCount - chunk * kBuildChunkSize));
+		});
+
+		// Creates the root containing everything
+		AABB rootBounds = get_empty_aabb();
+		for (AABB bounds : chunkBounds)
+		{
+			rootBounds = get_aabb_union(rootBounds, bounds);
+		};
+		mNodes.reserve(primCount * 2);
+		mNodes.push_back(BVHNode{ rootBounds, 0, primCount });
+
+		// Splits the big nodes near the root with the work within each level spread across threads, then builds the subtrees below them in parallel
+		std::vector<glm::ivec2> subtreeRoots;
+		if (builder == BVHBuilder::SAH)
+		{
+			SubdivideTop(subtreeRoots);
+			BuildSubtrees(subtreeRoots, &BVH::Subdivide);
+		}
+		else
+		{
+			// Codes each primitive by where its centre sits in the box around all of them, then sorts them along the curve the codes trace
+			AABB centreBounds = get_empty_aabb();
+			for (const glm::vec3& centre : mPrimCentres)
+			{
+				centreBounds = get_aabb_union(centreBounds, get_aabb_from_points(centre, centre));
+			};
+			glm::vec3 centreExtent = centreBounds.mMax - centreBounds.mMin;
+			glm::vec3 centreScale = glm::vec3(centreExtent.x > 0 ? 1 / centreExtent.x : 0, centreExtent.y > 0 ? 1 / centreExtent.y : 0, centreExtent.z > 0 ? 1 / centreExtent.z : 0);
+
+			mMortonCodes.resize(primCount);
+			run_in_parallel(chunkCount, [&](int chunk)
+			{
+				for (int i = chunk * kBuildChunkSize; i < std::min((chunk + 1) * kBuildChunkSize, primCount); i++)
+				{
+					mMortonCodes[i] = get_morton_code((mPrimCentres[i] - centreBounds.mMin) * centreScale);
+				};
+			});
+			SortByMortonCode();
+
+			std::vector<int> topNodes;
+			SubdivideMortonTop(0, 0, subtreeRoots, topNodes);
+			BuildSubtrees(subtreeRoots, &BVH::SubdivideMorton);
+
+			// Fills in the bounds of the nodes above the subtrees, children first
+			for (auto node = topNodes.rbegin(); node != topNodes.rend(); node++)
+			{
+				int leftIndex = mNodes[*node].mLeftFirst;
+				mNodes[*node].mBounds = get_aabb_union(mNodes[leftIndex].mBounds, mNodes[leftIndex + 1].mBounds);
+			};
+
+			std::vector<uint32_t>().swap(mMortonCodes);
+		};
+
+		// Build data is no longer needed
+		std::vector<AABB>().swap(mPrimBounds);
+		std::vector<glm::vec3>().swap(mPrimCentres);
+	};
+
+	// Fits the tree's boxes to primitives that have moved, keeping which leaf each primitive is in rather than building the tree again
+	// The bounds are indexed like those given to Build and have to be for the same primitives, the further they've moved the slower the tree gets to trace (see GetCost)
+	void Refit(const std::vector<AABB>& primBounds)
+	{
+		// A tree used in place can't be changed, so it is copied first
+		if (mExternalNodes)
+		{
+			mNodes.assign(mExternalNodes, mExternalNodes + mExternalNodeCount);
+			mPrimIndices.assign(mExternalPrimIndices, mExternalPrimIndices + mExternalPrimCount);
+			mExternalNodes = nullptr;
+			mExternalPrimIndices = nullptr;
+		};
+
+		// Fits the leaves to their primitives across threads
+		int nodeCount = (int)mNodes.size();
+		run_in_parallel((nodeCount + kBuildChunkSize - 1) / kBuildChunkSize, [&](int chunk)
+		{
+			for (int node = chunk * kBuildChunkSize; node < std::min((chunk + 1) * kBuildChunkSize, nodeCount); node++)
+			{
+				if (mNodes[node].mCount == 0)
+				{
+					continue;
+				};
+
+				AABB bounds = get_empty_aabb();
+				for (int i = mNodes[node].mLeftFirst; i < mNodes[node].mLeftFirst + mNodes[node].mCount; i++)
+				{
+					bounds = get_aabb_union(bounds, primBounds[mPrimIndices[i]]);
+				};
+				mNodes[node].mBounds = bounds;
+			};
+		});
+
+		// Then the interior nodes to their children, which are always after them in the tree so walking it backwards fits children first
+		for (int node = nodeCount - 1; node >= 0; node--)
+		{
+			if (mNodes[node].mCount == 0)
+			{
+				int leftIndex = mNodes[node].mLeftFirst;
+				mNodes[node].mBounds = get_aabb_union(mNodes[leftIndex].mBounds, mNodes[leftIndex + 1].mBounds);
+			};
+		};
+	};
+
+	// Uses a tree built earlier (by Build, then saved) in place, without copying it
+	// The arrays must stay alive and unchanged for as long as this BVH uses them
+	void Adopt(const BVHNode* nodes, int nodeCount, const int* primIndices, int primCount)
+	{
+		mNodes.clear();
+		mPrimIndices.clear();
+		mExternalNodes = nodes;
+		mExternalNodeCount = nodeCount;
+		mExternalPrimIndices = primIndices;
+		mExternalPrimCount = primCount;
+	};
+
+	// Visits the leaves the ray passes through, nearest first, skipping any that start beyond closestDistance
+	// The intersect function is called as intersect(primIndex, closestDistance) and should lower closestDistance and return true when it finds a closer hit
+	template <typename IntersectFunc>
+	bool Traverse(Ray ray, float& closestDistance, IntersectFunc intersect) const
+	{
+		return TraverseNodes(GetNodes(), GetNodeCount(), GetPrimIndices(), ray, closestDistance, intersect);
+	};
+	// Same as Traverse, over a tree held in arrays kept somewhere else (such as a mesh's pooled BVH) so no BVH object is needed
+	template <typename IntersectFunc>
+	static bool TraverseNodes(const BVHNode* nodes, int nodeCount, const int* primIndices, Ray ray, float& closestDistance, IntersectFunc intersect)
+	{
+		if (nodeCount == 0)
+		{
+			return false;
+		};
+
+		// Gets ray values
+		glm::vec3 origin = ray.GetOrigin();
+		glm::vec3 direction = ray.GetDirection();
+		glm::vec3 inverseDirection = get_safe_inverse_direction(direction);
+
+		// Box tests measure in multiples of the direction, this converts them to lengths comparable with hit distances
+		float directionLength = glm::length(direction);
+
+		// Nodes waiting to be visited, along with the distance the ray enters them at
+		struct StackEntry
+		{
+			int mNode;
+			float mEntry;
+		};
+		StackEntry stack[kMaxDepth + 16];
+		int stackSize = 0;
+
+		float entry;
+		if (!get_ray_aabb_entry(origin, inverseDirection, nodes[0].mBounds, closestDistance / directionLength, entry))
+		{
+			return false;
+		};
+		stack[stackSize++] = StackEntry{ 0, entry };
+
+		bool hit = false;
+		while (stackSize > 0)
+		{
+			StackEntry current = stack[--stackSize];
+
+			// A closer hit may have been found since this node was queued
+			if (current.mEntry * directionLength > closestDistance)
+			{
+				continue;
+			};
+
+			COUNT_TRAVERSAL_STEP();
+			const BVHNode& node = nodes[current.mNode];
+
+			// Tests every primitive in a leaf
+			if (node.mCount > 0)
+			{
+				for (int i = node.mLeftFirst; i < node.mLeftFirst + node.mCount; i++)
+				{
+					if (intersect(primIndices[i], closestDistance))
+					{
+						hit = true;
+					};
+				};
+
+				continue;
+			};
+
+			// Tests both children
+			float maxDistance = closestDistance / directionLength;
+			float leftEntry, rightEntry;
+			bool leftHit = get_ray_aabb_entry(origin, inverseDirection, nodes[node.mLeftFirst].mBounds, maxDistance, leftEntry);
+			bool rightHit = get_ray_aabb_entry(origin, inverseDirection, nodes[node.mLeftFirst + 1].mBounds, maxDistance, rightEntry);
+
+			// Pushes the further child first so the nearer one is visited next
+			if (leftHit && rightHit)
+			{
+				if (leftEntry <= rightEntry)
+				{
+					stack[stackSize++] = StackEntry{ node.mLeftFirst + 1, rightEntry };
+					stack[stackSize++] = StackEntry{ node.mLeftFirst, leftEntry };
+				}
+				else
+				{
+					stack[stackSize++] = StackEntry{ node.mLeftFirst, leftEntry };
+					stack[stackSize++] = StackEntry{ node.mLeftFirst + 1, rightEntry };
+				};
+			}
+			else if (leftHit)
+			{
+				stack[stackSize++] = StackEntry{ node.mLeftFirst, leftEntry };
+			}
+			else if (rightHit)
+			{
+				stack[stackSize++] = StackEntry{ node.mLeftFirst + 1, rightEntry };
+			};
+		};
+
+		return hit;
+	};
+	// Visits the leaves the ray passes through in no particular order until occludes(primIndex) returns true
+	// For shadow rays, which only need to know if anything is in the way, so there's no closest hit to keep track of
+	template <typename OccludeFunc>
+	bool TraverseAny(Ray ray, OccludeFunc occludes) const
+	{
+		return TraverseAnyNodes(GetNodes(), GetNodeCount(), GetPrimIndices(), ray, occludes);
+	};
+	// Same as TraverseAny, over a tree held in arrays kept somewhere else (such as a mesh's pooled BVH)
+	template <typename OccludeFunc>
+	static bool TraverseAnyNodes(const BVHNode* nodes, int nodeCount, const int* primIndices, Ray ray, OccludeFunc occludes)
+	{
+		if (nodeCount == 0)
+		{
+			return false;
+		};
+
+		glm::vec3 origin = ray.GetOrigin();
+		glm::vec3 inverseDirection = get_safe_inverse_direction(ray.GetDirection());
+		float maxDistance = std::numeric_limits<float>::max();
+
+		int stack[kMaxDepth + 16];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			COUNT_TRAVERSAL_STEP();
+			const BVHNode& node = nodes[stack[--stackSize]];
+
+			float entry;
+			if (!get_ray_aabb_entry(origin, inverseDirection, node.mBounds, maxDistance, entry))
+			{
+				continue;
+			};
+
+			// Stops at the first primitive in the way
+			if (node.mCount > 0)
+			{
+				for (int i = node.mLeftFirst; i < node.mLeftFirst + node.mCount; i++)
+				{
+					if (occludes(primIndices[i]))
+					{
+						return true;
+					};
+				};
+
+				continue;
+			};
+
+			stack[stackSize++] = node.mLeftFirst + 1;
+			stack[stackSize++] = node.mLeftFirst;
+		};
+
+		return false;
+	};
+	// Walks the tree with every ray in a packet at once, testing each box against the whole packet
+	// A node is only visited by the lanes that enter it before their own closest distance, and skipped when none do
+	// The intersect function is called as intersect(primIndex, laneMask, closestDistances) and should lower the closest distances of the lanes in the mask that find a closer hit, returning true if any did
+	template <typename IntersectFunc>
+	void TraversePacket(const RayPacket& packet, float* closestDistances, IntersectFunc intersect) const
+	{
+		const BVHNode* nodes = GetNodes();
+		const int* primIndices = GetPrimIndices();
+		if (GetNodeCount() == 0 || packet.mActiveMask == 0)
+		{
+			return;
+		};
+
+		// Box tests measure in multiples of each ray's direction
+		alignas(32) float maxDistances[kPacketWidth];
+		for (int lane = 0; lane < kPacketWidth; lane++)
+		{
+			maxDistances[lane] = closestDistances[lane] / packet.mDirectionLength[lane];
+		};
+
+		// Nodes waiting to be visited, along with the lanes that reached them
+		struct StackEntry
+		{
+			int mNode;
+			int mLaneMask;
+		};
+		StackEntry stack[kMaxDepth + 16];
+		int stackSize = 0;
+
+		alignas(32) float leftEntries[kPacketWidth];
+		alignas(32) float rightEntries[kPacketWidth];
+		int rootMask = get_packet_aabb_mask(packet, nodes[0].mBounds, packet.mActiveMask, maxDistances, leftEntries);
+		if (rootMask == 0)
+		{
+			return;
+		};
+		stack[stackSize++] = StackEntry{ 0, rootMask };
+
+		while (stackSize > 0)
+		{
+			StackEntry current = stack[--stackSize];
+			COUNT_TRAVERSAL_STEP();
+			const BVHNode& node = nodes[current.mNode];
+
+			// Retests a leaf's box, dropping the lanes that have found something closer since it was queued
+			if (node.mCount > 0)
+			{
+				int laneMask = get_packet_aabb_mask(packet, node.mBounds, current.mLaneMask, maxDistances, leftEntries);
+
+				for (int i = node.mLeftFirst; i < node.mLeftFirst + node.mCount && laneMask != 0; i++)
+				{
+					if (intersect(primIndices[i], laneMask, closestDistances))
+					{
+						for (int lane = 0; lane < kPacketWidth; lane++)
+						{
+							maxDistances[lane] = closestDistances[lane] / packet.mDirectionLength[lane];
+						};
+					};
+				};
+
+				continue;
+			};
+
+			// Tests both children against every lane that got here
+			int leftMask = get_packet_aabb_mask(packet, nodes[node.mLeftFirst].mBounds, current.mLaneMask, maxDistances, leftEntries);
+			int rightMask = get_packet_aabb_mask(packet, nodes[node.mLeftFirst + 1].mBounds, current.mLaneMask, maxDistances, rightEntries);
+
+			// Pushes the child the packet enters later first, going by the earliest entry of any lane
+			if (leftMask != 0 && rightMask != 0)
+			{
+				float leftEntry = std::numeric_limits<float>::max();
+				float rightEntry = std::numeric_limits<float>::max();
+				for (int lane = 0; lane < kPacketWidth; lane++)
+				{
+					if (leftMask & (1 << lane))
+					{
+						leftEntry = std::min(leftEntry, leftEntries[lane]);
+					};
+					if (rightMask & (1 << lane))
+					{
+						rightEntry = std::min(rightEntry, rightEntries[lane]);
+					};
+				};
+
+				if (leftEntry <= rightEntry)
+				{
+					stack[stackSize++] = StackEntry{ node.mLeftFirst + 1, rightMask };
+					stack[stackSize++] = StackEntry{ node.mLeftFirst, leftMask };
+				}
+				else
+				{
+					stack[stackSize++] = StackEntry{ node.mLeftFirst, leftMask };
+					stack[stackSize++] = StackEntry{ node.mLeftFirst + 1, rightMask };
+				};
+			}
+			else if (leftMask != 0)
+			{
+				stack[stackSize++] = StackEntry{ node.mLeftFirst, leftMask };
+			}
+			else if (rightMask != 0)
+			{
+				stack[stackSize++] = StackEntry{ node.mLeftFirst + 1, rightMask };
+			};
+		};
+	};
+
+	const BVHNode* GetNodes() const
+	{
+		return mExternalNodes ? mExternalNodes : mNodes.data();
+	};
+	int GetNodeCount() const
+	{
+		return mExternalNodes ? mExternalNodeCount : (int)mNodes.size();
+	};
+	const int* GetPrimIndices() const
+	{
+		return mExternalNodes ? mExternalPrimIndices : mPrimIndices.data();
+	};
+	int GetPrimCount() const
+	{
+		return mExternalNodes ? mExternalPrimCount : (int)mPrimIndices.size();
+	};
+	// Gets the tree's surface area heuristic cost relative to its root, the number of nodes plus primitives a random ray hitting the root is expected to test
+	// Lower is faster to trace, for comparing trees built different ways over the same primitives
+	float GetCost() const
+	{
+		const BVHNode* nodes = GetNodes();
+		int nodeCount = GetNodeCount();
+		if (nodeCount == 0)
+		{
+			return 0;
+		};
+
+		float cost = 0;
+		for (int i = 0; i < nodeCount; i++)
+		{
+			cost += get_aabb_surface_area(nodes[i].mBounds) * (nodes[i].mCount > 0 ? nodes[i].mCount : 1);
+		};
+
+		return cost / get_aabb_surface_area(nodes[0].mBounds);
+	};
+};
+
+
+// One block of memory handed out front to back and freed all at once when the arena is destroyed
+// Nothing in it is destructed, so it can only hold types that don't need to be (such as shape properties)
+class Arena
+{
+private:
+	// Stores the block, with room to align its start
+	std::unique_ptr<uint8_t[]> mBlock;
+	size_t mSize;
+	// Stores how many bytes from the block's start have been handed out
+	size_t mUsed;
+
+public:
+	// Alignment of everything handed out, a cache line so no two arrays share one
+	static const size_t kAlignment = 64;
+
+	Arena(size_t size) : mBlock(new uint8_t[size + kAlignment]), mSize(size + kAlignment), mUsed(0) {};
+	~Arena() {};
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	// Gets room for size bytes, or null if the block is full
+	void* Allocate(size_t size)
+	{
+		uintptr_t start = ((uintptr_t)mBlock.get() + mUsed + kAlignment - 1) & ~(uintptr_t)(kAlignment - 1);
+		size_t end = (size_t)(start - (uintptr_t)mBlock.get()) + size;
+		if (end > mSize)
+		{
+			return nullptr;
+		};
+
+		mUsed = end;
+		return (void*)start;
+	};
+	// Gets how many bytes an arena needs to hand out runs of these sizes
+	static size_t GetSizeFor(const std::vector<size_t>& sizes)
+	{
+		size_t total = 0;
+		for (size_t size : sizes)
+		{
+			total += (size + kAlignment - 1) & ~(kAlignment - 1);
+		};
+
+		return total;
+	};
+};
+
+
+// Raw access to any PrimitiveArray, so a scene cache can write and map every array the same way
+class PrimitiveArrayBase
+{
+public:
+	virtual ~PrimitiveArrayBase() {};
+
+	virtual const void* GetRawData() const = 0;
+	virtual size_t GetCount() const = 0;
+	virtual size_t GetElementSize() const = 0;
+	// Makes the array view elements owned by something else, which has to outlive it
+	virtual void ViewRaw(const void* elements, size_t count) = 0;
+	// Moves the elements into room for capacity of them (at least as many as it has) owned by something else, such as a scene's arena, which has to outlive the array
+	virtual void PlaceRaw(void* elements, size_t capacity) = 0;
+	// Removes one element, moving the ones after it down
+	virtual void Erase(size_t index) = 0;
+};
+
+
+// Contiguous array holding one property of one shape type
+// It either owns its elements or views elements owned by something else (such as a mapped scene cache), copying them before the first change
+// Owned elements are kept on the heap, or in room placed in an arena so a whole scene can share one allocation
+template <typename T>
+class PrimitiveArray : public PrimitiveArrayBase
+{
+private:
+	// Stores the heap block owned elements are in, null if they've been placed somewhere else
+	std::unique_ptr<T[]> mHeap;
+	// Stores the elements, owned or viewed
+	T* mElements;
+	size_t mCount;
+	// Stores how many owned elements there's room for, always zero when viewing so any change copies them first
+	size_t mCapacity;
+	bool mViewing;
+
+	// Moves the owned elements to a bigger heap block
+	void Grow(size_t capacity)
+	{
+		std::unique_ptr<T[]> heap(new T[capacity]);
+		std::copy(mElements, mElements + mCount, heap.get());
+
+		mHeap = std::move(heap);
+		mElements = mHeap.get();
+		mCapacity = capacity;
+	};
+	void MakeOwned()
+	{
+		if (mViewing)
+		{
+			mViewing = false;
+			Grow(mCount);
+		};
+	};
+	// Makes room for count elements, at least doubling the capacity so adding one at a time stays cheap
+	void MakeRoom(size_t count)
+	{
+		MakeOwned();
+		if (count > mCapacity)
+		{
+			Grow(std::max(count, mCapacity * 2));
+		};
+	};
+
+public:
+	PrimitiveArray() : mElements(nullptr), mCount(0), mCapacity(0), mViewing(false) {};
+	~PrimitiveArray() {};
+
+	// Arrays can be moved along with their scene, but not copied
+	PrimitiveArray(const PrimitiveArray&) = delete;
+	PrimitiveArray& operator=(const PrimitiveArray&) = delete;
+	PrimitiveArray(PrimitiveArray&& other) : PrimitiveArray()
+	{
+		*this = std::move(other);
+	};
+	PrimitiveArray& operator=(PrimitiveArray&& other)
+	{
+		mHeap = std::move(other.mHeap);
+		mElements = other.mElements;
+		mCount = other.mCount;
+		mCapacity = other.mCapacity;
+		mViewing = other.mViewing;
+
+		other.mElements = nullptr;
+		other.mCount = 0;
+		other.mCapacity = 0;
+		other.mViewing = false;
+		return *this;
+	};
+
+	const T* data() const
+	{
+		return mElements;
+	};
+	size_t size() const
+	{
+		return mCount;
+	};
+	const T& operator[](size_t index) const
+	{
+		return mElements[index];
+	};
+	void push_back(const T& value)
+	{
+		// Viewing arrays have no room either, so this also catches the first change to one
+		if (mCount >= mCapacity)
+		{
+			MakeRoom(mCount + 1);
+		};
+		mElements[mCount++] = value;
+	};
+	// Adds a run of elements to the end
+	void append(const T* values, size_t count)
+	{
+		MakeRoom(mCount + count);
+		std::copy(values, values + count, mElements + mCount);
+		mCount += count;
+	};
+	// Drops elements from the end, or adds default ones
+	void resize(size_t count)
+	{
+		MakeRoom(count);
+		std::fill(mElements + std::min(mCount, count), mElements + count, T());
+		mCount = count;
+	};
+	// Makes room for the array to hold count elements without reallocating
+	void reserve(size_t count)
+	{
+		MakeOwned();
+		if (count > mCapacity)
+		{
+			Grow(count);
+		};
+	};
+	// Gets the elements for changing in place
+	T* GetMutableData()
+	{
+		MakeOwned();
+		return mElements;
+	};
+
+	const void* GetRawData() const
+	{
+		return data();
+	};
+	size_t GetCount() const
+	{
+		return size();
+	};
+	size_t GetElementSize() const
+	{
+		return sizeof(T);
+	};
+	void ViewRaw(const void* elements, size_t count)
+	{
+		// Never written through, MakeOwned copies the elements before any change
+		mHeap.reset();
+		mElements = (T*)elements;
+		mCount = count;
+		mCapacity = 0;
+		mViewing = true;
+	};
+	void PlaceRaw(void* elements, size_t capacity)
+	{
+		std::copy(mElements, mElements + mCount, (T*)elements);
+
+		mHeap.reset();
+		mElements = (T*)elements;
+		mCapacity = capacity;
+		mViewing = false;
+	};
+	void Erase(size_t index)
+	{
+		MakeOwned();
+		std::copy(mElements + index + 1, mElements + mCount, mElements + index);
+		mCount--;
+	};
+};
+
+
+// Every sphere in a scene, one array per property
+struct SphereBlock
+{
+	PrimitiveArray<float> mCentreX, mCentreY, mCentreZ;
+	PrimitiveArray<float> mRadius;
+	PrimitiveArray<glm::vec3> mColour;
+
+	size_t size() const
+	{
+		return mRadius.size();
+	};
+	glm::vec3 GetCentre(size_t index) const
+	{
+		return glm::vec3(mCentreX[index], mCentreY[index], mCentreZ[index]);
+	};
+	AABB GetBounds(size_t index) const
+	{
+		glm::vec3 halfSize(mRadius[index], mRadius[index], mRadius[index]);
+
+		return get_aabb_from_points(GetCentre(index) - halfSize, GetCentre(index) + halfSize);
+	};
+};
+
+
+// Every rectangle in a scene, one array per property
+struct RectangleBlock
+{
+	PrimitiveArray<float> mCentreX, mCentreY, mCentreZ;
+	PrimitiveArray<float> mWidth, mHeight;
+	PrimitiveArray<glm::vec3> mColour;
+
+	size_t size() const
+	{
+		return mWidth.size();
+	};
+	glm::vec3 GetCentre(size_t index) const
+	{
+		return glm::vec3(mCentreX[index], mCentreY[index], mCentreZ[index]);
+	};
+	AABB GetBounds(size_t index) const
+	{
+		glm::vec3 halfSize(mWidth[index] / 2, mHeight[index] / 2, 0);
+
+		return get_aabb_from_points(GetCentre(index) - halfSize, GetCentre(index) + halfSize);
+	};
+};
+
+
+// Every circle in a scene, one array per property
+struct CircleBlock
+{
+	PrimitiveArray<float> mCentreX, mCentreY, mCentreZ;
+	PrimitiveArray<float> mRadius;
+	PrimitiveArray<glm::vec3> mColour;
+
+	size_t size() const
+	{
+		return mRadius.size();
+	};
+	glm::vec3 GetCentre(size_t index) const
+	{
+		return glm::vec3(mCentreX[index], mCentreY[index], mCentreZ[index]);
+	};
+	AABB GetBounds(size_t index) const
+	{
+		glm::vec3 halfSize(mRadius[index], mRadius[index], 0);
+
+		return get_aabb_from_points(GetCentre(index) - halfSize, GetCentre(index) + halfSize);
+	};
+};
+
+
+// Every triangle in a scene, one array per property
+struct TriangleBlock
+{
+	PrimitiveArray<float> mAX, mAY, mAZ;
+	PrimitiveArray<float> mBX, mBY, mBZ;
+	PrimitiveArray<float> mCX, mCY, mCZ;
+	PrimitiveArray<glm::vec3> mColour;
+
+	size_t size() const
+	{
+		return mAX.size();
+	};
+	glm::vec3 GetPointA(size_t index) const
+	{
+		return glm::vec3(mAX[index], mAY[index], mAZ[index]);
+	};
+	glm::vec3 GetPointB(size_t index) const
+	{
+		return glm::vec3(mBX[index], mBY[index], mBZ[index]);
+	};
+	glm::vec3 GetPointC(size_t index) const
+	{
+		return glm::vec3(mCX[index], mCY[index], mCZ[index]);
+	};
+	AABB GetBounds(size_t index) const
+	{
+		AABB bounds = get_aabb_from_points(GetPointA(index), GetPointB(index));
+
+		return get_aabb_union(bounds, get_aabb_from_points(GetPointC(index), GetPointC(index)));
+	};
+};
+
+
+// Every triangle mesh in a scene
+// The per-mesh arrays hold one element per mesh, each naming the mesh's run of the pooled arrays below, which every mesh shares
+// Instances of a mesh (see Scene::AddMeshInstance) name the same runs under their own transform, so its triangles and BVH are stored once however many times it appears
+struct MeshBlock
+{
+	// Stores each mesh's runs of the pools
+	PrimitiveArray<uint32_t> mFirstVertex, mVertexCount;
+	PrimitiveArray<uint32_t> mFirstTriangle, mTriangleCount;
+	PrimitiveArray<uint32_t> mFirstNode, mNodeCount;
+	PrimitiveArray<glm::vec3> mColour;
+	// Stores the transform from each mesh's pooled vertices to where it is in the scene, and back again
+	PrimitiveArray<glm::mat4x3> mTransform, mInverseTransform;
+
+	// Stores the vertex positions the triangles share
+	PrimitiveArray<float> mVertexX, mVertexY, mVertexZ;
+	// Stores three vertex indices per triangle, counted from the mesh's first vertex
+	PrimitiveArray<uint32_t> mIndices;
+	// Stores each mesh's BVH over its own triangles, leaves refer to triangles counted from the mesh's first triangle
+	PrimitiveArray<BVHNode> mNodes;
+	// Stores each mesh's triangles in leaf order, one per triangle starting at the mesh's first triangle
+	PrimitiveArray<int> mPrimIndices;
+
+	size_t size() const
+	{
+		return mColour.size();
+	};
+	// Gets a vertex by its index in the vertex pool
+	glm::vec3 GetVertex(size_t vertex) const
+	{
+		return glm::vec3(mVertexX[vertex], mVertexY[vertex], mVertexZ[vertex]);
+	};
+	// Gets the corners of one of a mesh's triangles
+	void GetTriangle(size_t index, uint32_t triangle, glm::vec3& pointA, glm::vec3& pointB, glm::vec3& pointC) const
+	{
+		const uint32_t* corners = mIndices.data() + ((size_t)mFirstTriangle[index] + triangle) * 3;
+		size_t firstVertex = mFirstVertex[index];
+
+		pointA = GetVertex(firstVertex + corners[0]);
+		pointB = GetVertex(firstVertex + corners[1]);
+		pointC = GetVertex(firstVertex + corners[2]);
+	};
+	// The root of a mesh's BVH already bounds all of it, before it is transformed
+	AABB GetBounds(size_t index) const
+	{
+		return get_transformed_aabb(mNodes[mFirstNode[index]].mBounds, mTransform[index]);
+	};
+	// Gets if a mesh is where its pooled vertices are, so rays needn't be transformed to test it
+	bool IsUntransformed(size_t index) const
+	{
+		return mInverseTransform[index] == glm::mat4x3(1.0f);
+	};
+};
+
+
+// Read-only mapping of a whole file into memory, unmapped when destroyed
+class MappedFile
+{
+private:
+	// Stores the start of the mapped file and its size in bytes
+	const uint8_t* mData;
+	size_t mSize;
+
+#ifdef _WIN32
+	HANDLE mFile;
+	HANDLE mMapping;
+#endif
+
+	void Close()
+	{
+#ifdef _WIN32
+		if (mData)
+		{
+			UnmapViewOfFile(mData);
+		};
+		if (mMapping)
+		{
+			CloseHandle(mMapping);
+		};
+		if (mFile != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(mFile);
+		};
+		mFile = INVALID_HANDLE_VALUE;
+		mMapping = NULL;
+#else
+		if (mData)
+		{
+			munmap((void*)mData, mSize);
+		};
+#endif
+		mData = nullptr;
+		mSize = 0;
+	};
+
+public:
+	MappedFile() : mData(nullptr), mSize(0)
+	{
+#ifdef _WIN32
+		mFile = INVALID_HANDLE_VALUE;
+		mMapping = NULL;
+#endif
+	};
+	~MappedFile()
+	{
+		Close();
+	};
+
+	// Mappings can't be shared between copies
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Maps the file, returns false if it can't be opened or is empty
+	bool Open(std::string path)
+	{
+		Close();
+
+#ifdef _WIN32
+		mFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (mFile == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		};
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart == 0)
+		{
+			Close();
+			return false;
+		};
+
+		mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mMapping)
+		{
+			Close();
+			return false;
+		};
+
+		mData = (const uint8_t*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+		mSize = (size_t)fileSize.QuadPart;
+#else
+		int file = open(path.c_str(), O_RDONLY);
+		if (file < 0)
+		{
+			return false;
+		};
+
+		struct stat fileStatus;
+		if (fstat(file, &fileStatus) != 0 || fileStatus.st_size == 0)
+		{
+			close(file);
+			return false;
+		};
+
+		// The mapping stays valid after the file is closed
+		void* data = mmap(nullptr, (size_t)fileStatus.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		close(file);
+
+		mData = data == MAP_FAILED ? nullptr : (const uint8_t*)data;
+		mSize = (size_t)fileStatus.st_size;
+#endif
+
+		if (!mData)
+		{
+			Close();
+			return false;
+		};
+
+		return true;
+	};
+
+	const uint8_t* GetData() const
+	{
+		return mData;
+	};
+	size_t GetSize() const
+	{
+		return mSize;
+	};
+};
+
+
+class Scene
+{
+private:
+	// Stores the vector direction for lighting
+	glm::vec3 mLightDirection;
+	// Shapes to render, each type stored as its own block of arrays
+	SphereBlock mSpheres;
+	RectangleBlock mRectangles;
+	CircleBlock mCircles;
+	TriangleBlock mTriangles;
+	MeshBlock mMeshes;
+
+	// Stores a BVH built ahead of time over the shapes in their current order (from a scene cache), if there is one
+	const BVHNode* mPrebuiltNodes;
+	int mPrebuiltNodeCount;
+	const int* mPrebuiltPrimIndices;
+	// Keeps whatever the shape arrays or prebuilt BVH view alive for as long as this scene uses it
+	std::shared_ptr<const MappedFile> mBacking;
+	// Stores the shape arrays once room has been reserved for them, so a scene is one allocation and freeing it is one release
+	std::unique_ptr<Arena> mArena;
+	// Stores the keyframes of every animated shape, and each shape's track through them
+	std::vector<Keyframe> mKeyframes;
+	std::vector<AnimationTrack> mAnimationTracks;
+
+	// Gets where the mesh being added starts in the vertex and triangle pools, which is wherever the last finished mesh ended
+	// Finished meshes' triangles fill the pools up to the end of the leaf order pool, but instances mean the last mesh isn't always the one ending it
+	size_t GetOpenMeshFirstVertex() const
+	{
+		for (size_t i = mMeshes.size(); i-- > 0;)
+		{
+			if ((size_t)mMeshes.mFirstTriangle[i] + mMeshes.mTriangleCount[i] == mMeshes.mPrimIndices.size())
+			{
+				return (size_t)mMeshes.mFirstVertex[i] + mMeshes.mVertexCount[i];
+			};
+		};
+
+		return 0;
+	};
+	size_t GetOpenMeshFirstTriangle() const
+	{
+		return mMeshes.mPrimIndices.size();
+	};
+	// Moves a point stored across three arrays by offset
+	static void MovePoint(PrimitiveArray<float>& x, PrimitiveArray<float>& y, PrimitiveArray<float>& z, size_t index, glm::vec3 offset)
+	{
+		x.GetMutableData()[index] += offset.x;
+		y.GetMutableData()[index] += offset.y;
+		z.GetMutableData()[index] += offset.z;
+	};
+
+public:
+	Scene(glm::vec3 lightDirection) : mPrebuiltNodes(nullptr), mPrebuiltNodeCount(0), mPrebuiltPrimIndices(nullptr)
+	{
+		mLightDirection = lightDirection;
+	};
+	~Scene() {};
+
+	// Scenes own their shapes, so they can be handed over but not copied
+	Scene(const Scene&) = delete;
+	Scene& operator=(const Scene&) = delete;
+	Scene(Scene&&) = default;
+	Scene& operator=(Scene&&) = default;
+
+	// Makes room for this many more shapes of each type (indexed by ShapeType), moving every shape array into one new arena
+	// Meshes' vertices and triangles aren't included, ReserveMesh makes room for those
+	void ReserveShapes(const size_t counts[kShapeTypeCount])
+	{
+		// Gets the size of each array once it has room for the new shapes
+		std::vector<PrimitiveArrayBase*> arrays;
+		std::vector<size_t> capacities;
+		std::vector<size_t> sizes;
+		for (int type = 0; type < kShapeTypeCount; type++)
+		{
+			for (PrimitiveArrayBase* array : GetArrays((ShapeType)type))
+			{
+				arrays.push_back(array);
+				capacities.push_back(array->GetCount() + counts[type]);
+				sizes.push_back(capacities.back() * array->GetElementSize());
+			};
+		};
+
+		// Moves every array into the new arena before freeing any old one, which some of them may still be in
+		std::unique_ptr<Arena> arena(new Arena(Arena::GetSizeFor(sizes)));
+		for (size_t i = 0; i < arrays.size(); i++)
+		{
+			arrays[i]->PlaceRaw(arena->Allocate(sizes[i]), capacities[i]);
+		};
+		mArena = std::move(arena);
+	};
+
+	// Adds sphere to the sphere arrays
+	void AddSphere(glm::vec3 centre, float radius, glm::vec3 colour)
+	{
+		mSpheres.mCentreX.push_back(centre.x);
+		mSpheres.mCentreY.push_back(centre.y);
+		mSpheres.mCentreZ.push_back(centre.z);
+		mSpheres.mRadius.push_back(radius);
+		mSpheres.mColour.push_back(colour);
+		ClearPrebuiltBVH();
+	};
+	// Adds rectangle to the rectangle arrays
+	void AddRectangle(glm::vec3 centre, float width, float height, glm::vec3 colour)
+	{
+		mRectangles.mCentreX.push_back(centre.x);
+		mRectangles.mCentreY.push_back(centre.y);
+		mRectangles.mCentreZ.push_back(centre.z);
+		mRectangles.mWidth.push_back(width);
+		mRectangles.mHeight.push_back(height);
+		mRectangles.mColour.push_back(colour);
+		ClearPrebuiltBVH();
+	};
+	// Adds circle to the circle arrays
+	void AddCircle(glm::vec3 centre, float radius, glm::vec3 colour)
+	{
+		mCircles.mCentreX.push_back(centre.x);
+		mCircles.mCentreY.push_back(centre.y);
+		mCircles.mCentreZ.push_back(centre.z);
+		mCircles.mRadius.push_back(radius);
+		mCircles.mColour.push_back(colour);
+		ClearPrebuiltBVH();
+	};
+	// Adds triangle to the triangle arrays
+	void AddTriangle(glm::vec3 pointA, glm::vec3 pointB, glm::vec3 pointC, glm::vec3 colour)
+	{
+		mTriangles.mAX.push_back(pointA.x);
+		mTriangles.mAY.push_back(pointA.y);
+		mTriangles.mAZ.push_back(pointA.z);
+		mTriangles.mBX.push_back(pointB.x);
+		mTriangles.mBY.push_back(pointB.y);
+		mTriangles.mBZ.push_back(pointB.z);
+		mTriangles.mCX.push_back(pointC.x);
+		mTriangles.mCY.push_back(pointC.y);
+		mTriangles.mCZ.push_back(pointC.z);
+		mTriangles.mColour.push_back(colour);
+		ClearPrebuiltBVH();
+	};
+	// Adds triangle lying flat at the given z
+	void AddTriangle(float z, glm::vec2 pointA, glm::vec2 pointB, glm::vec2 pointC, glm::vec3 colour)
+	{
+		AddTriangle(glm::vec3(pointA, z), glm::vec3(pointB, z), glm::vec3(pointC, z), colour);
+	};
+
+	// Meshes are added a vertex and triangle at a time, then finished with EndMesh
+	// Adds a vertex to the mesh being added
+	void AddMeshVertex(glm::vec3 position)
+	{
+		mMeshes.mVertexX.push_back(position.x);
+		mMeshes.mVertexY.push_back(position.y);
+		mMeshes.mVertexZ.push_back(position.z);
+	};
+	// Adds a triangle to the mesh being added, from the indices of three of its vertices (the first vertex added being 0)
+	void AddMeshTriangle(uint32_t vertexA, uint32_t vertexB, uint32_t vertexC)
+	{
+		mMeshes.mIndices.push_back(vertexA);
+		mMeshes.mIndices.push_back(vertexB);
+		mMeshes.mIndices.push_back(vertexC);
+	};
+	// Makes room for the mesh being added to have this many vertices and triangles without the pools reallocating
+	void ReserveMesh(size_t vertexCount, size_t triangleCount)
+	{
+		size_t firstVertex = GetOpenMeshFirstVertex();
+		mMeshes.mVertexX.reserve(firstVertex + vertexCount);
+		mMeshes.mVertexY.reserve(firstVertex + vertexCount);
+		mMeshes.mVertexZ.reserve(firstVertex + vertexCount);
+		mMeshes.mIndices.reserve((GetOpenMeshFirstTriangle() + triangleCount) * 3);
+	};
+	size_t GetOpenMeshVertexCount() const
+	{
+		return mMeshes.mVertexX.size() - GetOpenMeshFirstVertex();
+	};
+	// Moves and scales the mesh being added so the centre of its bounds is at centre and their longest side is size long
+	void PlaceOpenMesh(glm::vec3 centre, float size)
+	{
+		size_t firstVertex = GetOpenMeshFirstVertex();
+		size_t vertexCount = GetOpenMeshVertexCount();
+		if (vertexCount == 0)
+		{
+			return;
+		};
+
+		AABB bounds = get_empty_aabb();
+		for (size_t i = firstVertex; i < firstVertex + vertexCount; i++)
+		{
+			bounds = get_aabb_union(bounds, get_aabb_from_points(mMeshes.GetVertex(i), mMeshes.GetVertex(i)));
+		};
+		glm::vec3 extent = bounds.mMax - bounds.mMin;
+		float longestSide = std::max(std::max(extent.x, extent.y), extent.z);
+		float scale = longestSide > 0 ? size / longestSide : 1.0f;
+		glm::vec3 boundsCentre = get_aabb_centre(bounds);
+
+		float* vertexX = mMeshes.mVertexX.GetMutableData();
+		float* vertexY = mMeshes.mVertexY.GetMutableData();
+		float* vertexZ = mMeshes.mVertexZ.GetMutableData();
+		for (size_t i = firstVertex; i < firstVertex + vertexCount; i++)
+		{
+			vertexX[i] = centre.x + (vertexX[i] - boundsCentre.x) * scale;
+			vertexY[i] = centre.y + (vertexY[i] - boundsCentre.y) * scale;
+			vertexZ[i] = centre.z + (vertexZ[i] - boundsCentre.z) * scale;
+		};
+	};
+	// Drops the vertices and triangles of the mesh being added
+	void DiscardOpenMesh()
+	{
+		mMeshes.mVertexX.resize(GetOpenMeshFirstVertex());
+		mMeshes.mVertexY.resize(GetOpenMeshFirstVertex());
+		mMeshes.mVertexZ.resize(GetOpenMeshFirstVertex());
+		mMeshes.mIndices.resize(GetOpenMeshFirstTriangle() * 3);
+	};
+	// Finishes the mesh being added and builds its BVH
+	// Returns false (dropping the mesh) if it has no triangles or a triangle uses a vertex it doesn't have
+	bool EndMesh(glm::vec3 colour)
+	{
+		size_t firstVertex = GetOpenMeshFirstVertex();
+		size_t firstTriangle = GetOpenMeshFirstTriangle();
+		size_t vertexCount = GetOpenMeshVertexCount();
+		size_t triangleCount = mMeshes.mIndices.size() / 3 - firstTriangle;
+		if (triangleCount == 0 || vertexCount > std::numeric_limits<uint32_t>::max() || triangleCount > (size_t)std::numeric_limits<int>::max())
+		{
+			DiscardOpenMesh();
+			return false;
+		};
+
+		// Gets the bounds of each triangle, checking its corners
+		std::vector<AABB> triangleBounds;
+		triangleBounds.reserve(triangleCount);
+		const uint32_t* corners = mMeshes.mIndices.data() + firstTriangle * 3;
+		for (size_t i = 0; i < triangleCount; i++, corners += 3)
+		{
+			if (corners[0] >= vertexCount || corners[1] >= vertexCount || corners[2] >= vertexCount)
+			{
+				DiscardOpenMesh();
+				return false;
+			};
+
+			glm::vec3 pointC = mMeshes.GetVertex(firstVertex + corners[2]);
+			AABB bounds = get_aabb_from_points(mMeshes.GetVertex(firstVertex + corners[0]), mMeshes.GetVertex(firstVertex + corners[1]));
+			triangleBounds.push_back(get_aabb_union(bounds, get_aabb_from_points(pointC, pointC)));
+		};
+
+		// Builds the mesh's BVH and adds it to the pools
+		BVH bvh;
+		bvh.Build(std::move(triangleBounds));
+		mMeshes.mFirstNode.push_back((uint32_t)mMeshes.mNodes.size());
+		mMeshes.mNodeCount.push_back((uint32_t)bvh.GetNodeCount());
+		mMeshes.mNodes.append(bvh.GetNodes(), (size_t)bvh.GetNodeCount());
+		mMeshes.mPrimIndices.append(bvh.GetPrimIndices(), (size_t)bvh.GetPrimCount());
+
+		mMeshes.mFirstVertex.push_back((uint32_t)firstVertex);
+		mMeshes.mVertexCount.push_back((uint32_t)vertexCount);
+		mMeshes.mFirstTriangle.push_back((uint32_t)firstTriangle);
+		mMeshes.mTriangleCount.push_back((uint32_t)triangleCount);
+		mMeshes.mColour.push_back(colour);
+		mMeshes.mTransform.push_back(glm::mat4x3(1.0f));
+		mMeshes.mInverseTransform.push_back(glm::mat4x3(1.0f));
+		ClearPrebuiltBVH();
+		return true;
+	};
+	// Adds another copy of the mesh at meshIndex, moved, turned and scaled from it by transform (an affine matrix, whose last column is the move) and coloured colour
+	// The copy shares the mesh's triangles and BVH, so an instance only costs one element of each per-mesh array
+	// Returns false if there's no such mesh or transform can't be undone (scaling something to nothing)
+	bool AddMeshInstance(size_t meshIndex, glm::mat4x3 transform, glm::vec3 colour)
+	{
+		if (meshIndex >= mMeshes.size())
+		{
+			return false;
+		};
+		glm::mat4 meshTransform = glm::mat4(transform) * glm::mat4(mMeshes.mTransform[meshIndex]);
+		if (glm::determinant(meshTransform) == 0)
+		{
+			return false;
+		};
+
+		// The runs are copied out first, as adding to an array can move what the copied element refers to
+		for (PrimitiveArray<uint32_t>* runs : { &mMeshes.mFirstVertex, &mMeshes.mVertexCount, &mMeshes.mFirstTriangle, &mMeshes.mTriangleCount, &mMeshes.mFirstNode, &mMeshes.mNodeCount })
+		{
+			uint32_t run = (*runs)[meshIndex];
+			runs->push_back(run);
+		};
+		mMeshes.mColour.push_back(colour);
+		mMeshes.mTransform.push_back(glm::mat4x3(meshTransform));
+		mMeshes.mInverseTransform.push_back(glm::mat4x3(glm::inverse(meshTransform)));
+		ClearPrebuiltBVH();
+		return true;
+	};
+
+	// Moves the shape at an index (see GetShapeType) by offset
+	void MoveShape(size_t shapeIndex, glm::vec3 offset)
+	{
+		size_t typeIndex;
+		switch (GetShapeType(shapeIndex, typeIndex))
+		{
+		case ShapeType::Sphere:
+			MovePoint(mSpheres.mCentreX, mSpheres.mCentreY, mSpheres.mCentreZ, typeIndex, offset);
+			break;
+		case ShapeType::Rectangle:
+			MovePoint(mRectangles.mCentreX, mRectangles.mCentreY, mRectangles.mCentreZ, typeIndex, offset);
+			break;
+		case ShapeType::Circle:
+			MovePoint(mCircles.mCentreX, mCircles.mCentreY, mCircles.mCentreZ, typeIndex, offset);
+			break;
+		case ShapeType::Triangle:
+			MovePoint(mTriangles.mAX, mTriangles.mAY, mTriangles.mAZ, typeIndex, offset);
+			MovePoint(mTriangles.mBX, mTriangles.mBY, mTriangles.mBZ, typeIndex, offset);
+			MovePoint(mTriangles.mCX, mTriangles.mCY, mTriangles.mCZ, typeIndex, offset);
+			break;
+		default:
+		{
+			// Moves the mesh's transform rather than its vertices, which its instances share
+			glm::mat4x3& transform = mMeshes.mTransform.GetMutableData()[typeIndex];
+			transform[3] += offset;
+			mMeshes.mInverseTransform.GetMutableData()[typeIndex] = glm::mat4x3(glm::inverse(glm::mat4(transform)));
+			break;
+		}
+		};
+		ClearPrebuiltBVH();
+	};
+	// Changes the colour of the shape at an index (see GetShapeType)
+	void SetShapeColour(size_t shapeIndex, glm::vec3 colour)
+	{
+		size_t typeIndex;
+		switch (GetShapeType(shapeIndex, typeIndex))
+		{
+		case ShapeType::Sphere:
+			mSpheres.mColour.GetMutableData()[typeIndex] = colour;
+			break;
+		case ShapeType::Rectangle:
+			mRectangles.mColour.GetMutableData()[typeIndex] = colour;
+			break;
+		case ShapeType::Circle:
+			mCircles.mColour.GetMutableData()[typeIndex] = colour;
+			break;
+		case ShapeType::Triangle:
+			mTriangles.mColour.GetMutableData()[typeIndex] = colour;
+			break;
+		default:
+			mMeshes.mColour.GetMutableData()[typeIndex] = colour;
+			break;
+		};
+	};
+	// Removes the shape at an index (see GetShapeType), every shape after it moves down an index
+	// Can't be used while a mesh is being added
+	void RemoveShape(size_t shapeIndex)
+	{
+		size_t typeIndex;
+		ShapeType type = GetShapeType(shapeIndex, typeIndex);
+
+		for (PrimitiveArrayBase* array : GetArrays(type))
+		{
+			array->Erase(typeIndex);
+		};
+
+		// A removed mesh's vertices, triangles and nodes are left unused in the pools, unless no mesh left uses them and they're at the end where the next mesh will be added
+		if (type == ShapeType::Mesh)
+		{
+			size_t vertexEnd = 0, triangleEnd = 0, nodeEnd = 0;
+			for (size_t i = 0; i < mMeshes.size(); i++)
+			{
+				vertexEnd = std::max(vertexEnd, (size_t)mMeshes.mFirstVertex[i] + mMeshes.mVertexCount[i]);
+				triangleEnd = std::max(triangleEnd, (size_t)mMeshes.mFirstTriangle[i] + mMeshes.mTriangleCount[i]);
+				nodeEnd = std::max(nodeEnd, (size_t)mMeshes.mFirstNode[i] + mMeshes.mNodeCount[i]);
+			};
+			mMeshes.mVertexX.resize(vertexEnd);
+			mMeshes.mVertexY.resize(vertexEnd);
+			mMeshes.mVertexZ.resize(vertexEnd);
+			mMeshes.mIndices.resize(triangleEnd * 3);
+			mMeshes.mPrimIndices.resize(triangleEnd);
+			mMeshes.mNodes.resize(nodeEnd);
+		};
+
+		// Drops the shape's keyframes, and moves the tracks of the shapes after it in its type down to match their new index
+		for (size_t track = 0; track < mAnimationTracks.size(); track++)
+		{
+			AnimationTrack& removedTrack = mAnimationTracks[track];
+			if (removedTrack.mType != type || removedTrack.mTypeIndex != typeIndex)
+			{
+				continue;
+			};
+
+			mKeyframes.erase(mKeyframes.begin() + removedTrack.mFirstKey, mKeyframes.begin() + removedTrack.mFirstKey + removedTrack.mKeyCount);
+			for (AnimationTrack& laterTrack : mAnimationTracks)
+			{
+				laterTrack.mFirstKey -= laterTrack.mFirstKey > removedTrack.mFirstKey ? removedTrack.mKeyCount : 0;
+			};
+			mAnimationTracks.erase(mAnimationTracks.begin() + track);
+			break;
+		};
+		for (AnimationTrack& track : mAnimationTracks)
+		{
+			track.mTypeIndex -= track.mType == type && track.mTypeIndex > typeIndex ? 1 : 0;
+		};
+		ClearPrebuiltBVH();
+	};
+
+	// Keyframes where a shape is at a frame of the scene's animation, as an offset from where it was added (see SetAnimationFrame)
+	// A shape's keyframes have to be added together in frame order, returns false if this one isn't after the shape's last
+	// Only spheres, rectangles, circles and triangles can be keyframed
+	bool AddKeyframe(ShapeType type, size_t typeIndex, float frame, glm::vec3 offset)
+	{
+		if (type == ShapeType::Mesh)
+		{
+			return false;
+		};
+
+		if (mAnimationTracks.empty() || mAnimationTracks.back().mType != type || mAnimationTracks.back().mTypeIndex != typeIndex)
+		{
+			mAnimationTracks.push_back(AnimationTrack{ type, typeIndex, (int)mKeyframes.size(), 0, glm::vec3(0, 0, 0) });
+		}
+		else if (frame <= mKeyframes.back().mFrame)
+		{
+			return false;
+		};
+
+		mKeyframes.push_back(Keyframe{ frame, offset });
+		mAnimationTracks.back().mKeyCount++;
+		return true;
+	};
+	// Moves every keyframed shape to where its keyframes put it at a frame, blending linearly between the keyframes either side
+	// Shapes stay at their first keyframe before it and at their last after it, returns how many shapes moved
+	size_t SetAnimationFrame(float frame)
+	{
+		size_t movedCount = 0;
+		for (AnimationTrack& track : mAnimationTracks)
+		{
+			const Keyframe* keys = &mKeyframes[track.mFirstKey];
+
+			// Finds the first keyframe after the frame
+			int next = 0;
+			while (next < track.mKeyCount && keys[next].mFrame <= frame)
+			{
+				next++;
+			};
+
+			glm::vec3 offset;
+			if (next == 0 || next == track.mKeyCount)
+			{
+				offset = keys[next == 0 ? 0 : next - 1].mOffset;
+			}
+			else
+			{
+				float blend = (frame - keys[next - 1].mFrame) / (keys[next].mFrame - keys[next - 1].mFrame);
+				offset = glm::mix(keys[next - 1].mOffset, keys[next].mOffset, blend);
+			};
+
+			if (offset != track.mOffset)
+			{
+				MoveShape(GetShapeIndex(track.mType, track.mTypeIndex), offset - track.mOffset);
+				track.mOffset = offset;
+				movedCount++;
+			};
+		};
+
+		return movedCount;
+	};
+	// Gets how many whole frames the animation runs for, up to and including the last keyframe of any shape (0 when nothing is keyframed)
+	int GetAnimationFrameCount() const
+	{
+		float lastFrame = -1;
+		for (const AnimationTrack& track : mAnimationTracks)
+		{
+			lastFrame = std::max(lastFrame, mKeyframes[track.mFirstKey + track.mKeyCount - 1].mFrame);
+		};
+
+		return lastFrame < 0 ? 0 : (int)lastFrame + 1;
+	};
+
+	const SphereBlock& GetSpheres() const
+	{
+		return mSpheres;
+	};
+	const RectangleBlock& GetRectangles() const
+	{
+		return mRectangles;
+	};
+	const CircleBlock& GetCircles() const
+	{
+		return mCircles;
+	};
+	const TriangleBlock& GetTriangles() const
+	{
+		return mTriangles;
+	};
+	const MeshBlock& GetMeshes() const
+	{
+		return mMeshes;
+	};
+
+	// Gets every array one type of shape is stored in
+	// Scene caches store the arrays in this order, so changing it needs a new cache version
+	std::vector<PrimitiveArrayBase*> GetArrays(ShapeType type)
+	{
+		switch (type)
+		{
+		case ShapeType::Sphere:
+			return { &mSpheres.mCentreX, &mSpheres.mCentreY, &mSpheres.mCentreZ, &mSpheres.mRadius, &mSpheres.mColour };
+		case ShapeType::Rectangle:
+			return { &mRectangles.mCentreX, &mRectangles.mCentreY, &mRectangles.mCentreZ, &mRectangles.mWidth, &mRectangles.mHeight, &mRectangles.mColour };
+		case ShapeType::Circle:
+			return { &mCircles.mCentreX, &mCircles.mCentreY, &mCircles.mCentreZ, &mCircles.mRadius, &mCircles.mColour };
+		case ShapeType::Triangle:
+			return { &mTriangles.mAX, &mTriangles.mAY, &mTriangles.mAZ, &mTriangles.mBX, &mTriangles.mBY, &mTriangles.mBZ, &mTriangles.mCX, &mTriangles.mCY, &mTriangles.mCZ, &mTriangles.mColour };
+		default:
+			return { &mMeshes.mFirstVertex, &mMeshes.mVertexCount, &mMeshes.mFirstTriangle, &mMeshes.mTriangleCount, &mMeshes.mFirstNode, &mMeshes.mNodeCount, &mMeshes.mColour, &mMeshes.mTransform, &mMeshes.mInverseTransform };
+		};
+	};
+	std::vector<const PrimitiveArrayBase*> GetArrays(ShapeType type) const
+	{
+		std::vector<PrimitiveArrayBase*> arrays = const_cast<Scene*>(this)->GetArrays(type);
+
+		return std::vector<const PrimitiveArrayBase*>(arrays.begin(), arrays.end());
+	};
+	// Gets the pools every mesh keeps its vertices, triangles and BVH in, which don't hold one element per shape like the arrays above
+	std::vector<PrimitiveArrayBase*> GetMeshPoolArrays()
+	{
+		return { &mMeshes.mVertexX, &mMeshes.mVertexY, &mMeshes.mVertexZ, &mMeshes.mIndices, &mMeshes.mNodes, &mMeshes.mPrimIndices };
+	};
+	std::vector<const PrimitiveArrayBase*> GetMeshPoolArrays() const
+	{
+		std::vector<PrimitiveArrayBase*> arrays = const_cast<Scene*>(this)->GetMeshPoolArrays();
+
+		return std::vector<const PrimitiveArrayBase*>(arrays.begin(), arrays.end());
+	};
+	// Keeps something the shape arrays (or a prebuilt BVH) view alive along with the scene
+	void SetBacking(std::shared_ptr<const MappedFile> backing)
+	{
+		mBacking = backing;
+	};
+
+	size_t GetShapeCount() const
+	{
+		return mSpheres.size() + mRectangles.size() + mCircles.size() + mTriangles.size() + mMeshes.size();
+	};
+	// Shapes are indexed as a whole by spheres first, then rectangles, circles, triangles and meshes (each mesh being one shape)
+	// Gets the index of a shape as a whole from its type and its index in that type's arrays, the opposite of GetShapeType
+	size_t GetShapeIndex(ShapeType type, size_t typeIndex) const
+	{
+		size_t firstIndex = 0;
+		firstIndex += type > ShapeType::Sphere ? mSpheres.size() : 0;
+		firstIndex += type > ShapeType::Rectangle ? mRectangles.size() : 0;
+		firstIndex += type > ShapeType::Circle ? mCircles.size() : 0;
+		firstIndex += type > ShapeType::Triangle ? mTriangles.size() : 0;
+
+		return firstIndex + typeIndex;
+	};
+	// Gets the type of the shape at an index, along with its index in that type's arrays
+	ShapeType GetShapeType(size_t shapeIndex, size_t& typeIndex) const
+	{
+		if (shapeIndex < mSpheres.size())
+		{
+			typeIndex = shapeIndex;
+			return ShapeType::Sphere;
+		};
+		shapeIndex -= mSpheres.size();
+
+		if (shapeIndex < mRectangles.size())
+		{
+			typeIndex = shapeIndex;
+			return ShapeType::Rectangle;
+		};
+		shapeIndex -= mRectangles.size();
+
+		if (shapeIndex < mCircles.size())
+		{
+			typeIndex = shapeIndex;
+			return ShapeType::Circle;
+		};
+		shapeIndex -= mCircles.size();
+
+		if (shapeIndex < mTriangles.size())
+		{
+			typeIndex = shapeIndex;
+			return ShapeType::Triangle;
+		};
+
+		typeIndex = shapeIndex - mTriangles.size();
+		return ShapeType::Mesh;
+	};
+	// Gets the box enclosing every point the shape at an index can be hit at (used by the BVH)
+	AABB GetShapeBounds(size_t shapeIndex) const
+	{
+		size_t typeIndex;
+		switch (GetShapeType(shapeIndex, typeIndex))
+		{
+		case ShapeType::Sphere:
+			return mSpheres.GetBounds(typeIndex);
+		case ShapeType::Rectangle:
+			return mRectangles.GetBounds(typeIndex);
+		case ShapeType::Circle:
+			return mCircles.GetBounds(typeIndex);
+		case ShapeType::Triangle:
+			return mTriangles.GetBounds(typeIndex);
+		default:
+			return mMeshes.GetBounds(typeIndex);
+		};
+	};
+
+	// Gets data on if the given ray collides with a shape, triangles and meshes use the ray's triangle setup
+	HitData GetHit(ShapeType type, size_t index, Ray ray, const TriangleRay& triangleRay) const
+	{
+		uint32_t triangle = 0;
+
+		switch (type)
+		{
+		case ShapeType::Sphere:
+			return get_ray_sphere_intersection(ray, mSpheres.GetCentre(index), mSpheres.mRadius[index]);
+		case ShapeType::Rectangle:
+			return get_ray_rectangle_intersection(ray, mRectangles.GetCentre(index), mRectangles.mWidth[index], mRectangles.mHeight[index]);
+		case ShapeType::Circle:
+			return get_ray_circle_intersection(ray, mCircles.GetCentre(index), mCircles.mRadius[index]);
+		case ShapeType::Triangle:
+			return get_ray_triangle_intersection(triangleRay, mTriangles.GetPointA(index), mTriangles.GetPointB(index), mTriangles.GetPointC(index));
+		default:
+			return GetMeshHit(index, ray, triangleRay, std::numeric_limits<float>::max(), triangle);
+		};
+	};
+	// Same as GetHit for planar shapes (see PlanarLayerIndex), given the point the ray crosses the shape's plane at (see get_point_at_z) so it isn't worked out again
+	// Triangles still use the ray's triangle setup, so they're hit exactly where GetHit hits them
+	HitData GetPlanarHit(ShapeType type, size_t index, glm::vec3 point, const TriangleRay& triangleRay) const
+	{
+		switch (type)
+		{
+		case ShapeType::Rectangle:
+			return HitData{ is_point_in_rectangle(point, mRectangles.GetCentre(index), mRectangles.mWidth[index], mRectangles.mHeight[index]), point };
+		case ShapeType::Circle:
+			return HitData{ is_point_in_circle(point, mCircles.GetCentre(index), mCircles.mRadius[index]), point };
+		default:
+			return get_ray_triangle_intersection(triangleRay, mTriangles.GetPointA(index), mTriangles.GetPointB(index), mTriangles.GetPointC(index));
+		};
+	};
+	// Moves a ray into the space a mesh's pooled vertices are in, returning false (leaving it alone) if the mesh isn't transformed
+	// A scaled mesh stretches the ray's direction too, lengthScale is set to how many lengths along the moved ray one length along the original is
+	bool GetMeshRay(size_t index, Ray& ray, TriangleRay& triangleRay, float& lengthScale) const
+	{
+		lengthScale = 1.0f;
+		if (mMeshes.IsUntransformed(index))
+		{
+			return false;
+		};
+
+		const glm::mat4x3& inverseTransform = mMeshes.mInverseTransform[index];
+		glm::vec3 direction = inverseTransform * glm::vec4(ray.GetDirection(), 0.0f);
+		lengthScale = glm::length(direction) / glm::length(ray.GetDirection());
+		ray = Ray(inverseTransform * glm::vec4(ray.GetOrigin(), 1.0f), direction);
+		triangleRay = get_triangle_ray(ray);
+		return true;
+	};
+	// Finds the nearest of a mesh's triangles the ray hits closer than maxDistance by walking the mesh's BVH, setting which triangle it was
+	// maxDistance and the distances hits are compared by are in the scene's space, whatever the mesh's transform
+	HitData GetMeshHit(size_t index, Ray ray, const TriangleRay& triangleRay, float maxDistance, uint32_t& triangle) const
+	{
+		// Transformed meshes are walked with the ray moved into their pooled vertices' space, and hits moved back out
+		// The BVH measures distances along the moved ray, so they are scaled to and from it by lengthScale
+		TriangleRay meshTriangleRay;
+		float lengthScale;
+		bool transformed = GetMeshRay(index, ray, meshTriangleRay, lengthScale);
+		const TriangleRay& testRay = transformed ? meshTriangleRay : triangleRay;
+		const glm::mat4x3& transform = mMeshes.mTransform[index];
+
+		const uint32_t* corners = mMeshes.mIndices.data() + (size_t)mMeshes.mFirstTriangle[index] * 3;
+		size_t firstVertex = mMeshes.mFirstVertex[index];
+		const float* vertexX = mMeshes.mVertexX.data() + firstVertex;
+		const float* vertexY = mMeshes.mVertexY.data() + firstVertex;
+		const float* vertexZ = mMeshes.mVertexZ.data() + firstVertex;
+
+		HitData closestHit{ false, glm::vec3(0, 0, 0) };
+		float closestDistance = std::min(maxDistance * lengthScale, std::numeric_limits<float>::max());
+		BVH::TraverseNodes(mMeshes.mNodes.data() + mMeshes.mFirstNode[index], (int)mMeshes.mNodeCount[index], mMeshes.mPrimIndices.data() + mMeshes.mFirstTriangle[index], ray, closestDistance, [&](int primIndex, float& currentClosest)
+		{
+			COUNT_INTERSECTION_TESTS(ShapeType::Mesh, 1);
+
+			const uint32_t* triangleCorners = corners + (size_t)primIndex * 3;
+			glm::vec3 pointA(vertexX[triangleCorners[0]], vertexY[triangleCorners[0]], vertexZ[triangleCorners[0]]);
+			glm::vec3 pointB(vertexX[triangleCorners[1]], vertexY[triangleCorners[1]], vertexZ[triangleCorners[1]]);
+			glm::vec3 pointC(vertexX[triangleCorners[2]], vertexY[triangleCorners[2]], vertexZ[triangleCorners[2]]);
+
+			// Distances are measured the same way as between shapes, so meshes and other shapes overlap correctly
+			HitData hitData = get_ray_triangle_intersection(testRay, pointA, pointB, pointC);
+			if (!hitData.mHit)
+			{
+				return false;
+			};
+			if (transformed)
+			{
+				hitData.mFirstIntersection = transform * glm::vec4(hitData.mFirstIntersection, 1.0f);
+			};
+			float distance = get_length_between_points(hitData.mFirstIntersection, triangleRay.mOrigin) * lengthScale;
+			if (distance >= currentClosest)
+			{
+				return false;
+			};
+
+			currentClosest = distance;
+			closestHit = hitData;
+			triangle = (uint32_t)primIndex;
+			return true;
+		});
+
+		return closestHit;
+	};
+	// Gets if any of a mesh's triangles but skipTriangle is in the ray's way
+	// Shadow rays aren't cut short, so the distance scale of a transformed mesh isn't needed
+	bool IsMeshBlocking(size_t index, Ray ray, const TriangleRay& triangleRay, uint32_t skipTriangle) const
+	{
+		TriangleRay meshTriangleRay;
+		float lengthScale;
+		bool transformed = GetMeshRay(index, ray, meshTriangleRay, lengthScale);
+		const TriangleRay& testRay = transformed ? meshTriangleRay : triangleRay;
+
+		const uint32_t* corners = mMeshes.mIndices.data() + (size_t)mMeshes.mFirstTriangle[index] * 3;
+		size_t firstVertex = mMeshes.mFirstVertex[index];
+		const float* vertexX = mMeshes.mVertexX.data() + firstVertex;
+		const float* vertexY = mMeshes.mVertexY.data() + firstVertex;
+		const float* vertexZ = mMeshes.mVertexZ.data() + firstVertex;
+
+		return BVH::TraverseAnyNodes(mMeshes.mNodes.data() + mMeshes.mFirstNode[index], (int)mMeshes.mNodeCount[index], mMeshes.mPrimIndices.data() + mMeshes.mFirstTriangle[index], ray, [&](int primIndex)
+		{
+			if ((uint32_t)primIndex == skipTriangle)
+			{
+				return false;
+			};
+			COUNT_INTERSECTION_TESTS(ShapeType::Mesh, 1);
+
+			const uint32_t* triangleCorners = corners + (size_t)primIndex * 3;
+			glm::vec3 pointA(vertexX[triangleCorners[0]], vertexY[triangleCorners[0]], vertexZ[triangleCorners[0]]);
+			glm::vec3 pointB(vertexX[triangleCorners[1]], vertexY[triangleCorners[1]], vertexZ[triangleCorners[1]]);
+			glm::vec3 pointC(vertexX[triangleCorners[2]], vertexY[triangleCorners[2]], vertexZ[triangleCorners[2]]);
+
+			return get_ray_triangle_distance(testRay, pointA, pointB, pointC) > 0;
+		});
+	};
+	glm::vec3 GetColour(ShapeType type, size_t index) const
+	{
+		switch (type)
+		{
+		case ShapeType::Sphere:
+			return mSpheres.mColour[index];
+		case ShapeType::Rectangle:
+			return mRectangles.mColour[index];
+		case ShapeType::Circle:
+			return mCircles.mColour[index];
+		case ShapeType::Triangle:
+			return mTriangles.mColour[index];
+		default:
+			return mMeshes.mColour[index];
+		};
+	};
+	// Gets the colour modifier for the pixel (adjusts brightness based on lighting), meshes also need which triangle was hit
+	float GetColourModifier(ShapeType type, size_t index, uint32_t triangle, glm::vec3 intersectionPoint) const
+	{
+		if (type == ShapeType::Sphere)
+		{
+			// Get normal to the sphere at intersection point
+			glm::vec3 sphereNormal = get_normal_on_sphere(mSpheres.GetCentre(index), intersectionPoint);
+
+			// Gets colour modifier based on similarity of normal and light direction
+			return pow(1 - get_direction_difference(mLightDirection, sphereNormal), 2);
+		};
+		if (type == ShapeType::Triangle)
+		{
+			// Colour modifier based on the triangle's normal
+			glm::vec3 triangleNormal = get_triangle_normal(mTriangles.GetPointA(index), mTriangles.GetPointB(index), mTriangles.GetPointC(index));
+
+			return pow(1 - get_direction_difference(mLightDirection, triangleNormal), 2);
+		};
+		if (type == ShapeType::Mesh)
+		{
+			// Colour modifier based on the hit triangle's normal, once it is where the mesh's transform puts it
+			glm::vec3 pointA, pointB, pointC;
+			mMeshes.GetTriangle(index, triangle, pointA, pointB, pointC);
+			if (!mMeshes.IsUntransformed(index))
+			{
+				const glm::mat4x3& transform = mMeshes.mTransform[index];
+				pointA = transform * glm::vec4(pointA, 1.0f);
+				pointB = transform * glm::vec4(pointB, 1.0f);
+				pointC = transform * glm::vec4(pointC, 1.0f);
+			};
+
+			return pow(1 - get_direction_difference(mLightDirection, get_triangle_normal(pointA, pointB, pointC)), 2);
+		};
+
+		// Basic colour modifier for 2D objects
+		return pow(1 - get_direction_difference(mLightDirection, glm::vec3(0, 0, -1)), 2);
+	};
+
+	glm::vec3 GetLightDirection() const
+	{
+		return mLightDirection;
+	};
+	void SetLightDirection(glm::vec3 lightDirection)
+	{
+		mLightDirection = lightDirection;
+	};
+
+	// Attaches a BVH built over the shapes in their current order, whatever its arrays are in has to be kept alive with SetBacking
+	// Adding shapes afterwards drops it, as it would no longer cover everything
+	void SetPrebuiltBVH(const BVHNode* nodes, int nodeCount, const int* primIndices)
+	{
+		mPrebuiltNodes = nodes;
+		mPrebuiltNodeCount = nodeCount;
+		mPrebuiltPrimIndices = primIndices;
+	};
+	void ClearPrebuiltBVH()
+	{
+		if (mPrebuiltNodes)
+		{
+			SetPrebuiltBVH(nullptr, 0, nullptr);
+		};
+	};
+	// Returns false if there is no prebuilt BVH
+	bool GetPrebuiltBVH(const BVHNode*& nodes, int& nodeCount, const int*& primIndices) const
+	{
+		nodes = mPrebuiltNodes;
+		nodeCount = mPrebuiltNodeCount;
+		primIndices = mPrebuiltPrimIndices;
+
+		return mPrebuiltNodes != nullptr;
+	};
+};
+
+
+// Widest and tallest a layer's grid gets, in cells
+const int kMaxLayerGridSize = 256;
+
+
+// Finds which planar shapes (rectangles, circles and triangles flat in z) a ray can hit by grouping them into layers of equal z, sorted by z, each with a 2D grid over its shapes
+// A ray works out where it crosses a layer once and only tests the shapes in the grid cell there, so it costs about one step per layer it reaches rather than a test per shape
+class PlanarLayerIndex
+{
+private:
+	// Stores every layer, sorted by z
+	std::vector<PlanarLayer> mLayers;
+	// Stores where each cell's shapes start in mCellShapes, cells of a layer following each other row by row, with one extra entry ending the last cell
+	std::vector<int> mCellStarts;
+	// Stores the shapes (indexed as in Scene::GetShapeType) overlapping each cell, in index order
+	std::vector<int> mCellShapes;
+	// Stores the shapes not on any layer, for something else to find
+	std::vector<int> mOtherShapes;
+	// Stores if the index has been built since it was last cleared
+	bool mBuilt;
+
+	// Gets the column or row of a layer's grid a coordinate falls in, coordinates past the grid's sides give its first or last
+	static int GetCell(float coordinate, float gridMin, float cellsPerUnit, int gridSize)
+	{
+		return std::min(std::max((int)((coordinate - gridMin) * cellsPerUnit), 0), gridSize - 1);
+	};
+	// Adds a layer over the shapes sharing a z, filling its cells from the shapes' bounds
+	void AddLayer(float z, const std::vector<int>& shapes, const std::vector<AABB>& shapeBounds)
+	{
+		PlanarLayer layer;
+		layer.mZ = z;
+		layer.mGridMin = glm::vec2(std::numeric_limits<float>::max());
+		layer.mGridMax = glm::vec2(-std::numeric_limits<float>::max());
+		for (size_t i = 0; i < shapes.size(); i++)
+		{
+			layer.mGridMin = glm::min(layer.mGridMin, glm::vec2(shapeBounds[i].mMin));
+			layer.mGridMax = glm::max(layer.mGridMax, glm::vec2(shapeBounds[i].mMax));
+		};
+
+		// Aims for about one shape per cell, with cells as near square as the layer allows
+		glm::vec2 size = layer.mGridMax - layer.mGridMin;
+		float cellSide = std::sqrt(size.x * size.y / (float)shapes.size());
+		layer.mGridX = cellSide > 0 ? std::min(std::max((int)std::ceil(size.x / cellSide), 1), kMaxLayerGridSize) : 1;
+		layer.mGridY = cellSide > 0 ? std::min(std::max((int)std::ceil(size.y / cellSide), 1), kMaxLayerGridSize) : 1;
+		layer.mCellsPerUnit.x = size.x > 0 ? (float)layer.mGridX / size.x : 0;
+		layer.mCellsPerUnit.y = size.y > 0 ? (float)layer.mGridY / size.y : 0;
+		layer.mFirstCell = (int)mCellStarts.size() - 1;
+
+		// Counts the shapes in each cell, then turns the counts into where each cell's shapes start
+		int cellCount = layer.mGridX * layer.mGridY;
+		std::vector<int> cellCounts(cellCount, 0);
+		std::vector<glm::ivec4> shapeCells(shapes.size());
+		for (size_t i = 0; i < shapes.size(); i++)
+		{
+			shapeCells[i] = glm::ivec4(GetCell(shapeBounds[i].mMin.x, layer.mGridMin.x, layer.mCellsPerUnit.x, layer.mGridX), GetCell(shapeBounds[i].mMin.y, layer.mGridMin.y, layer.mCellsPerUnit.y, layer.mGridY), GetCell(shapeBounds[i].mMax.x, layer.mGridMin.x, layer.mCellsPerUnit.x, layer.mGridX), GetCell(shapeBounds[i].mMax.y, layer.mGridMin.y, layer.mCellsPerUnit.y, layer.mGridY));
+			for (int y = shapeCells[i].y; y <= shapeCells[i].w; y++)
+			{
+				for (int x = shapeCells[i].x; x <= shapeCells[i].z; x++)
+				{
+					cellCounts[y * layer.mGridX + x]++;
+				};
+			};
+		};
+
+		int firstShape = (int)mCellShapes.size();
+		std::vector<int> cellEnds(cellCount);
+		for (int cell = 0; cell < cellCount; cell++)
+		{
+			cellEnds[cell] = firstShape;
+			firstShape += cellCounts[cell];
+			mCellStarts.push_back(firstShape);
+		};
+
+		// Shapes are taken in index order, so each cell's list is too
+		mCellShapes.resize(firstShape);
+		for (size_t i = 0; i < shapes.size(); i++)
+		{
+			for (int y = shapeCells[i].y; y <= shapeCells[i].w; y++)
+			{
+				for (int x = shapeCells[i].x; x <= shapeCells[i].z; x++)
+				{
+					mCellShapes[cellEnds[y * layer.mGridX + x]++] = shapes[i];
+				};
+			};
+		};
+
+		mLayers.push_back(layer);
+	};
+	// Calls visit(point, shapes, count) with the shapes in the cell the ray crosses each layer it reaches in, nearest layer first, until it returns true
+	// Stops at the first layer at or further than maxDistance, which visit may lower
+	template <typename VisitFunc>
+	bool Walk(Ray ray, const float& maxDistance, VisitFunc visit) const
+	{
+		glm::vec3 origin = ray.GetOrigin();
+		glm::vec3 direction = ray.GetDirection();
+
+		// Rays running along the layers never cross them
+		if (direction.z == 0 || mLayers.empty())
+		{
+			return false;
+		};
+
+		// Starts at the first layer level with or past the origin in the ray's direction
+		int step = direction.z > 0 ? 1 : -1;
+		auto zLess = [](const PlanarLayer& layer, float z) { return layer.mZ < z; };
+		auto zGreater = [](float z, const PlanarLayer& layer) { return z < layer.mZ; };
+		int first = step > 0 ? (int)(std::lower_bound(mLayers.begin(), mLayers.end(), origin.z, zLess) - mLayers.begin()) : (int)(std::upper_bound(mLayers.begin(), mLayers.end(), origin.z, zGreater) - mLayers.begin()) - 1;
+
+		for (int i = first; i >= 0 && i < (int)mLayers.size(); i += step)
+		{
+			COUNT_TRAVERSAL_STEP();
+			const PlanarLayer& layer = mLayers[i];
+
+			// Gets the crossing point the same way the shapes' own tests do
+			glm::vec3 point = get_point_at_z(ray, layer.mZ);
+
+			// Layers are reached in order, so nothing nearer is left once one is at or past the closest distance
+			if (get_length_between_points(point, origin) >= maxDistance)
+			{
+				return false;
+			};
+
+			// Skips layers the ray doesn't reach ahead of it, or misses the grid of (written so points that aren't numbers miss too)
+			if (glm::dot(point - origin, direction) < 0 || !(point.x >= layer.mGridMin.x && point.x <= layer.mGridMax.x && point.y >= layer.mGridMin.y && point.y <= layer.mGridMax.y))
+			{
+				continue;
+			};
+
+			int cell = layer.mFirstCell + GetCell(point.y, layer.mGridMin.y, layer.mCellsPerUnit.y, layer.mGridY) * layer.mGridX + GetCell(point.x, layer.mGridMin.x, layer.mCellsPerUnit.x, layer.mGridX);
+			if (visit(point, mCellShapes.data() + mCellStarts[cell], mCellStarts[cell + 1] - mCellStarts[cell]))
+			{
+				return true;
+			};
+		};
+
+		return false;
+	};
+
+public:
+	PlanarLayerIndex() : mBuilt(false) {};
+	~PlanarLayerIndex() {};
+
+	// Sorts the scene's planar shapes into layers, every other shape goes in the list from GetOtherShapes
+	void Build(const Scene& scene)
+	{
+		Clear();
+
+		// Gets the z of every planar shape, grouping equal ones together in index order
+		std::vector<std::pair<float, int>> planarShapes;
+		for (size_t i = 0; i < scene.GetShapeCount(); i++)
+		{
+			size_t typeIndex;
+			ShapeType type = scene.GetShapeType(i, typeIndex);
+			AABB bounds = scene.GetShapeBounds(i);
+			if (type == ShapeType::Rectangle || type == ShapeType::Circle || (type == ShapeType::Triangle && bounds.mMin.z == bounds.mMax.z))
+			{
+				planarShapes.push_back(std::make_pair(bounds.mMin.z, (int)i));
+			}
+			else
+			{
+				mOtherShapes.push_back((int)i);
+			};
+		};
+		std::sort(planarShapes.begin(), planarShapes.end());
+
+		mCellStarts.push_back(0);
+		std::vector<int> layerShapes;
+		std::vector<AABB> layerBounds;
+		for (size_t i = 0; i < planarShapes.size(); i++)
+		{
+			layerShapes.push_back(planarShapes[i].second);
+			layerBounds.push_back(scene.GetShapeBounds(planarShapes[i].second));
+
+			if (i + 1 == planarShapes.size() || planarShapes[i + 1].first != planarShapes[i].first)
+			{
+				AddLayer(planarShapes[i].first, layerShapes, layerBounds);
+				layerShapes.clear();
+				layerBounds.clear();
+			};
+		};
+
+		mBuilt = true;
+	};
+	void Clear()
+	{
+		mLayers.clear();
+		mCellStarts.clear();
+		mCellShapes.clear();
+		mOtherShapes.clear();
+		mBuilt = false;
+	};
+
+	// Visits the shapes in the cells the ray crosses, nearest layer first, stopping after the first layer with a hit or at a layer beyond closestDistance
+	// The intersect function is called as intersect(shapeIndex, point, closestDistance), point being where the ray crosses the shape's layer, and should lower closestDistance and return true when it finds a closer hit
+	template <typename IntersectFunc>
+	bool Traverse(Ray ray, float& closestDistance, IntersectFunc intersect) const
+	{
+		return Walk(ray, closestDistance, [&](glm::vec3 point, const int* shapes, int count)
+		{
+			bool hit = false;
+			for (int i = 0; i < count; i++)
+			{
+				if (intersect(shapes[i], point, closestDistance))
+				{
+					hit = true;
+				};
+			};
+			return hit;
+		});
+	};
+	// Visits the shapes in the cells the ray crosses until occludes(shapeIndex) returns true, for shadow rays
+	template <typename OccludeFunc>
+	bool TraverseAny(Ray ray, OccludeFunc occludes) const
+	{
+		float maxDistance = std::numeric_limits<float>::max();
+
+		return Walk(ray, maxDistance, [&](glm::vec3 /*point*/, const int* shapes, int count)
+		{
+			for (int i = 0; i < count; i++)
+			{
+				if (occludes(shapes[i]))
+				{
+					return true;
+				};
+			};
+			return false;
+		});
+	};
+
+	bool IsBuilt() const
+	{
+		return mBuilt;
+	};
+	int GetLayerCount() const
+	{
+		return (int)mLayers.size();
+	};
+	const std::vector<int>& GetOtherShapes() const
+	{
+		return mOtherShapes;
+	};
+};
+
+
+// Widest a uniform grid gets along any axis in cells, and how many cells it aims for per shape
+const int kMaxGridSize = 256;
+const float kGridCellsPerShape = 2.0f;
+// Fraction of a cell that shapes' cell ranges are widened by, so rounding as a ray steps between cells can't miss a shape at their boundary
+const float kGridCellPadding = 1e-3f;
+// Shapes (or cells) each thread takes at once while a grid is built
+const int kGridBuildChunkSize = 4096;
+// How many of the shapes tested last a grid walk remembers, so shapes spanning several cells aren't tested again in each
+const int kGridMailboxSize = 8;
+
+
+// Splits the space around a scene's shapes into equal boxes, each listing the shapes whose bounds overlap it
+// Rays step from box to box in the order they pass through them (3D-DDA), testing the shapes in each, so they stop soon after the cell holding the first thing they hit
+// Suits many similar-sized shapes spread fairly evenly, where it builds faster than a hierarchy and each step is cheaper
+class UniformGrid
+{
+private:
+	// Stores the grid's corners, its size in cells along each axis and how many cells there are per unit along each
+	glm::vec3 mMin;
+	glm::vec3 mMax;
+	glm::ivec3 mSize;
+	glm::vec3 mCellsPerUnit;
+	// Stores where each cell's shapes start in mCellShapes, cells in x, then y, then z order, with one extra entry ending the last cell
+	std::vector<int> mCellStarts;
+	// Stores the shapes (indexed as in the bounds the grid was built over) overlapping each cell, in index order
+	std::vector<int> mCellShapes;
+	// Stores if the grid has been built since it was last cleared
+	bool mBuilt;
+
+	// Gets the first and last cells along each axis that a box overlaps
+	void GetCellRange(const AABB& bounds, glm::ivec3& first, glm::ivec3& last) const
+	{
+		first = glm::clamp(glm::ivec3(glm::floor((bounds.mMin - mMin) * mCellsPerUnit - kGridCellPadding)), glm::ivec3(0), mSize - 1);
+		last = glm::clamp(glm::ivec3(glm::floor((bounds.mMax - mMin) * mCellsPerUnit + kGridCellPadding)), glm::ivec3(0), mSize - 1);
+	};
+	int GetCellIndex(glm::ivec3 cell) const
+	{
+		return (cell.z * mSize.y + cell.y) * mSize.x + cell.x;
+	};
+	// Calls visit(shapeIndex) for the shapes in each cell the ray passes through, in the order it reaches them, until it returns true
+	// Stops once the ray leaves a cell further away than maxDistance, which visit may lower
+	template <typename VisitFunc>
+	bool Walk(Ray ray, const float& maxDistance, VisitFunc visit) const
+	{
+		if (mCellShapes.empty())
+		{
+			return false;
+		};
+
+		glm::vec3 origin = ray.GetOrigin();
+		glm::vec3 direction = ray.GetDirection();
+		glm::vec3 inverseDirection = get_safe_inverse_direction(direction);
+
+		// Distances along the ray are in multiples of its direction, this converts them to lengths comparable with hit distances
+		float directionLength = glm::length(direction);
+
+		// Finds where the ray enters the grid, if it does
+		glm::vec3 nearDistances = glm::min((mMin - origin) * inverseDirection, (mMax - origin) * inverseDirection);
+		glm::vec3 farDistances = glm::max((mMin - origin) * inverseDirection, (mMax - origin) * inverseDirection);
+		float entry = std::max(std::max(nearDistances.x, nearDistances.y), std::max(nearDistances.z, 0.0f));
+		float exit = std::min(std::min(farDistances.x, farDistances.y), farDistances.z);
+		if (entry > exit)
+		{
+			return false;
+		};
+
+		// Starts in the cell the ray enters at, then gets the step along each axis, how far the ray goes before it crosses the next cell boundary on each, and how far it goes between boundaries
+		glm::ivec3 cell = glm::clamp(glm::ivec3(glm::floor((origin + direction * entry - mMin) * mCellsPerUnit)), glm::ivec3(0), mSize - 1);
+		glm::ivec3 step;
+		glm::vec3 nextBoundary;
+		glm::vec3 boundaryGap;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float cellWidth = 1.0f / mCellsPerUnit[axis];
+			if (direction[axis] > 0)
+			{
+				step[axis] = 1;
+				nextBoundary[axis] = (mMin[axis] + (cell[axis] + 1) * cellWidth - origin[axis]) * inverseDirection[axis];
+				boundaryGap[axis] = cellWidth * inverseDirection[axis];
+			}
+			else if (direction[axis] < 0)
+			{
+				step[axis] = -1;
+				nextBoundary[axis] = (mMin[axis] + cell[axis] * cellWidth - origin[axis]) * inverseDirection[axis];
+				boundaryGap[axis] = -cellWidth * inverseDirection[axis];
+			}
+			else
+			{
+				step[axis] = 0;
+				nextBoundary[axis] = std::numeric_limits<float>::max();
+				boundaryGap[axis] = 0;
+			};
+		};
+
+		int mailbox[kGridMailboxSize];
+		std::fill(mailbox, mailbox + kGridMailboxSize, -1);
+		int mailboxNext = 0;
+
+		while (true)
+		{
+			COUNT_TRAVERSAL_STEP();
+
+			int cellIndex = GetCellIndex(cell);
+			for (int i = mCellStarts[cellIndex]; i < mCellStarts[cellIndex + 1]; i++)
+			{
+				int shapeIndex = mCellShapes[i];
+				if (std::find(mailbox, mailbox + kGridMailboxSize, shapeIndex) != mailbox + kGridMailboxSize)
+				{
+					continue;
+				};
+				mailbox[mailboxNext] = shapeIndex;
+				mailboxNext = (mailboxNext + 1) % kGridMailboxSize;
+
+				if (visit(shapeIndex))
+				{
+					return true;
+				};
+			};
+
+			// Crosses whichever boundary is nearest, unless what's been hit is nearer, as everything past it is further than that
+			int axis = nextBoundary.x < nextBoundary.y ? (nextBoundary.x < nextBoundary.z ? 0 : 2) : (nextBoundary.y < nextBoundary.z ? 1 : 2);
+			if (nextBoundary[axis] * directionLength >= maxDistance)
+			{
+				return false;
+			};
+
+			cell[axis] += step[axis];
+			if (cell[axis] < 0 || cell[axis] >= mSize[axis])
+			{
+				return false;
+			};
+			nextBoundary[axis] += boundaryGap[axis];
+		};
+	};
+
+public:
+	UniformGrid() : mMin(0, 0, 0), mMax(0, 0, 0), mSize(0, 0, 0), mCellsPerUnit(0, 0, 0), mBuilt(false) {};
+	~UniformGrid() {};
+
+	// Builds the grid over the given primitive bounds across every hardware thread, primitives are referred to by their index in the list
+	// Cells are picked about as wide as they are tall and deep, kGridCellsPerShape of them per primitive
+	void Build(const std::vector<AABB>& primBounds)
+	{
+		Clear();
+		mBuilt = true;
+
+		if (primBounds.empty())
+		{
+			return;
+		};
+
+		AABB bounds = get_empty_aabb();
+		for (const AABB& primBound : primBounds)
+		{
+			bounds = get_aabb_union(bounds, primBound);
+		};
+
+		// Flat scenes get a sliver of depth, so every axis has room for a cell
+		glm::vec3 extent = bounds.mMax - bounds.mMin;
+		float largestExtent = std::max(std::max(extent.x, extent.y), extent.z);
+		extent = largestExtent > 0 ? glm::max(extent, glm::vec3(largestExtent * 1e-3f)) : glm::vec3(1, 1, 1);
+
+		int primCount = (int)primBounds.size();
+		float cellWidth = std::cbrt(extent.x * extent.y * extent.z / (kGridCellsPerShape * primCount));
+		mMin = bounds.mMin;
+		mMax = bounds.mMin + extent;
+		mSize = glm::clamp(glm::ivec3(glm::ceil(extent / cellWidth)), glm::ivec3(1), glm::ivec3(kMaxGridSize));
+		mCellsPerUnit = glm::vec3(mSize) / extent;
+
+		// Counts the primitives overlapping each cell
+		int cellCount = mSize.x * mSize.y * mSize.z;
+		int primChunkCount = (primCount + kGridBuildChunkSize - 1) / kGridBuildChunkSize;
+		int cellChunkCount = (cellCount + kGridBuildChunkSize - 1) / kGridBuildChunkSize;
+		std::unique_ptr<std::atomic<int>[]> cellCursors(new std::atomic<int>[cellCount]);
+		run_in_parallel(cellChunkCount, [&](int chunk)
+		{
+			for (int cell = chunk * kGridBuildChunkSize; cell < std::min((chunk + 1) * kGridBuildChunkSize, cellCount); cell++)
+			{
+				cellCursors[cell].store(0, std::memory_order_relaxed);
+			};
+		});
+		auto forEachCell = [&](int prim, auto action)
+		{
+			glm::ivec3 first, last;
+			GetCellRange(primBounds[prim], first, last);
+			for (int z = first.z; z <= last.z; z++)
+			{
+				for (int y = first.y; y <= last.y; y++)
+				{
+					for (int x = first.x; x <= last.x; x++)
+					{
+						action(GetCellIndex(glm::ivec3(x, y, z)));
+					};
+				};
+			};
+		};
+		run_in_parallel(primChunkCount, [&](int chunk)
+		{
+			for (int prim = chunk * kGridBuildChunkSize; prim < std::min((chunk + 1) * kGridBuildChunkSize, primCount); prim++)
+			{
+				forEachCell(prim, [&](int cell) { cellCursors[cell].fetch_add(1, std::memory_order_relaxed); });
+			};
+		});
+
+		// Turns the counts into where each cell's primitives start, leaving each cell's cursor at its start
+		mCellStarts.resize((size_t)cellCount + 1);
+		mCellStarts[0] = 0;
+		for (int cell = 0; cell < cellCount; cell++)
+		{
+			mCellStarts[cell + 1] = mCellStarts[cell] + cellCursors[cell].load(std::memory_order_relaxed);
+			cellCursors[cell].store(mCellStarts[cell], std::memory_order_relaxed);
+		};
+		mCellShapes.resize(mCellStarts[cellCount]);
+
+		// Fills the cells, threads adding to the same cell in any order, so each cell is sorted after to keep ties between primitives always going the same way
+		run_in_parallel(primChunkCount, [&](int chunk)
+		{
+			for (int prim = chunk * kGridBuildChunkSize; prim < std::min((chunk + 1) * kGridBuildChunkSize, primCount); prim++)
+			{
+				forEachCell(prim, [&](int cell) { mCellShapes[cellCursors[cell].fetch_add(1, std::memory_order_relaxed)] = prim; });
+			};
+		});
+		run_in_parallel(cellChunkCount, [&](int chunk)
+		{
+			for (int cell = chunk * kGridBuildChunkSize; cell < std::min((chunk + 1) * kGridBuildChunkSize, cellCount); cell++)
+			{
+				std::sort(mCellShapes.begin() + mCellStarts[cell], mCellShapes.begin() + mCellStarts[cell + 1]);
+			};
+		});
+	};
+	void Clear()
+	{
+		mCellStarts.clear();
+		mCellShapes.clear();
+		mSize = glm::ivec3(0, 0, 0);
+		mBuilt = false;
+	};
+
+	// Visits the shapes in the cells the ray passes through, nearest cell first, stopping after the cell a hit closer than closestDistance is found in
+	// The intersect function is called as intersect(primIndex, closestDistance) and should lower closestDistance and return true when it finds a closer hit
+	template <typename IntersectFunc>
+	bool Traverse(Ray ray, float& closestDistance, IntersectFunc intersect) const
+	{
+		bool hit = false;
+		Walk(ray, closestDistance, [&](int primIndex)
+		{
+			if (intersect(primIndex, closestDistance))
+			{
+				hit = true;
+			};
+			return false;
+		});
+		return hit;
+	};
+	// Visits the shapes in the cells the ray passes through until occludes(primIndex) returns true, for shadow rays
+	template <typename OccludeFunc>
+	bool TraverseAny(Ray ray, OccludeFunc occludes) const
+	{
+		float maxDistance = std::numeric_limits<float>::max();
+
+		return Walk(ray, maxDistance, occludes);
+	};
+
+	bool IsBuilt() const
+	{
+		return mBuilt;
+	};
+	int GetCellCount() const
+	{
+		return mSize.x * mSize.y * mSize.z;
+	};
+};
+
+
+// Ways of finding which shape a ray hits first
+enum class AccelerationMode
+{
+	Linear,	// Tests every shape in the scene
+	BVH,	// Walks a bounding volume hierarchy built over the scene's shapes
+	Layers,	// Walks the z layers of a PlanarLayerIndex for planar shapes, and a BVH over the rest
+	Grid	// Steps through the cells of a UniformGrid over the scene's shapes
+};
+
+
+// Refitted BVHs are built again once their cost (see BVH::GetCost) grows past this many times what it was when built
+const float kRefitCostLimit = 1.5f;
+// Share of its light a point in shadow keeps
+const float kShadowBrightness = 0.25f;
+// How far along the light direction shadow rays start from the point they're cast from, so they can't hit the surface they leave
+const float kShadowRayOffset = 0.01f;
+
+// The shape that last blocked a shadow ray on this thread, tried first by the next one as neighbouring points are usually shadowed by the same shape
+thread_local int gLastOccluder = -1;
+// Whether shadow rays try gLastOccluder first, on unless a benchmark changes it
+bool gUseOccluderCache = true;
+
+// Shape ID of rays that hit nothing (see RayTracer::TraceRay)
+const uint32_t kMissShapeId = 0;
+
+
+class RayTracer
+{
+private:
+	// Stores current scene
+	Scene mCurrentScene;
+	// Stores how closest hits are found
+	AccelerationMode mAccelerationMode;
+	// Stores the hierarchy over the current scene's shapes, leaves hold indices as used by Scene::GetShapeType
+	BVH mBVH;
+	// Stores how the hierarchies are built, and how long building or refitting mBVH last took (negative when the scene came with it prebuilt)
+	BVHBuilder mBVHBuilder;
+	double mBVHBuildMs;
+	// Stores mBVH's cost (see BVH::GetCost) when it was last built, and how many times that refitting it can grow its cost to before it is built again
+	float mBuiltBVHCost;
+	float mRefitCostLimit;
+	// Stores the z layers over the current scene's planar shapes, and a hierarchy over its other shapes (leaves hold indices into mLayers.GetOtherShapes()), only built while the layer mode is in use
+	PlanarLayerIndex mLayers;
+	BVH mOtherBVH;
+	// Stores the uniform grid over the current scene's shapes, indexed as in Scene::GetShapeType, only built while the grid mode is in use
+	UniformGrid mGrid;
+	// Stores if hit points are checked for shapes between them and the light
+	bool mShadows;
+
+	// Keeps a hit if it is closer than the closest one so far
+	static void KeepClosestHit(Ray ray, HitData currentHitData, ShapeType type, size_t index, ShapeHit& closestHit, uint32_t triangle = 0)
+	{
+		// If collision detected
+		if (currentHitData.mHit)
+		{
+			// Check if closest collision
+			float distance = get_length_between_points(currentHitData.mFirstIntersection, ray.GetOrigin());
+			if (distance < closestHit.mDistance)
+			{
+				closestHit = ShapeHit{ currentHitData, distance, type, index, triangle };
+			};
+		};
+	};
+
+	// Finds the closest hit by testing every shape, one type at a time
+	void GetClosestHitLinear(Ray ray, ShapeHit& closestHit) const
+	{
+		// Spheres are tested several at a time by the sphere kernel
+		const SphereBlock& spheres = mCurrentScene.GetSpheres();
+		COUNT_INTERSECTION_TESTS(ShapeType::Sphere, spheres.size());
+		float sphereDistance = closestHit.mDistance;
+		int sphereIndex = get_nearest_sphere_hit(ray, spheres.mCentreX.data(), spheres.mCentreY.data(), spheres.mCentreZ.data(), spheres.mRadius.data(), spheres.size(), sphereDistance);
+		if (sphereIndex >= 0)
+		{
+			glm::vec3 hitPoint = ray.GetOrigin() + ray.GetDirection() * (sphereDistance / glm::length(ray.GetDirection()));
+			KeepClosestHit(ray, HitData{ true, hitPoint }, ShapeType::Sphere, sphereIndex, closestHit);
+		};
+
+		const RectangleBlock& rectangles = mCurrentScene.GetRectangles();
+		COUNT_INTERSECTION_TESTS(ShapeType::Rectangle, rectangles.size());
+		const float* rectangleX = rectangles.mCentreX.data();
+		const float* rectangleY = rectangles.mCentreY.data();
+		const float* rectangleZ = rectangles.mCentreZ.data();
+		const float* rectangleWidth = rectangles.mWidth.data();
+		const float* rectangleHeight = rectangles.mHeight.data();
+		for (size_t i = 0; i < rectangles.size(); i++)
+		{
+			KeepClosestHit(ray, get_ray_rectangle_intersection(ray, glm::vec3(rectangleX[i], rectangleY[i], rectangleZ[i]), rectangleWidth[i], rectangleHeight[i]), ShapeType::Rectangle, i, closestHit);
+		};
+
+		const CircleBlock& circles = mCurrentScene.GetCircles();
+		COUNT_INTERSECTION_TESTS(ShapeType::Circle, circles.size());
+		const float* circleX = circles.mCentreX.data();
+		const float* circleY = circles.mCentreY.data();
+		const float* circleZ = circles.mCentreZ.data();
+		const float* circleRadius = circles.mRadius.data();
+		for (size_t i = 0; i < circles.size(); i++)
+		{
+			KeepClosestHit(ray, get_ray_circle_intersection(ray, glm::vec3(circleX[i], circleY[i], circleZ[i]), circleRadius[i]), ShapeType::Circle, i, closestHit);
+		};
+
+		// The ray is set up for the triangle test once for every triangle
+		const TriangleBlock& triangles = mCurrentScene.GetTriangles();
+		COUNT_INTERSECTION_TESTS(ShapeType::Triangle, triangles.size());
+		TriangleRay triangleRay = get_triangle_ray(ray);
+		const float* triangleAX = triangles.mAX.data();
+		const float* triangleAY = triangles.mAY.data();
+		const float* triangleAZ = triangles.mAZ.data();
+		const float* triangleBX = triangles.mBX.data();
+		const float* triangleBY = triangles.mBY.data();
+		const float* triangleBZ = triangles.mBZ.data();
+		const float* triangleCX = triangles.mCX.data();
+		const float* triangleCY = triangles.mCY.data();
+		const float* triangleCZ = triangles.mCZ.data();
+		for (size_t i = 0; i < triangles.size(); i++)
+		{
+			HitData currentHitData = get_ray_triangle_intersection(triangleRay, glm::vec3(triangleAX[i], triangleAY[i], triangleAZ[i]), glm::vec3(triangleBX[i], triangleBY[i], triangleBZ[i]), glm::vec3(triangleCX[i], triangleCY[i], triangleCZ[i]));
+			KeepClosestHit(ray, currentHitData, ShapeType::Triangle, i, closestHit);
+		};
+
+		// Meshes are too big to test every triangle of, so each is searched through its own BVH
+		const MeshBlock& meshes = mCurrentScene.GetMeshes();
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			uint32_t triangle = 0;
+			HitData currentHitData = mCurrentScene.GetMeshHit(i, ray, triangleRay, closestHit.mDistance, triangle);
+			KeepClosestHit(ray, currentHitData, ShapeType::Mesh, i, closestHit, triangle);
+		};
+	};
+	// Tests the shape at an index (as used by Scene::GetShapeType) for a hierarchy's traversal, lowering currentClosest and returning true if it's hit closer
+	bool TestClosestShape(int shapeIndex, Ray ray, const TriangleRay& triangleRay, float& currentClosest, ShapeHit& closestHit) const
+	{
+		// Check for collision
+		size_t typeIndex;
+		ShapeType type = mCurrentScene.GetShapeType(shapeIndex, typeIndex);
+		if (type == ShapeType::Mesh)
+		{
+			// Meshes only look for triangles closer than the closest hit so far
+			uint32_t triangle = 0;
+			HitData hitData = mCurrentScene.GetMeshHit(typeIndex, ray, triangleRay, currentClosest, triangle);
+			KeepClosestHit(ray, hitData, type, typeIndex, closestHit, triangle);
+		}
+		else
+		{
+			COUNT_INTERSECTION_TESTS(type, 1);
+			KeepClosestHit(ray, mCurrentScene.GetHit(type, typeIndex, ray, triangleRay), type, typeIndex, closestHit);
+		};
+
+		// Check if closest collision
+		if (closestHit.mDistance >= currentClosest)
+		{
+			return false;
+		};
+
+		currentClosest = closestHit.mDistance;
+		return true;
+	};
+	// Finds the closest hit by walking the BVH
+	void GetClosestHitBVH(Ray ray, ShapeHit& closestHit) const
+	{
+		float closestDistance = std::numeric_limits<float>::max();
+		TriangleRay triangleRay = get_triangle_ray(ray);
+
+		mBVH.Traverse(ray, closestDistance, [&](int primIndex, float& currentClosest)
+		{
+			return TestClosestShape(primIndex, ray, triangleRay, currentClosest, closestHit);
+		});
+	};
+	// Finds the closest hit by stepping through the grid
+	void GetClosestHitGrid(Ray ray, ShapeHit& closestHit) const
+	{
+		float closestDistance = std::numeric_limits<float>::max();
+		TriangleRay triangleRay = get_triangle_ray(ray);
+
+		mGrid.Traverse(ray, closestDistance, [&](int primIndex, float& currentClosest)
+		{
+			return TestClosestShape(primIndex, ray, triangleRay, currentClosest, closestHit);
+		});
+	};
+	// Finds the closest hit by walking the hierarchy over shapes off the layers, then the layers up to whatever that hit
+	void GetClosestHitLayers(Ray ray, ShapeHit& closestHit) const
+	{
+		float closestDistance = std::numeric_limits<float>::max();
+		TriangleRay triangleRay = get_triangle_ray(ray);
+		const std::vector<int>& otherShapes = mLayers.GetOtherShapes();
+
+		mOtherBVH.Traverse(ray, closestDistance, [&](int primIndex, float& currentClosest)
+		{
+			return TestClosestShape(otherShapes[primIndex], ray, triangleRay, currentClosest, closestHit);
+		});
+
+		closestDistance = closestHit.mDistance;
+		mLayers.Traverse(ray, closestDistance, [&](int shapeIndex, glm::vec3 point, float& currentClosest)
+		{
+			size_t typeIndex;
+			ShapeType type = mCurrentScene.GetShapeType(shapeIndex, typeIndex);
+			COUNT_INTERSECTION_TESTS(type, 1);
+			KeepClosestHit(ray, mCurrentScene.GetPlanarHit(type, typeIndex, point, triangleRay), type, typeIndex, closestHit);
+
+			if (closestHit.mDistance >= currentClosest)
+			{
+				return false;
+			};
+
+			currentClosest = closestHit.mDistance;
+			return true;
+		});
+	};
+	// Finds the closest hit of every ray in a packet by walking the BVH with the whole packet
+	void GetClosestHitsBVH(const RayPacket& packet, ShapeHit* closestHits) const
+	{
+		float closestDistances[kPacketWidth];
+		TriangleRay triangleRays[kPacketWidth];
+		for (int lane = 0; lane < kPacketWidth; lane++)
+		{
+			closestDistances[lane] = std::numeric_limits<float>::max();
+			if (packet.mActiveMask & (1 << lane))
+			{
+				triangleRays[lane] = get_triangle_ray(packet.GetRay(lane));
+			};
+		};
+
+		const SphereBlock& spheres = mCurrentScene.GetSpheres();
+		mBVH.TraversePacket(packet, closestDistances, [&](int primIndex, int laneMask, float* currentClosest)
+		{
+			size_t typeIndex;
+			ShapeType type = mCurrentScene.GetShapeType(primIndex, typeIndex);
+
+			// Each lane tested counts as a test of its own
+			if (type != ShapeType::Mesh)
+			{
+				COUNT_INTERSECTION_TESTS(type, get_lane_count(laneMask));
+			};
+
+			if (type == ShapeType::Sphere)
+			{
+				// Spheres are tested against every lane at once
+				float distances[kPacketWidth];
+				int hitMask = get_packet_sphere_hits(packet, laneMask, spheres.GetCentre(typeIndex), spheres.mRadius[typeIndex], distances);
+				for (int lane = 0; lane < kPacketWidth; lane++)
+				{
+					if (hitMask & (1 << lane))
+					{
+						Ray ray = packet.GetRay(lane);
+						glm::vec3 hitPoint = ray.GetOrigin() + ray.GetDirection() * (distances[lane] / packet.mDirectionLength[lane]);
+						KeepClosestHit(ray, HitData{ true, hitPoint }, type, typeIndex, closestHits[lane]);
+					};
+				};
+			}
+			else
+			{
+				// Other shapes are tested one lane at a time
+				for (int lane = 0; lane < kPacketWidth; lane++)
+				{
+					if (!(laneMask & (1 << lane)))
+					{
+						continue;
+					};
+
+					Ray ray = packet.GetRay(lane);
+					uint32_t triangle = 0;
+					HitData hitData = type == ShapeType::Mesh ? mCurrentScene.GetMeshHit(typeIndex, ray, triangleRays[lane], currentClosest[lane], triangle) : mCurrentScene.GetHit(type, typeIndex, ray, triangleRays[lane]);
+					KeepClosestHit(ray, hitData, type, typeIndex, closestHits[lane], triangle);
+				};
+			};
+
+			// Lowers the closest distance of every lane that found something closer
+			bool closer = false;
+			for (int lane = 0; lane < kPacketWidth; lane++)
+			{
+				if ((laneMask & (1 << lane)) && closestHits[lane].mDistance < currentClosest[lane])
+				{
+					currentClosest[lane] = closestHits[lane].mDistance;
+					closer = true;
+				};
+			};
+			return closer;
+		});
+	};
+	// Gets if the shape at an index (as used by Scene::GetShapeType) is in a shadow ray's way
+	// The shaded shape can't shadow itself, except meshes whose other triangles can
+	bool IsOccluder(int shapeIndex, Ray shadowRay, const TriangleRay& triangleRay, const ShapeHit& shaded) const
+	{
+		size_t typeIndex;
+		ShapeType type = mCurrentScene.GetShapeType(shapeIndex, typeIndex);
+		bool isShaded = type == shaded.mType && typeIndex == shaded.mIndex;
+
+		if (type == ShapeType::Mesh)
+		{
+			return mCurrentScene.IsMeshBlocking(typeIndex, shadowRay, triangleRay, isShaded ? shaded.mTriangle : std::numeric_limits<uint32_t>::max());
+		};
+		if (isShaded)
+		{
+			return false;
+		};
+
+		COUNT_INTERSECTION_TESTS(type, 1);
+		return mCurrentScene.GetHit(type, typeIndex, shadowRay, triangleRay).mHit;
+	};
+	// Gets if anything is between a hit point and the light, stopping at the first thing found rather than looking for the closest
+	bool IsInShadow(const ShapeHit& shaded) const
+	{
+		glm::vec3 lightDirection = glm::normalize(mCurrentScene.GetLightDirection());
+		Ray shadowRay(shaded.mHit.mFirstIntersection + lightDirection * kShadowRayOffset, lightDirection);
+		TriangleRay triangleRay = get_triangle_ray(shadowRay);
+
+		// Tries whatever blocked this thread's last shadow ray first
+		int lastOccluder = gUseOccluderCache ? gLastOccluder : -1;
+		if (lastOccluder >= 0 && lastOccluder < (int)mCurrentScene.GetShapeCount())
+		{
+			if (IsOccluder(lastOccluder, shadowRay, triangleRay, shaded))
+			{
+				return true;
+			};
+		}
+		else
+		{
+			lastOccluder = -1;
+		};
+
+		auto occludes = [&](int shapeIndex)
+		{
+			if (shapeIndex == lastOccluder || !IsOccluder(shapeIndex, shadowRay, triangleRay, shaded))
+			{
+				return false;
+			};
+
+			gLastOccluder = shapeIndex;
+			return true;
+		};
+
+		if (mAccelerationMode == AccelerationMode::BVH)
+		{
+			return mBVH.TraverseAny(shadowRay, occludes);
+		};
+		if (mAccelerationMode == AccelerationMode::Layers)
+		{
+			const std::vector<int>& otherShapes = mLayers.GetOtherShapes();
+			return mOtherBVH.TraverseAny(shadowRay, [&](int primIndex) { return occludes(otherShapes[primIndex]); }) || mLayers.TraverseAny(shadowRay, occludes);
+		};
+		if (mAccelerationMode == AccelerationMode::Grid)
+		{
+			return mGrid.TraverseAny(shadowRay, occludes);
+		};
+
+		for (int shapeIndex = 0; shapeIndex < (int)mCurrentScene.GetShapeCount(); shapeIndex++)
+		{
+			if (occludes(shapeIndex))
+			{
+				return true;
+			};
+		};
+
+		return false;
+	};
+	// Gets the colour of the closest hit, black if nothing was hit
+	// Sets the pixel hit's shape ID and shading, if one is given
+	glm::vec3 GetHitColour(const ShapeHit& closestHit, PixelHit* pixelHit) const
+	{
+		PROFILE_PHASE(ShadingNs);
+
+		if (pixelHit)
+		{
+			pixelHit->mShapeId = kMissShapeId;
+			pixelHit->mShading = 0;
+		};
+
+		// If collision detected
+		if (closestHit.mHit.mHit)
+		{
+			PROFILE_COUNT(Hits, 1);
+
+			// Gets colour modifier from closest shape
+			float colourModifier = mCurrentScene.GetColourModifier(closestHit.mType, closestHit.mIndex, closestHit.mTriangle, closestHit.mHit.mFirstIntersection);
+
+			// Points the light can't reach keep only some of their light
+			if (mShadows && IsInShadow(closestHit))
+			{
+				colourModifier *= kShadowBrightness;
+			};
+
+			if (pixelHit)
+			{
+				pixelHit->mShapeId = (uint32_t)mCurrentScene.GetShapeIndex(closestHit.mType, closestHit.mIndex) + 1;
+				pixelHit->mShading = colourModifier;
+			};
+
+			// If collision, return colour
+			return mCurrentScene.GetColour(closestHit.mType, closestHit.mIndex) * colourModifier;
+		};
+
+		// If no collision return black
+		return glm::vec3(0, 0, 0);
+	};
+	// Rebuilds the BVH after the scene's shapes have changed, and the current mode's own structure if it has one
+	void UpdateBVH()
+	{
+		BuildBVH();
+		ResetModeStructures();
+	};
+	// Builds the hierarchy over the current scene with the chosen builder, timing how long it takes
+	void BuildBVH()
+	{
+		std::chrono::steady_clock::time_point buildStart = std::chrono::steady_clock::now();
+		build_scene_bvh(mCurrentScene, mBVH, mBVHBuilder);
+		mBVHBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+		mBuiltBVHCost = mBVH.GetCost();
+	};
+	// Drops the layer index and grid, which are out of date once the shapes change, and builds whichever the current mode uses again
+	void ResetModeStructures()
+	{
+		mLayers.Clear();
+		mGrid.Clear();
+		UpdateModeStructure();
+	};
+	// Builds the layer index or grid over the current scene if its mode is in use and it isn't built yet
+	void UpdateModeStructure()
+	{
+		if (mAccelerationMode == AccelerationMode::Grid && !mGrid.IsBuilt())
+		{
+			PROFILE_SCOPE("Build grid");
+
+			mGrid.Build(get_scene_shape_bounds(mCurrentScene));
+		};
+
+		if (mAccelerationMode != AccelerationMode::Layers || mLayers.IsBuilt())
+		{
+			return;
+		};
+
+		PROFILE_SCOPE("Build layers");
+
+		mLayers.Build(mCurrentScene);
+
+		std::vector<AABB> otherBounds;
+		otherBounds.reserve(mLayers.GetOtherShapes().size());
+		for (int shapeIndex : mLayers.GetOtherShapes())
+		{
+			otherBounds.push_back(mCurrentScene.GetShapeBounds(shapeIndex));
+		};
+		mOtherBVH.Build(std::move(otherBounds), mBVHBuilder);
+	};
+	// Gets the bounds of a shape, or empty bounds if there's no shape there
+	AABB GetShapeBounds(size_t shapeIndex) const
+	{
+		return shapeIndex < mCurrentScene.GetShapeCount() ? mCurrentScene.GetShapeBounds(shapeIndex) : get_empty_aabb();
+	};
+	// Finishes adding a shape of the given type (always added last of its type) to the scene
+	SceneEdit FinishAdd(ShapeType type, size_t typeCount)
+	{
+		size_t shapeIndex = mCurrentScene.GetShapeIndex(type, typeCount - 1);
+		UpdateBVH();
+
+		return SceneEdit{ get_empty_aabb(), GetShapeBounds(shapeIndex), (uint32_t)shapeIndex + 1, 1, false };
+	};
+
+public:
+	RayTracer() : mCurrentScene(glm::vec3(1, -1, -1)), mAccelerationMode(AccelerationMode::BVH), mBVHBuilder(BVHBuilder::SAH), mBVHBuildMs(0), mBuiltBVHCost(0), mRefitCostLimit(kRefitCostLimit), mShadows(false) {};
+	~RayTracer() {};
+
+	// Gets the colour seen along the ray, and if pixelHit is given sets its shape ID and shading
+	// Shape IDs are the shape's index (see Scene::GetShapeType) plus one, or kMissShapeId if nothing was hit
+	glm::vec3 TraceRay(Ray ray, PixelHit* pixelHit = nullptr) const
+	{
+		PROFILE_COUNT(Rays, 1);
+
+		// Initialises default closest hit
+		ShapeHit closestHit{ HitData{ false, glm::vec3(0, 0, 0) }, std::numeric_limits<float>::max(), ShapeType::Sphere, 0, 0 };
+
+		// Finds the first shape along the ray
+		{
+			PROFILE_PHASE(TraversalNs);
+
+			if (mAccelerationMode == AccelerationMode::BVH)
+			{
+				GetClosestHitBVH(ray, closestHit);
+			}
+			else if (mAccelerationMode == AccelerationMode::Layers)
+			{
+				GetClosestHitLayers(ray, closestHit);
+			}
+			else if (mAccelerationMode == AccelerationMode::Grid)
+			{
+				GetClosestHitGrid(ray, closestHit);
+			}
+			else
+			{
+				GetClosestHitLinear(ray, closestHit);
+			};
+		}
+
+		return GetHitColour(closestHit, pixelHit);
+	};
+	// Traces every active ray in a packet, setting the colour of each one's lane, and its shape ID and shading (see TraceRay) if pixelHits is given
+	void TracePacket(const RayPacket& packet, glm::vec3* colours, PixelHit* pixelHits = nullptr) const
+	{
+		// Only the BVH is walked as a packet, the other modes trace each ray on its own
+		if (mAccelerationMode != AccelerationMode::BVH)
+		{
+			for (int lane = 0; lane < kPacketWidth; lane++)
+			{
+				if (packet.mActiveMask & (1 << lane))
+				{
+					colours[lane] = TraceRay(packet.GetRay(lane), pixelHits ? &pixelHits[lane] : nullptr);
+				};
+			};
+			return;
+		};
+
+		PROFILE_COUNT(Rays, get_lane_count(packet.mActiveMask));
+
+		ShapeHit closestHits[kPacketWidth];
+		for (int lane = 0; lane < kPacketWidth; lane++)
+		{
+			closestHits[lane] = ShapeHit{ HitData{ false, glm::vec3(0, 0, 0) }, std::numeric_limits<float>::max(), ShapeType::Sphere, 0, 0 };
+		};
+
+		{
+			PROFILE_PHASE(TraversalNs);
+
+			GetClosestHitsBVH(packet, closestHits);
+		}
+
+		for (int lane = 0; lane < kPacketWidth; lane++)
+		{
+			if (packet.mActiveMask & (1 << lane))
+			{
+				colours[lane] = GetHitColour(closestHits[lane], pixelHits ? &pixelHits[lane] : nullptr);
+			};
+		};
+	};
+	// Takes over the scene, which callers hand over with std::move rather than copying its shapes
+	void SetScene(Scene&& scene)
+	{
+		PROFILE_SCOPE("Set scene");
+
+		mCurrentScene = std::move(scene);
+
+		// The layer index and grid are only built over the new shapes if they're in use
+		ResetModeStructures();
+
+		// Uses the scene's own hierarchy in place when it came with one
+		const BVHNode* prebuiltNodes;
+		int prebuiltNodeCount;
+		const int* prebuiltPrimIndices;
+		if (mCurrentScene.GetPrebuiltBVH(prebuiltNodes, prebuiltNodeCount, prebuiltPrimIndices))
+		{
+			mBVH.Adopt(prebuiltNodes, prebuiltNodeCount, prebuiltPrimIndices, (int)mCurrentScene.GetShapeCount());
+			mBVHBuildMs = -1;
+			mBuiltBVHCost = mBVH.GetCost();
+			return;
+		};
+
+		// Otherwise rebuilds the hierarchy over the new shapes
+		BuildBVH();
+	};
+	// Switching to the layer or grid mode builds its structure, if it isn't already built over the current scene
+	void SetAccelerationMode(AccelerationMode mode)
+	{
+		mAccelerationMode = mode;
+		UpdateModeStructure();
+	};
+	// Switching builder rebuilds the hierarchies over the current scene with it, trading build time against trace time (see BVHBuilder)
+	void SetBVHBuilder(BVHBuilder builder)
+	{
+		if (builder != mBVHBuilder)
+		{
+			mBVHBuilder = builder;
+			UpdateBVH();
+		};
+	};
+	BVHBuilder GetBVHBuilder() const
+	{
+		return mBVHBuilder;
+	};
+	double GetBVHBuildMs() const
+	{
+		return mBVHBuildMs;
+	};
+	// Sets how many times its cost when built (see BVH::GetCost) refitting can grow the BVH's cost to before SetAnimationFrame builds it again, 0 builds it again every frame
+	void SetRefitCostLimit(float limit)
+	{
+		mRefitCostLimit = limit;
+	};
+
+	// Moves the scene's keyframed shapes to where they are at a frame of its animation (see Scene::SetAnimationFrame), refitting the BVH to them rather than building it again
+	// Only builds the BVH again once refitting has made it too slow to trace (see SetRefitCostLimit), returns true if it did
+	// GetBVHBuildMs gives how long the refit or build took, 0 if nothing moved
+	bool SetAnimationFrame(float frame)
+	{
+		PROFILE_SCOPE("Animate scene");
+
+		std::chrono::steady_clock::time_point updateStart = std::chrono::steady_clock::now();
+		if (mCurrentScene.SetAnimationFrame(frame) == 0)
+		{
+			mBVHBuildMs = 0;
+			return false;
+		};
+
+		std::vector<AABB> shapeBounds = get_scene_shape_bounds(mCurrentScene);
+		mBVH.Refit(shapeBounds);
+		bool rebuilt = mBVH.GetCost() > mBuiltBVHCost * mRefitCostLimit;
+		if (rebuilt)
+		{
+			mBVH.Build(std::move(shapeBounds), mBVHBuilder);
+			mBuiltBVHCost = mBVH.GetCost();
+		};
+		mBVHBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - updateStart).count();
+
+		// The layer index and grid can't be refitted, so are built again if in use
+		ResetModeStructures();
+
+		return rebuilt;
+	};
+	// Turns casting a shadow ray from every hit point on or off
+	void SetShadows(bool shadows)
+	{
+		mShadows = shadows;
+	};
+	bool GetShadows() const
+	{
+		return mShadows;
+	};
+	int GetBVHNodeCount() const
+	{
+		return mBVH.GetNodeCount();
+	};
+	float GetBVHCost() const
+	{
+		return mBVH.GetCost();
+	};
+	int GetLayerCount() const
+	{
+		return mLayers.GetLayerCount();
+	};
+	int GetGridCellCount() const
+	{
+		return mGrid.GetCellCount();
+	};
+	const Scene& GetScene() const
+	{
+		return mCurrentScene;
+	};
+
+	// Edits to the live scene, each keeping the BVH up to date and returning what changed so a rendered frame can be updated (see TileRenderer::UpdateFrame)
+	// Shapes are added last of their type, moving the index of every shape of a later type up by one
+	SceneEdit AddSphere(glm::vec3 centre, float radius, glm::vec3 colour)
+	{
+		mCurrentScene.AddSphere(centre, radius, colour);
+		return FinishAdd(ShapeType::Sphere, mCurrentScene.GetSpheres().size());
+	};
+	SceneEdit AddRectangle(glm::vec3 centre, float width, float height, glm::vec3 colour)
+	{
+		mCurrentScene.AddRectangle(centre, width, height, colour);
+		return FinishAdd(ShapeType::Rectangle, mCurrentScene.GetRectangles().size());
+	};
+	SceneEdit AddCircle(glm::vec3 centre, float radius, glm::vec3 colour)
+	{
+		mCurrentScene.AddCircle(centre, radius, colour);
+		return FinishAdd(ShapeType::Circle, mCurrentScene.GetCircles().size());
+	};
+	SceneEdit AddTriangle(glm::vec3 pointA, glm::vec3 pointB, glm::vec3 pointC, glm::vec3 colour)
+	{
+		mCurrentScene.AddTriangle(pointA, pointB, pointC, colour);
+		return FinishAdd(ShapeType::Triangle, mCurrentScene.GetTriangles().size());
+	};
+	SceneEdit MoveShape(size_t shapeIndex, glm::vec3 offset)
+	{
+		AABB oldBounds = GetShapeBounds(shapeIndex);
+		mCurrentScene.MoveShape(shapeIndex, offset);
+		UpdateBVH();
+
+		return SceneEdit{ oldBounds, GetShapeBounds(shapeIndex), (uint32_t)shapeIndex + 1, 0, false };
+	};
+	// Recolouring leaves the BVH as it is
+	SceneEdit SetShapeColour(size_t shapeIndex, glm::vec3 colour)
+	{
+		mCurrentScene.SetShapeColour(shapeIndex, colour);
+
+		return SceneEdit{ GetShapeBounds(shapeIndex), GetShapeBounds(shapeIndex), (uint32_t)shapeIndex + 1, 0, true };
+	};
+	// Removing a shape moves the index of every shape after it down by one
+	SceneEdit RemoveShape(size_t shapeIndex)
+	{
+		AABB oldBounds = GetShapeBounds(shapeIndex);
+		mCurrentScene.RemoveShape(shapeIndex);
+		UpdateBVH();
+
+		return SceneEdit{ oldBounds, get_empty_aabb(), (uint32_t)shapeIndex + 1, -1, false };
+	};
+};
+
+
+class Camera
+{
+private:
+	// Window and viewing variables
+	glm::ivec2 mWindowSize;
+	glm::ivec2 mWindowCentre;
+	glm::ivec2 mViewingSize;
+
+	// Used for working out ray origins and directions
+	float mXViewMultiplier;
+	float mYViewMultiplier;
+	float mXViewOffset;
+	float mYViewOffset;
+
+public:
+	Camera(glm::ivec2 windowSize, glm::ivec2 viewingSize)
+	{
+		// Getting window size, centre and viewing size
+		mWindowSize = windowSize;
+		mWindowCentre = windowSize / 2;
+		mViewingSize = viewingSize;
+
+		// Getting variables for calculating ray data
+		mXViewMultiplier = (float)mViewingSize.x / (float)mWindowSize.x;
+		mYViewMultiplier = (float)mViewingSize.y / (float)mWindowSize.y;
+		mXViewOffset = (float)(mViewingSize.x - mWindowSize.x) / 2;
+		mYViewOffset = (float)(mViewingSize.y - mWindowSize.y) / 2;
+	};
+	~Camera() {};
+
+	Ray GetRay(glm::ivec2 pixelPosition) const
+	{
+		PROFILE_PHASE(RayGenerationNs);
+
+		// Getting start and end points for reference when creating the ray
+		glm::vec3 source;
+		glm::vec3 lead;
+
+		// Getting coordinates for the ray's origin
+		source.x = (float)pixelPosition.x;
+		source.y = (float)pixelPosition.y;
+		source.z = -1.f;
+
+		// Getting coordinates for the ray's path
+		lead.x = (float)(pixelPosition.x) * mXViewMultiplier - mXViewOffset;
+		lead.y = (float)(pixelPosition.y) * mYViewMultiplier - mYViewOffset;
+		lead.z = 20.f;
+
+		// Creating ray
+		Ray ray(source, glm::normalize(lead - source));
+
+		return ray;
+	};
+	// Gets a ray from a point anywhere in the window, made the same way as GetRay, so whole numbers give the same rays as the pixels there
+	Ray GetRay(glm::vec2 position) const
+	{
+		PROFILE_PHASE(RayGenerationNs);
+
+		glm::vec3 source(position.x, position.y, -1.f);
+		glm::vec3 lead(position.x * mXViewMultiplier - mXViewOffset, position.y * mYViewMultiplier - mYViewOffset, 20.f);
+
+		return Ray(source, glm::normalize(lead - source));
+	};
+	// Gets the pixels from start up to end whose rays (or anti-aliasing samples) could pass through a box, returns false if no pixel's could
+	// Pixels are padded by a pixel or two past the box's projection, so rays that graze its sides when rounded are still counted
+	bool GetPixelBounds(const AABB& bounds, glm::ivec2& start, glm::ivec2& end) const
+	{
+		// Rays start at a depth of -1, so nothing nearer can be seen
+		if (bounds.mMin.x > bounds.mMax.x || bounds.mMax.z < -1.f)
+		{
+			return false;
+		};
+
+		glm::vec2 multiplier(mXViewMultiplier, mYViewMultiplier);
+		glm::vec2 offset(mXViewOffset, mYViewOffset);
+		glm::vec2 lowest(std::numeric_limits<float>::max());
+		glm::vec2 highest(-std::numeric_limits<float>::max());
+		bool wholeWindow = false;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 point((corner & 1) ? bounds.mMax.x : bounds.mMin.x, (corner & 2) ? bounds.mMax.y : bounds.mMin.y, std::max((corner & 4) ? bounds.mMax.z : bounds.mMin.z, -1.f));
+
+			// The ray from pixel p reaches p + t * (p * multiplier - offset - p) at a depth of -1 + t * 21, so solves that for p
+			float t = (point.z + 1.f) / 21.f;
+			glm::vec2 divisor = 1.f + t * (multiplier - 1.f);
+			if (divisor.x <= 0 || divisor.y <= 0)
+			{
+				// Past where the rays cross over, any pixel's could reach it
+				wholeWindow = true;
+				break;
+			};
+
+			glm::vec2 pixel = (glm::vec2(point) + t * offset) / divisor;
+			lowest = glm::min(lowest, pixel);
+			highest = glm::max(highest, pixel);
+		};
+
+		if (wholeWindow)
+		{
+			start = glm::ivec2(0, 0);
+			end = mWindowSize;
+			return true;
+		};
+
+		// Samples lie anywhere up to a pixel past the pixel's own position
+		start = glm::max(glm::ivec2(glm::floor(lowest)) - 1, 0);
+		end = glm::min(glm::ivec2(glm::ceil(highest)) + 2, mWindowSize);
+		return start.x < end.x && start.y < end.y;
+	};
+	// Gets the rays of a kPacketSizeX by kPacketSizeY block of pixels starting at firstPixel, lane i being pixel (i % kPacketSizeX, i / kPacketSizeX) of the block
+	// Pixels at or past endPixel are left out of the packet's active lanes
+	// Each ray is made exactly as GetRay makes it, only a step at a time across the whole block
+	void GetRayPacket(glm::ivec2 firstPixel, glm::ivec2 endPixel, RayPacket& packet) const
+	{
+		PROFILE_PHASE(RayGenerationNs);
+
+		packet.mActiveMask = 0;
+
+		// Gets the same origins and directions towards the same lead points
+		for (int lane = 0; lane < kPacketWidth; lane++)
+		{
+			int x = firstPixel.x + lane % kPacketSizeX;
+			int y = firstPixel.y + lane / kPacketSizeX;
+
+			packet.mOriginX[lane] = (float)x;
+			packet.mOriginY[lane] = (float)y;
+			packet.mOriginZ[lane] = -1.f;
+			packet.mDirectionX[lane] = ((float)x * mXViewMultiplier - mXViewOffset) - packet.mOriginX[lane];
+			packet.mDirectionY[lane] = ((float)y * mYViewMultiplier - mYViewOffset) - packet.mOriginY[lane];
+			packet.mDirectionZ[lane] = 20.f - packet.mOriginZ[lane];
+
+			if (x < endPixel.x && y < endPixel.y)
+			{
+				packet.mActiveMask |= 1 << lane;
+			};
+		};
+
+		// Normalises the directions the way glm::normalize does
+		for (int lane = 0; lane < kPacketWidth; lane++)
+		{
+			float x = packet.mDirectionX[lane], y = packet.mDirectionY[lane], z = packet.mDirectionZ[lane];
+			float inverseLength = 1.0f / std::sqrt(x * x + y * y + z * z);
+
+			packet.mDirectionX[lane] = x * inverseLength;
+			packet.mDirectionY[lane] = y * inverseLength;
+			packet.mDirectionZ[lane] = z * inverseLength;
+		};
+
+		// Gets what the box tests need
+		for (int lane = 0; lane < kPacketWidth; lane++)
+		{
+			glm::vec3 direction(packet.mDirectionX[lane], packet.mDirectionY[lane], packet.mDirectionZ[lane]);
+			glm::vec3 inverseDirection = get_safe_inverse_direction(direction);
+
+			packet.mInverseDirectionX[lane] = inverseDirection.x;
+			packet.mInverseDirectionY[lane] = inverseDirection.y;
+			packet.mInverseDirectionZ[lane] = inverseDirection.z;
+			packet.mDirectionLength[lane] = glm::length(direction);
+		};
+	};
+};
+
+
+// Fixed set of worker threads that share out batches of tasks
+// Each worker owns a queue of task indices, takes from the front of its own and steals from the back of others when it runs dry
+class WorkerPool
+{
+private:
+	// A worker's pending tasks
+	struct WorkQueue
+	{
+		std::mutex mMutex;
+		std::deque<int> mTasks;
+	};
+
+	std::vector<std::thread> mThreads;
+	std::vector<std::unique_ptr<WorkQueue>> mQueues;
+
+	// Stores the current batch's task function, called as task(taskIndex, workerIndex)
+	std::function<void(int, int)> mTask;
+
+	// Used to wake workers for a new batch and to wait for them to finish it
+	std::mutex mMutex;
+	std::condition_variable mWorkReady;
+	std::condition_variable mWorkDone;
+	int mBatch;
+	int mBusyWorkers;
+	bool mStopping;
+
+	// Takes the next task from the worker's own queue
+	bool PopTask(int workerIndex, int& task)
+	{
+		WorkQueue& queue = *mQueues[workerIndex];
+		std::lock_guard<std::mutex> lock(queue.mMutex);
+
+		if (queue.mTasks.empty())
+		{
+			return false;
+		};
+
+		task = queue.mTasks.front();
+		queue.mTasks.pop_front();
+		return true;
+	};
+	// Takes the last task from another worker's queue
+	bool StealTask(int workerIndex, int& task)
+	{
+		int workerCount = (int)mQueues.size();
+
+		for (int offset = 1; offset < workerCount; offset++)
+		{
+			WorkQueue& queue = *mQueues[(workerIndex + offset) % workerCount];
+			std::lock_guard<std::mutex> lock(queue.mMutex);
+
+			if (!queue.mTasks.empty())
+			{
+				task = queue.mTasks.back();
+				queue.mTasks.pop_back();
+				return true;
+			};
+		};
+
+		return false;
+	};
+	void WorkerLoop(int workerIndex)
+	{
+		int lastBatch = 0;
+
+		while (true)
+		{
+			// Waits for a new batch (or shutdown)
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mWorkReady.wait(lock, [&] { return mStopping || mBatch != lastBatch; });
+
+				if (mStopping)
+				{
+					return;
+				};
+				lastBatch = mBatch;
+			}
+
+			// Works until there is nothing left to take anywhere
+			int task;
+			while (PopTask(workerIndex, task) || StealTask(workerIndex, task))
+			{
+				mTask(task, workerIndex);
+			};
+
+			// Lets Run return once every worker is idle
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				if (--mBusyWorkers == 0)
+				{
+					mWorkDone.notify_all();
+				};
+			}
+		};
+	};
+
+public:
+	WorkerPool(int threadCount) : mBatch(0), mBusyWorkers(0), mStopping(false)
+	{
+		threadCount = std::max(threadCount, 1);
+
+		for (int i = 0; i < threadCount; i++)
+		{
+			mQueues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+		};
+		for (int i = 0; i < threadCount; i++)
+		{
+			mThreads.push_back(std::thread(&WorkerPool::WorkerLoop, this, i));
+		};
+	};
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStopping = true;
+		}
+		mWorkReady.notify_all();
+
+		for (std::thread& thread : mThreads)
+		{
+			thread.join();
+		};
+	};
+
+	// Runs task(taskIndex, workerIndex) for every index below taskCount and waits for all of them to finish
+	// Neighbouring indices are dealt to the same worker so they are usually processed together
+	void Run(int taskCount, std::function<void(int, int)> task)
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+
+		// Deals out contiguous runs of tasks, workers are all idle so the queues can be filled freely
+		int workerCount = (int)mQueues.size();
+		for (int i = 0; i < workerCount; i++)
+		{
+			int first = (int)((long long)taskCount * i / workerCount);
+			int last = (int)((long long)taskCount * (i + 1) / workerCount);
+
+			for (int taskIndex = first; taskIndex < last; taskIndex++)
+			{
+				mQueues[i]->mTasks.push_back(taskIndex);
+			};
+		};
+
+		// Wakes the workers and waits for them to empty every queue
+		mTask = task;
+		mBusyWorkers = workerCount;
+		mBatch++;
+		mWorkReady.notify_all();
+		mWorkDone.wait(lock, [&] { return mBusyWorkers == 0; });
+	};
+
+	int GetThreadCount() const
+	{
+		return (int)mThreads.size();
+	};
+};
+
+
+// Block sizes of each pass of a progressive render (see TileRenderer::RenderProgressive), coarsest first, the last traces every pixel
+const int kProgressivePassCount = 3;
+const int kProgressiveBlockSizes[kProgressivePassCount] = { 8, 4, 1 };
+// Time between showing previews of a progressive render
+const int kPreviewIntervalMs = 33;
+// Difference between neighbouring pixels' colours (in the channel they differ most, from 0 to 1) that makes them an edge worth anti-aliasing
+const float kAntiAliasingContrast = 0.1f;
+
+
+// Renders frames by splitting them into square tiles which are traced on a worker pool
+class TileRenderer
+{
+private:
+	WorkerPool mWorkers;
+	// Stores the width and height of each tile in pixels
+	int mTileSize;
+	// Stores if tiles are traced a ray packet at a time rather than a ray at a time
+	bool mUsePackets;
+	// Stores the width of the grid anti-aliasing samples pixels on (1 when it is off), and if it samples every pixel rather than only edges
+	int mSampleGridSize;
+	bool mSupersampleAll;
+	// Stores what each pixel's ray hit in the last frame, and which pixels are edges, for anti-aliasing it and updating it after scene edits
+	std::vector<PixelHit> mPixelHits;
+	std::vector<uint8_t> mEdges;
+	// Stores if the last frame was finished (so it can be updated by UpdateFrame) and its size
+	bool mFrameValid;
+	glm::ivec2 mFrameSize;
+	// Stores how many rays the last frame traced
+	std::atomic<long long> mRayCount;
+	// Stores the pass RenderProgressive is drawing, and the last one it finished along with how many it has finished
+	// Finished passes are swapped in under the lock, so another thread can copy one out while the next is being drawn
+	std::vector<uint32_t> mPassBuffer;
+	std::vector<uint32_t> mFinishedPassBuffer;
+	int mFinishedPassCount;
+	mutable std::mutex mFinishedPassMutex;
+
+	// Gets how many tiles a rectangle of the window is split into
+	int GetTileCount(glm::ivec2 rectStart, glm::ivec2 rectEnd) const
+	{
+		return ((rectEnd.x - rectStart.x + mTileSize - 1) / mTileSize) * ((rectEnd.y - rectStart.y + mTileSize - 1) / mTileSize);
+	};
+	// Gets the pixel range of one of the tiles a rectangle of the window is split into, clipped to the rectangle
+	void GetTilePixels(int tileIndex, glm::ivec2 rectStart, glm::ivec2 rectEnd, glm::ivec2& start, glm::ivec2& end) const
+	{
+		int tilesX = (rectEnd.x - rectStart.x + mTileSize - 1) / mTileSize;
+
+		start = rectStart + glm::ivec2((tileIndex % tilesX) * mTileSize, (tileIndex / tilesX) * mTileSize);
+		end = glm::min(start + glm::ivec2(mTileSize, mTileSize), rectEnd);
+	};
+	// Averages jittered samples spread over a pixel (see get_sample_offset), adding how many were traced to rayCount
+	// Only the first four, one in each quarter of the pixel, are taken unless they hit different shapes or contrast
+	glm::vec3 GetSupersampledColour(const Camera& camera, const RayTracer& rayTracer, glm::ivec2 pixel, glm::ivec2 windowSize, long long& rayCount) const
+	{
+		// Each pixel has its own generator, so its samples land in the same places whichever order pixels are traced in
+		std::minstd_rand generator((uint32_t)(pixel.y * windowSize.x + pixel.x) + 1);
+		std::uniform_real_distribution<float> jitterDistribution(0.0f, 1.0f);
+
+		int sampleCount = mSampleGridSize * mSampleGridSize;
+		glm::vec3 total(0, 0, 0);
+		glm::vec3 lowest(1, 1, 1);
+		glm::vec3 highest(0, 0, 0);
+		uint32_t firstShapeId = kMissShapeId;
+		bool sameShape = true;
+		for (int sample = 0; sample < sampleCount; sample++)
+		{
+			float jitterX = jitterDistribution(generator);
+			float jitterY = jitterDistribution(generator);
+			glm::vec2 position = glm::vec2(pixel) + get_sample_offset(sample, mSampleGridSize, glm::vec2(jitterX, jitterY));
+
+			PixelHit sampleHit;
+			glm::vec3 colour = glm::clamp(rayTracer.TraceRay(camera.GetRay(position), &sampleHit), 0.0f, 1.0f);
+			total += colour;
+			lowest = glm::min(lowest, colour);
+			highest = glm::max(highest, colour);
+			firstShapeId = sample == 0 ? sampleHit.mShapeId : firstShapeId;
+			sameShape = sameShape && sampleHit.mShapeId == firstShapeId;
+
+			// Stops after the first four if they agree
+			glm::vec3 contrast = highest - lowest;
+			if (sample == 3 && !mSupersampleAll && sameShape && std::max(std::max(contrast.x, contrast.y), contrast.z) <= kAntiAliasingContrast)
+			{
+				sampleCount = 4;
+				break;
+			};
+		};
+
+		rayCount += sampleCount;
+		return total / (float)sampleCount;
+	};
+	// Traces a ray for every pixel from rectStart up to rectEnd, recording what each hit in mPixelHits
+	// Workers only write their own tiles' pixels, so the framebuffer needs no locking
+	void TraceRect(const Camera& camera, const RayTracer& rayTracer, glm::ivec2 windowSize, uint32_t* framebuffer, glm::ivec2 rectStart, glm::ivec2 rectEnd, const std::atomic<bool>* cancelled)
+	{
+		PixelHit* pixelHits = mPixelHits.data();
+
+		mWorkers.Run(GetTileCount(rectStart, rectEnd), [&](int tileIndex, int /*workerIndex*/)
+		{
+			if (cancelled && *cancelled)
+			{
+				return;
+			};
+
+			PROFILE_SCOPE("Tile");
+
+			glm::ivec2 start, end;
+			GetTilePixels(tileIndex, rectStart, rectEnd, start, end);
+
+			if (mUsePackets)
+			{
+				// Traces a block of pixels at a time, blocks hanging off the tile only trace their pixels inside it
+				RayPacket packet;
+				glm::vec3 colours[kPacketWidth];
+				PixelHit laneHits[kPacketWidth];
+				for (int y = start.y; y < end.y; y += kPacketSizeY)
+				{
+					for (int x = start.x; x < end.x; x += kPacketSizeX)
+					{
+						camera.GetRayPacket(glm::ivec2(x, y), end, packet);
+						rayTracer.TracePacket(packet, colours, laneHits);
+
+						for (int lane = 0; lane < kPacketWidth; lane++)
+						{
+							if (packet.mActiveMask & (1 << lane))
+							{
+								int pixel = (y + lane / kPacketSizeX) * windowSize.x + x + lane % kPacketSizeX;
+								pixelHits[pixel] = laneHits[lane];
+								pixelHits[pixel].mColour = framebuffer[pixel] = MCG::PackColour(colours[lane]);
+							};
+						};
+					};
+				};
+				return;
+			};
+
+			for (int y = start.y; y < end.y; y++)
+			{
+				for (int x = start.x; x < end.x; x++)
+				{
+					// Creates ray using pixel position and gets its colour
+					PixelHit& pixelHit = pixelHits[y * windowSize.x + x];
+					pixelHit.mColour = framebuffer[y * windowSize.x + x] = MCG::PackColour(rayTracer.TraceRay(camera.GetRay(glm::ivec2(x, y)), &pixelHit));
+				};
+			};
+		});
+
+		mRayCount += (long long)(rectEnd.x - rectStart.x) * (rectEnd.y - rectStart.y);
+	};
+	// Anti-aliases the pixels from rectStart up to rectEnd of a traced frame, supersampling the pixels that hit a different shape to a neighbour or contrast with one
+	// Every other pixel in the rectangle gets its traced colour back, in case it was an edge before a scene edit
+	void AntiAlias(const Camera& camera, const RayTracer& rayTracer, glm::ivec2 windowSize, uint32_t* framebuffer, glm::ivec2 rectStart, glm::ivec2 rectEnd, const std::atomic<bool>* cancelled)
+	{
+		int tileCount = GetTileCount(rectStart, rectEnd);
+
+		// Finds every edge from the traced pixels, which pixels being supersampled don't change
+		mWorkers.Run(tileCount, [&](int tileIndex, int /*workerIndex*/)
+		{
+			glm::ivec2 start, end;
+			GetTilePixels(tileIndex, rectStart, rectEnd, start, end);
+
+			const glm::ivec2 neighbourOffsets[4] = { glm::ivec2(-1, 0), glm::ivec2(1, 0), glm::ivec2(0, -1), glm::ivec2(0, 1) };
+			for (int y = start.y; y < end.y; y++)
+			{
+				for (int x = start.x; x < end.x; x++)
+				{
+					const PixelHit& pixelHit = mPixelHits[y * windowSize.x + x];
+					bool edge = mSupersampleAll;
+					for (int i = 0; i < 4 && !edge; i++)
+					{
+						glm::ivec2 neighbour = glm::ivec2(x, y) + neighbourOffsets[i];
+						if (neighbour.x < 0 || neighbour.y < 0 || neighbour.x >= windowSize.x || neighbour.y >= windowSize.y)
+						{
+							continue;
+						};
+
+						const PixelHit& neighbourHit = mPixelHits[neighbour.y * windowSize.x + neighbour.x];
+						edge = pixelHit.mShapeId != neighbourHit.mShapeId || get_colour_contrast(pixelHit.mColour, neighbourHit.mColour) > kAntiAliasingContrast;
+					};
+					mEdges[y * windowSize.x + x] = edge;
+				};
+			};
+		});
+
+		mWorkers.Run(tileCount, [&](int tileIndex, int /*workerIndex*/)
+		{
+			if (cancelled && *cancelled)
+			{
+				return;
+			};
+
+			PROFILE_SCOPE("Anti-alias tile");
+
+			glm::ivec2 start, end;
+			GetTilePixels(tileIndex, rectStart, rectEnd, start, end);
+
+			long long rayCount = 0;
+			for (int y = start.y; y < end.y; y++)
+			{
+				for (int x = start.x; x < end.x; x++)
+				{
+					int pixel = y * windowSize.x + x;
+					framebuffer[pixel] = mEdges[pixel] ? MCG::PackColour(GetSupersampledColour(camera, rayTracer, glm::ivec2(x, y), windowSize, rayCount)) : mPixelHits[pixel].mColour;
+				};
+			};
+			mRayCount += rayCount;
+		});
+	};
+
+public:
+	TileRenderer(int threadCount, int tileSize = 16) : mWorkers(threadCount), mRayCount(0), mFinishedPassCount(0)
+	{
+		mTileSize = tileSize;
+		mUsePackets = true;
+		mSampleGridSize = 1;
+		mSupersampleAll = false;
+		mFrameValid = false;
+		mFrameSize = glm::ivec2(0, 0);
+	};
+	~TileRenderer() {};
+
+	// Traces every pixel into a packed RGBA8 framebuffer (row-major, windowSize.x wide, see MCG::GetFramebuffer)
+	// Workers only write their own tiles' pixels, so the framebuffer needs no locking
+	// A blockSize above 1 makes a quick preview instead, tracing one pixel per blockSize square block and filling the block with it
+	// Frames (but not previews) are then anti-aliased if it has been turned on with SetAntiAliasing
+	// Tiles not yet started are skipped once cancelled is set, leaving their pixels as they were
+	void Render(const Camera& camera, const RayTracer& rayTracer, glm::ivec2 windowSize, uint32_t* framebuffer, int blockSize = 1, const std::atomic<bool>* cancelled = nullptr)
+	{
+		PROFILE_SCOPE(blockSize > 1 ? "Preview frame" : "Frame");
+
+		// Only finished frames can be updated after scene edits
+		mFrameValid = false;
+
+		if (blockSize > 1)
+		{
+			mWorkers.Run(GetTileCount(glm::ivec2(0, 0), windowSize), [&](int tileIndex, int /*workerIndex*/)
+			{
+				if (cancelled && *cancelled)
+				{
+					return;
+				};
+
+				PROFILE_SCOPE("Tile");
+
+				// Gets the tile's pixel range, clipped to the window
+				glm::ivec2 start, end;
+				GetTilePixels(tileIndex, glm::ivec2(0, 0), windowSize, start, end);
+
+				// Blocks start at the tile's corner and are clipped to it, so they line up across the window when the tile size is a multiple of the block size
+				for (int y = start.y; y < end.y; y += blockSize)
+				{
+					for (int x = start.x; x < end.x; x += blockSize)
+					{
+						uint32_t colour = MCG::PackColour(rayTracer.TraceRay(camera.GetRay(glm::ivec2(x, y))));
+
+						int blockEndX = std::min(x + blockSize, end.x);
+						int blockEndY = std::min(y + blockSize, end.y);
+						for (int blockY = y; blockY < blockEndY; blockY++)
+						{
+							std::fill(framebuffer + blockY * windowSize.x + x, framebuffer + blockY * windowSize.x + blockEndX, colour);
+						};
+					};
+				};
+			});
+
+			mRayCount = ((long long)(windowSize.x + blockSize - 1) / blockSize) * ((windowSize.y + blockSize - 1) / blockSize);
+			return;
+		};
+
+		mPixelHits.resize((size_t)windowSize.x * windowSize.y);
+		mRayCount = 0;
+		TraceRect(camera, rayTracer, windowSize, framebuffer, glm::ivec2(0, 0), windowSize, cancelled);
+
+		if (mSampleGridSize > 1 && !(cancelled && *cancelled))
+		{
+			mEdges.resize((size_t)windowSize.x * windowSize.y);
+			AntiAlias(camera, rayTracer, windowSize, framebuffer, glm::ivec2(0, 0), windowSize, cancelled);
+		};
+
+		mFrameValid = !(cancelled && *cancelled);
+		mFrameSize = windowSize;
+	};
+	// Brings the frame Render last drew up to date after an edit to the ray tracer's scene, retracing only the pixels whose rays could pass through the shape's bounds before or after the edit
+	// Recolouring traces nothing, the shape's pixels are shaded again from what their rays hit, only edges around them being supersampled again
+	// The camera has to be the one the frame was drawn with, edits have to be passed on one at a time in the order they were made
+	// Renders the whole frame instead if there's no finished frame of the same size to update, or shadows are on, as then a shape can change pixels anywhere
+	void UpdateFrame(const Camera& camera, const RayTracer& rayTracer, glm::ivec2 windowSize, uint32_t* framebuffer, const SceneEdit& edit)
+	{
+		if (!mFrameValid || windowSize != mFrameSize || rayTracer.GetShadows())
+		{
+			Render(camera, rayTracer, windowSize, framebuffer);
+			return;
+		};
+
+		PROFILE_SCOPE("Frame update");
+
+		mRayCount = 0;
+
+		// Keeps the IDs of shapes after an added or removed one matching their new indices, the removed shape's own pixels are all retraced below
+		if (edit.mIdShift != 0)
+		{
+			for (PixelHit& pixelHit : mPixelHits)
+			{
+				if (pixelHit.mShapeId > edit.mShapeId || (pixelHit.mShapeId == edit.mShapeId && edit.mIdShift > 0))
+				{
+					pixelHit.mShapeId += edit.mIdShift;
+				};
+			};
+		};
+
+		// Gets the pixels that could see the shape before and after the edit, as one rectangle if they overlap
+		glm::ivec2 rectStarts[2], rectEnds[2];
+		int rectCount = 0;
+		glm::ivec2 start, end;
+		if (camera.GetPixelBounds(edit.mOldBounds, start, end))
+		{
+			rectStarts[rectCount] = start;
+			rectEnds[rectCount++] = end;
+		};
+		if (camera.GetPixelBounds(edit.mNewBounds, start, end))
+		{
+			if (rectCount == 1 && glm::all(glm::lessThan(start, rectEnds[0])) && glm::all(glm::lessThan(rectStarts[0], end)))
+			{
+				rectStarts[0] = glm::min(rectStarts[0], start);
+				rectEnds[0] = glm::max(rectEnds[0], end);
+			}
+			else
+			{
+				rectStarts[rectCount] = start;
+				rectEnds[rectCount++] = end;
+			};
+		};
+
+		if (edit.mRecoloured)
+		{
+			// Shades the shape's pixels again, the same way RayTracer::GetHitColour does
+			size_t typeIndex;
+			ShapeType type = rayTracer.GetScene().GetShapeType(edit.mShapeId - 1, typeIndex);
+			glm::vec3 colour = rayTracer.GetScene().GetColour(type, typeIndex);
+			for (int i = 0; i < rectCount; i++)
+			{
+				for (int y = rectStarts[i].y; y < rectEnds[i].y; y++)
+				{
+					for (int x = rectStarts[i].x; x < rectEnds[i].x; x++)
+					{
+						PixelHit& pixelHit = mPixelHits[y * windowSize.x + x];
+						if (pixelHit.mShapeId == edit.mShapeId)
+						{
+							pixelHit.mColour = framebuffer[y * windowSize.x + x] = MCG::PackColour(colour * pixelHit.mShading);
+						};
+					};
+				};
+			};
+		}
+		else
+		{
+			for (int i = 0; i < rectCount; i++)
+			{
+				TraceRect(camera, rayTracer, windowSize, framebuffer, rectStarts[i], rectEnds[i], nullptr);
+			};
+		};
+
+		// Pixels next to changed ones can become or stop being edges too
+		if (mSampleGridSize > 1)
+		{
+			for (int i = 0; i < rectCount; i++)
+			{
+				AntiAlias(camera, rayTracer, windowSize, framebuffer, glm::max(rectStarts[i] - 1, 0), glm::min(rectEnds[i] + 1, windowSize), nullptr);
+			};
+		};
+	};
+	// Renders a frame a pass at a time with the block sizes in kProgressiveBlockSizes, so there is a usable preview long before the frame is done
+	// Passes are drawn into the renderer's own buffers, another thread can show each one as it finishes with CopyFinishedPass
+	// Stops early once cancelled is set, without finishing the pass it was on
+	void RenderProgressive(const Camera& camera, const RayTracer& rayTracer, glm::ivec2 windowSize, const std::atomic<bool>& cancelled)
+	{
+		size_t pixelCount = (size_t)windowSize.x * windowSize.y;
+		mPassBuffer.resize(pixelCount);
+		{
+			std::lock_guard<std::mutex> lock(mFinishedPassMutex);
+			mFinishedPassBuffer.resize(pixelCount);
+			mFinishedPassCount = 0;
+		}
+
+		for (int pass = 0; pass < kProgressivePassCount; pass++)
+		{
+			Render(camera, rayTracer, windowSize, mPassBuffer.data(), kProgressiveBlockSizes[pass], &cancelled);
+			if (cancelled)
+			{
+				return;
+			};
+
+			std::lock_guard<std::mutex> lock(mFinishedPassMutex);
+			mPassBuffer.swap(mFinishedPassBuffer);
+			mFinishedPassCount++;
+		};
+	};
+	// Copies the last pass RenderProgressive finished into framebuffer if more than shownPasses have finished, returning how many have
+	// Safe to call from another thread while RenderProgressive runs
+	int CopyFinishedPass(uint32_t* framebuffer, int shownPasses) const
+	{
+		std::lock_guard<std::mutex> lock(mFinishedPassMutex);
+		if (mFinishedPassCount > shownPasses)
+		{
+			std::copy(mFinishedPassBuffer.begin(), mFinishedPassBuffer.end(), framebuffer);
+		};
+
+		return mFinishedPassCount;
+	};
+
+	void SetPacketTracing(bool usePackets)
+	{
+		mUsePackets = usePackets;
+	};
+	// Turns on adaptive anti-aliasing, taking up to maxSamples jittered samples in pixels on edges (or in every pixel if supersampleAll is set)
+	// Samples are taken on a square grid a power of two wide, so maxSamples is rounded down to 4, 16, 64 and so on, below 4 turns it off
+	void SetAntiAliasing(int maxSamples, bool supersampleAll = false)
+	{
+		mSampleGridSize = 1;
+		while ((mSampleGridSize * 2) * (mSampleGridSize * 2) <= maxSamples)
+		{
+			mSampleGridSize *= 2;
+		};
+		mSupersampleAll = supersampleAll;
+		mFrameValid = false;
+	};
+	int GetThreadCount() const
+	{
+		return mWorkers.GetThreadCount();
+	};
+	// Gets how many rays the last call to Render or UpdateFrame traced, including anti-aliasing samples
+	long long GetRayCount() const
+	{
+		return mRayCount;
+	};
+};
+
+
+// Reads a scene file held in memory in a single pass, without splitting it into lines or words first
+// Each line holds one directive followed by its numbers, separated by spaces or tabs. Blank lines and lines starting with # are ignored.
+//   light <x> <y> <z>
+//   window <width> <height>
+//   viewing <width> <height>
+//   sphere <x> <y> <z> <radius> <r> <g> <b>
+//   rectangle <x> <y> <z> <width> <height> <r> <g> <b>
+//   circle <x> <y> <z> <radius> <r> <g> <b>
+//   triangle <z> <ax> <ay> <bx> <by> <cx> <cy> <r> <g> <b>
+//   triangle3d <ax> <ay> <az> <bx> <by> <bz> <cx> <cy> <cz> <r> <g> <b>
+//   mesh <path.obj> <x> <y> <z> <size> <r> <g> <b>
+//   instance <mesh> <m00> <m01> <m02> <m03> <m10> <m11> <m12> <m13> <m20> <m21> <m22> <m23> <r> <g> <b>
+//   key <frame> <x> <y> <z>
+// Colours range from 0 to 255, like the shape menu
+// Meshes are loaded from OBJ files (paths are relative to the scene file), centred on x y z and scaled so their longest side is size long
+// Instances reuse the mesh numbered mesh (counting the meshes and instances above from 0) without loading it again, moved by the 3x4 matrix m given row by row (see Scene::AddMeshInstance)
+// Keys keyframe the sphere, rectangle, circle or triangle above them, moving it by x y z from where it was added at that frame (see Scene::AddKeyframe)
+class SceneFileParser
+{
+private:
+	// Stores the file text, which must end with a null character
+	const char* mCursor;
+	// Stores the file name and current line for error messages
+	std::string mPath;
+	int mLine;
+
+	// Prints an error pointing at the current line
+	bool Fail(std::string message)
+	{
+		std::cout << mPath << ":" << mLine << ": " << message << std::endl;
+		return false;
+	};
+	void SkipSpaces()
+	{
+		while (*mCursor == ' ' || *mCursor == '\t' || *mCursor == '\r')
+		{
+			mCursor++;
+		};
+	};
+	// Moves past the end of the current line
+	void SkipLine()
+	{
+		while (*mCursor != '\n' && *mCursor != '\0')
+		{
+			mCursor++;
+		};
+		if (*mCursor == '\n')
+		{
+			mCursor++;
+			mLine++;
+		};
+	};
+	// Checks nothing but spaces or a comment is left on the line
+	bool AtLineEnd()
+	{
+		SkipSpaces();
+		return *mCursor == '\n' || *mCursor == '\0' || *mCursor == '#';
+	};
+	// Reads a decimal number such as 12, -0.5 or 1e-3
+	bool ReadFloat(float& value)
+	{
+		SkipSpaces();
+		const char* cursor = read_decimal(mCursor, value);
+
+		// Numbers have to be separated by spaces
+		if (!cursor || (*cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n' && *cursor != '\0' && *cursor != '#'))
+		{
+			return false;
+		};
+
+		mCursor = cursor;
+		return true;
+	};
+	// Reads a word that isn't a number, such as a file path (which can't have spaces in it)
+	bool ReadWord(std::string& word)
+	{
+		SkipSpaces();
+		const char* wordEnd = mCursor;
+		while (*wordEnd != ' ' && *wordEnd != '\t' && *wordEnd != '\r' && *wordEnd != '\n' && *wordEnd != '\0')
+		{
+			wordEnd++;
+		};
+		if (wordEnd == mCursor)
+		{
+			return false;
+		};
+
+		word.assign(mCursor, wordEnd);
+		mCursor = wordEnd;
+		return true;
+	};
+	// Reads a fixed number of floats, failing with a message naming the directive
+	bool ReadFloats(float* values, int count, const char* directive)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			if (!ReadFloat(values[i]))
+			{
+				return Fail(std::string("expected ") + std::to_string(count) + " numbers after '" + directive + "'");
+			};
+		};
+
+		if (!AtLineEnd())
+		{
+			return Fail(std::string("too many values after '") + directive + "'");
+		};
+
+		return true;
+	};
+	// Checks if the word at the cursor is the given directive, moving past it if so
+	bool ReadDirective(const char* directive)
+	{
+		size_t length = std::char_traits<char>::length(directive);
+
+		if (std::char_traits<char>::compare(mCursor, directive, length) != 0)
+		{
+			return false;
+		};
+		char next = mCursor[length];
+		if (next != ' ' && next != '\t')
+		{
+			return false;
+		};
+
+		mCursor += length;
+		return true;
+	};
+	// Counts the shapes of each type in the file (indexed by ShapeType) without reading their values, leaving the cursor where it was
+	void CountShapes(size_t counts[kShapeTypeCount])
+	{
+		const char* start = mCursor;
+		const char* directives[] = { "sphere", "rectangle", "circle", "triangle", "mesh", "triangle3d", "instance" };
+		const ShapeType directiveTypes[] = { ShapeType::Sphere, ShapeType::Rectangle, ShapeType::Circle, ShapeType::Triangle, ShapeType::Mesh, ShapeType::Triangle, ShapeType::Mesh };
+
+		while (mCursor)
+		{
+			SkipSpaces();
+			for (int i = 0; i < 7; i++)
+			{
+				if (ReadDirective(directives[i]))
+				{
+					counts[(int)directiveTypes[i]]++;
+					break;
+				};
+			};
+
+			// Jumps straight to the next line rather than stepping through this one
+			mCursor = std::strchr(mCursor, '\n');
+			if (mCursor)
+			{
+				mCursor++;
+			};
+		};
+
+		mCursor = start;
+	};
+
+public:
+	SceneFileParser(const char* text, std::string path)
+	{
+		mCursor = text;
+		mPath = path;
+		mLine = 1;
+	};
+	~SceneFileParser() {};
+
+	// Adds every shape in the file to the scene and reads any settings into the given variables
+	// Returns false (after printing where) if the file has a mistake in it
+	bool Parse(Scene& scene, glm::ivec2& windowSize, glm::ivec2& viewingSize)
+	{
+		float values[16];
+
+		// Stores the type and index of the shape added last, which keys apply to, while it is one that can be keyframed
+		ShapeType keyedType = ShapeType::Mesh;
+		size_t keyedIndex = 0;
+
+		// Counts the shapes first so the scene can store them all in one allocation
+		size_t shapeCounts[kShapeTypeCount] = {};
+		CountShapes(shapeCounts);
+		scene.ReserveShapes(shapeCounts);
+
+		while (*mCursor != '\0')
+		{
+			// Skips blank lines and comments
+			if (AtLineEnd())
+			{
+				SkipLine();
+				continue;
+			};
+
+			// Directives are checked roughly in order of how common they are in big scenes
+			if (ReadDirective("sphere"))
+			{
+				if (!ReadFloats(values, 7, "sphere"))
+				{
+					return false;
+				};
+				scene.AddSphere(glm::vec3(values[0], values[1], values[2]), values[3], glm::vec3(values[4], values[5], values[6]) / 255.0f);
+				keyedType = ShapeType::Sphere;
+				keyedIndex = scene.GetSpheres().size() - 1;
+			}
+			else if (ReadDirective("triangle"))
+			{
+				if (!ReadFloats(values, 10, "triangle"))
+				{
+					return false;
+				};
+				scene.AddTriangle(values[0], glm::vec2(values[1], values[2]), glm::vec2(values[3], values[4]), glm::vec2(values[5], values[6]), glm::vec3(values[7], values[8], values[9]) / 255.0f);
+				keyedType = ShapeType::Triangle;
+				keyedIndex = scene.GetTriangles().size() - 1;
+			}
+			else if (ReadDirective("triangle3d"))
+			{
+				if (!ReadFloats(values, 12, "triangle3d"))
+				{
+					return false;
+				};
+				scene.AddTriangle(glm::vec3(values[0], values[1], values[2]), glm::vec3(values[3], values[4], values[5]), glm::vec3(values[6], values[7], values[8]), glm::vec3(values[9], values[10], values[11]) / 255.0f);
+				keyedType = ShapeType::Triangle;
+				keyedIndex = scene.GetTriangles().size() - 1;
+			}
+			else if (ReadDirective("rectangle"))
+			{
+				if (!ReadFloats(values, 8, "rectangle"))
+				{
+					return false;
+				};
+				scene.AddRectangle(glm::vec3(values[0], values[1], values[2]), values[3], values[4], glm::vec3(values[5], values[6], values[7]) / 255.0f);
+				keyedType = ShapeType::Rectangle;
+				keyedIndex = scene.GetRectangles().size() - 1;
+			}
+			else if (ReadDirective("circle"))
+			{
+				if (!ReadFloats(values, 7, "circle"))
+				{
+					return false;
+				};
+				scene.AddCircle(glm::vec3(values[0], values[1], values[2]), values[3], glm::vec3(values[4], values[5], values[6]) / 255.0f);
+				keyedType = ShapeType::Circle;
+				keyedIndex = scene.GetCircles().size() - 1;
+			}
+			else if (ReadDirective("mesh"))
+			{
+				std::string meshPath;
+				if (!ReadWord(meshPath))
+				{
+					return Fail("expected an OBJ file after 'mesh'");
+				};
+				if (!ReadFloats(values, 7, "mesh"))
+				{
+					return false;
+				};
+
+				// Relative paths start from the scene file's folder
+				size_t folderEnd = mPath.find_last_of("/\\");
+				bool absolute = meshPath[0] == '/' || meshPath[0] == '\\' || (meshPath.size() > 1 && meshPath[1] == ':');
+				if (!absolute && folderEnd != std::string::npos)
+				{
+					meshPath = mPath.substr(0, folderEnd + 1) + meshPath;
+				};
+
+				if (!load_obj_file(meshPath, scene, glm::vec3(values[0], values[1], values[2]), values[3], glm::vec3(values[4], values[5], values[6]) / 255.0f))
+				{
+					return Fail("cannot load mesh " + meshPath);
+				};
+				keyedType = ShapeType::Mesh;
+			}
+			else if (ReadDirective("instance"))
+			{
+				if (!ReadFloats(values, 16, "instance"))
+				{
+					return false;
+				};
+
+				// The matrix is written row by row, GLM stores it column by column
+				glm::mat4x3 transform;
+				for (int row = 0; row < 3; row++)
+				{
+					for (int column = 0; column < 4; column++)
+					{
+						transform[column][row] = values[1 + row * 4 + column];
+					};
+				};
+
+				if (values[0] < 0 || values[0] != std::floor(values[0]) || !scene.AddMeshInstance((size_t)values[0], transform, glm::vec3(values[13], values[14], values[15]) / 255.0f))
+				{
+					return Fail("'instance' must name a mesh above it, with a matrix that doesn't scale it to nothing");
+				};
+				keyedType = ShapeType::Mesh;
+			}
+			else if (ReadDirective("key"))
+			{
+				if (!ReadFloats(values, 4, "key"))
+				{
+					return false;
+				};
+				if (keyedType == ShapeType::Mesh)
+				{
+					return Fail("'key' must come after a sphere, rectangle, circle or triangle");
+				};
+				if (values[0] < 0 || !scene.AddKeyframe(keyedType, keyedIndex, values[0], glm::vec3(values[1], values[2], values[3])))
+				{
+					return Fail("key frames must not be negative and must come after the shape's last key");
+				};
+			}
+			else if (ReadDirective("light"))
+			{
+				if (!ReadFloats(values, 3, "light"))
+				{
+					return false;
+				};
+				scene.SetLightDirection(glm::vec3(values[0], values[1], values[2]));
+			}
+			else if (ReadDirective("window"))
+			{
+				if (!ReadFloats(values, 2, "window"))
+				{
+					return false;
+				};
+				if (values[0] < 1 || values[1] < 1)
+				{
+					return Fail("window size must be at least 1x1");
+				};
+				windowSize = glm::ivec2((int)values[0], (int)values[1]);
+			}
+			else if (ReadDirective("viewing"))
+			{
+				if (!ReadFloats(values, 2, "viewing"))
+				{
+					return false;
+				};
+				viewingSize = glm::ivec2((int)values[0], (int)values[1]);
+			}
+			else
+			{
+				// Gets the unrecognised word for the message
+				const char* wordEnd = mCursor;
+				while (*wordEnd != ' ' && *wordEnd != '\t' && *wordEnd != '\r' && *wordEnd != '\n' && *wordEnd != '\0')
+				{
+					wordEnd++;
+				};
+				return Fail("unknown directive '" + std::string(mCursor, wordEnd) + "'");
+			};
+
+			SkipLine();
+		};
+
+		return true;
+	};
+};
+
+
+// Streams a Wavefront OBJ file into a scene as one mesh, reading it a block at a time without copying out lines or words
+// Only vertex positions (v) and faces (f) are used, faces with more than three corners are split into a fan of triangles
+// Face corners can be written as v, v/vt, v//vn or v/vt/vn, and negative indices count back from the latest vertex
+// Texture coordinates, normals, groups, materials and anything else are skipped
+class ObjFileReader
+{
+private:
+	// Size of each block read from the file, no line can be longer than this
+	static const size_t kBlockSize = 1 << 20;
+
+	// Stores the file name and current line for error messages
+	std::string mPath;
+	int mLine;
+	// Stores how many vertices and triangles have been found so far
+	size_t mVertexCount;
+	size_t mTriangleCount;
+
+	// Prints an error pointing at the current line
+	bool Fail(std::string message)
+	{
+		std::cout << mPath << ":" << mLine << ": " << message << std::endl;
+		return false;
+	};
+	static const char* SkipSpaces(const char* cursor)
+	{
+		while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')
+		{
+			cursor++;
+		};
+		return cursor;
+	};
+	// Checks if the line starts with the given one letter keyword
+	static bool IsKeyword(const char* line, char keyword)
+	{
+		return line[0] == keyword && (line[1] == ' ' || line[1] == '\t');
+	};
+	// Reads a face corner's vertex index, skipping any texture coordinate and normal indices after it
+	// Returns the character after the corner, or null if it isn't one
+	static const char* ReadCorner(const char* cursor, long long& index)
+	{
+		bool negative = *cursor == '-';
+		if (negative)
+		{
+			cursor++;
+		};
+		if (*cursor < '0' || *cursor > '9')
+		{
+			return nullptr;
+		};
+
+		// Anything past the largest index a mesh can hold is as wrong as it, so it stops growing there
+		index = 0;
+		for (; *cursor >= '0' && *cursor <= '9'; cursor++)
+		{
+			index = std::min(index * 10 + (*cursor - '0'), (long long)std::numeric_limits<uint32_t>::max() + 1);
+		};
+		index = negative ? -index : index;
+
+		if (*cursor == '/')
+		{
+			while (*cursor == '/' || *cursor == '-' || (*cursor >= '0' && *cursor <= '9'))
+			{
+				cursor++;
+			};
+		};
+
+		// Corners have to be separated by spaces
+		if (*cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n' && *cursor != '#')
+		{
+			return nullptr;
+		};
+
+		return cursor;
+	};
+
+	// Calls handleLine(line) on every line of the file in order, each one ending with a newline
+	// Only one block of the file is held at a time, a line cut off at the end of a block is moved to the front of the next one
+	template <typename LineFunc>
+	bool ForEachLine(LineFunc handleLine)
+	{
+		std::ifstream file(mPath, std::ios::binary);
+		if (!file)
+		{
+			std::cout << "Cannot open OBJ file " << mPath << std::endl;
+			return false;
+		};
+
+		// One spare character lets a newline be added after the last line
+		std::vector<char> block(kBlockSize + 1);
+		size_t carried = 0;
+		mLine = 1;
+		while (true)
+		{
+			file.read(block.data() + carried, (std::streamsize)(kBlockSize - carried));
+			size_t filled = carried + (size_t)file.gcount();
+			bool atEnd = !file;
+
+			// Finishes the last line if the file doesn't
+			if (atEnd && filled > 0 && block[filled - 1] != '\n')
+			{
+				block[filled++] = '\n';
+			};
+
+			// Handles every whole line in the block
+			const char* cursor = block.data();
+			const char* blockEnd = block.data() + filled;
+			const char* lineEnd;
+			while ((lineEnd = std::char_traits<char>::find(cursor, blockEnd - cursor, '\n')) != nullptr)
+			{
+				if (!handleLine(cursor))
+				{
+					return false;
+				};
+				cursor = lineEnd + 1;
+				mLine++;
+			};
+
+			if (atEnd)
+			{
+				return true;
+			};
+
+			// Moves the unfinished line to the front of the block
+			carried = blockEnd - cursor;
+			if (carried == kBlockSize)
+			{
+				return Fail("line is longer than " + std::to_string(kBlockSize) + " characters");
+			};
+			std::char_traits<char>::move(block.data(), cursor, carried);
+		};
+	};
+	// Counts the vertex or triangles a line adds
+	bool CountLine(const char* line)
+	{
+		line = SkipSpaces(line);
+
+		if (IsKeyword(line, 'v'))
+		{
+			mVertexCount++;
+		}
+		else if (IsKeyword(line, 'f'))
+		{
+			// A face of n corners is n - 2 triangles
+			int cornerCount = 0;
+			for (const char* cursor = SkipSpaces(line + 2); *cursor != '\n' && *cursor != '#'; cursor = SkipSpaces(cursor))
+			{
+				while (*cursor != ' ' && *cursor != '\t' && *cursor != '\r' && *cursor != '\n')
+				{
+					cursor++;
+				};
+				cornerCount++;
+			};
+			mTriangleCount += std::max(cornerCount - 2, 0);
+		};
+
+		return true;
+	};
+	// Adds the vertex or triangles a line describes to the scene's open mesh
+	bool AddLine(const char* line, Scene& scene)
+	{
+		line = SkipSpaces(line);
+
+		if (IsKeyword(line, 'v'))
+		{
+			float position[3];
+			const char* cursor = line + 2;
+			for (int i = 0; i < 3; i++)
+			{
+				cursor = read_decimal(SkipSpaces(cursor), position[i]);
+				if (!cursor)
+				{
+					return Fail("expected 3 numbers after 'v'");
+				};
+			};
+
+			// OBJ models are y up and face +z, turning them half way around x stands them upright facing the camera
+			scene.AddMeshVertex(glm::vec3(position[0], -position[1], -position[2]));
+			mVertexCount++;
+		}
+		else if (IsKeyword(line, 'f'))
+		{
+			uint32_t firstCorner = 0;
+			uint32_t previousCorner = 0;
+			int cornerCount = 0;
+			for (const char* cursor = SkipSpaces(line + 2); *cursor != '\n' && *cursor != '#'; cursor = SkipSpaces(cursor))
+			{
+				long long index;
+				cursor = ReadCorner(cursor, index);
+				if (!cursor)
+				{
+					return Fail("expected vertex indices after 'f'");
+				};
+
+				// OBJ indices count from 1, negative ones count back from the latest vertex
+				long long vertex = index < 0 ? (long long)mVertexCount + index : index - 1;
+				if (index == 0 || vertex < 0 || vertex >= (long long)mVertexCount)
+				{
+					return Fail("face uses vertex " + std::to_string(index) + ", which doesn't exist");
+				};
+
+				// Fans triangles out from the first corner
+				if (cornerCount == 0)
+				{
+					firstCorner = (uint32_t)vertex;
+				}
+				else if (cornerCount >= 2)
+				{
+					scene.AddMeshTriangle(firstCorner, previousCorner, (uint32_t)vertex);
+					mTriangleCount++;
+				};
+				previousCorner = (uint32_t)vertex;
+				cornerCount++;
+			};
+
+			if (cornerCount < 3)
+			{
+				return Fail("faces need at least 3 corners");
+			};
+		};
+
+		return true;
+	};
+
+public:
+	ObjFileReader(std::string path)
+	{
+		mPath = path;
+		mLine = 1;
+		mVertexCount = 0;
+		mTriangleCount = 0;
+	};
+	~ObjFileReader() {};
+
+	// Adds the file's faces to the scene as one mesh, centred on centre and scaled so its longest side is size long
+	// Returns false (after printing why, and adding nothing) if the file can't be read or has a mistake in it
+	bool Read(Scene& scene, glm::vec3 centre, float size, glm::vec3 colour)
+	{
+		// Counts everything first, so the scene's pools grow once to exactly the size they need
+		mVertexCount = 0;
+		mTriangleCount = 0;
+		if (!ForEachLine([&](const char* line) { return CountLine(line); }))
+		{
+			return false;
+		};
+		scene.ReserveMesh(mVertexCount, mTriangleCount);
+
+		// Then adds it
+		mVertexCount = 0;
+		mTriangleCount = 0;
+		if (!ForEachLine([&](const char* line) { return AddLine(line, scene); }))
+		{
+			scene.DiscardOpenMesh();
+			return false;
+		};
+
+		if (mVertexCount > std::numeric_limits<uint32_t>::max())
+		{
+			scene.DiscardOpenMesh();
+			std::cout << mPath << " has more vertices than a mesh can hold" << std::endl;
+			return false;
+		};
+
+		scene.PlaceOpenMesh(centre, size);
+		if (!scene.EndMesh(colour))
+		{
+			std::cout << mPath << " has no faces" << std::endl;
+			return false;
+		};
+
+		return true;
+	};
+
+	size_t GetVertexCount() const
+	{
+		return mVertexCount;
+	};
+	size_t GetTriangleCount() const
+	{
+		return mTriangleCount;
+	};
+};
+
+
+// Outputs a vec3 to console (used for debugging)
+void display_vec3(glm::vec3 vec)
+{
+	std::cout << vec.x << ", " << vec.y << ", " << vec.z << std::endl;
+};
+
+
+// Sets a ray up for the watertight triangle test, once per ray rather than once per triangle
+TriangleRay get_triangle_ray(Ray ray)
+{
+	TriangleRay triangleRay;
+	triangleRay.mOrigin = ray.GetOrigin();
+	triangleRay.mDirection = ray.GetDirection();
+
+	// Picks the axis the ray moves along most as its z
+	glm::vec3 direction = ray.GetDirection();
+	glm::vec3 absDirection = glm::abs(direction);
+	int axisZ = absDirection.x > absDirection.y ? (absDirection.x > absDirection.z ? 0 : 2) : (absDirection.y > absDirection.z ? 1 : 2);
+	int axisX = (axisZ + 1) % 3;
+	int axisY = (axisX + 1) % 3;
+
+	// Swaps x and y when the ray heads down z, which keeps the triangle's winding the same
+	if (direction[axisZ] < 0)
+	{
+		std::swap(axisX, axisY);
+	};
+
+	// x and y are sheared by z so the ray has no x or y movement, and z is scaled so it moves one unit along it
+	// Multiplying by a row only adds exact zeros on top of the shear, so every corner is moved exactly the same way in every triangle
+	triangleRay.mRowX = glm::vec3(0, 0, 0);
+	triangleRay.mRowY = glm::vec3(0, 0, 0);
+	triangleRay.mRowZ = glm::vec3(0, 0, 0);
+	triangleRay.mRowX[axisX] = 1.0f;
+	triangleRay.mRowX[axisZ] = -direction[axisX] / direction[axisZ];
+	triangleRay.mRowY[axisY] = 1.0f;
+	triangleRay.mRowY[axisZ] = -direction[axisY] / direction[axisZ];
+	triangleRay.mRowZ[axisZ] = 1.0f / direction[axisZ];
+
+	return triangleRay;
+};
+
+
+// Watertight ray/triangle test (Woop, Benthin and Wald, 2013)
+// The corners are moved into a space where the ray runs straight down z from (0, 0), where each edge's side of the ray is found from that edge's two corners alone
+// Triangles sharing an edge work it out identically, so a ray can't slip between them
+// Returns the distance along the ray in multiples of its direction, or -1 if it misses
+float get_ray_triangle_distance(const TriangleRay& ray, glm::vec3 pointA, glm::vec3 pointB, glm::vec3 pointC)
+{
+	// Gets the corners relative to the ray origin
+	glm::vec3 a = pointA - ray.mOrigin;
+	glm::vec3 b = pointB - ray.mOrigin;
+	glm::vec3 c = pointC - ray.mOrigin;
+
+	// Shears them so the ray points along z
+	float ax = glm::dot(ray.mRowX, a);
+	float ay = glm::dot(ray.mRowY, a);
+	float bx = glm::dot(ray.mRowX, b);
+	float by = glm::dot(ray.mRowY, b);
+	float cx = glm::dot(ray.mRowX, c);
+	float cy = glm::dot(ray.mRowY, c);
+
+	// Gets which side of each edge the ray passes
+	float u = cx * by - cy * bx;
+	float v = ax * cy - ay * cx;
+	float w = bx * ay - by * ax;
+
+	// Exactly on an edge the float result doesn't say which side the ray is on, so that edge is redone in double precision
+	// Only the zero edges are redone, so a shared edge still comes out the same in both of its triangles
+	if (u == 0)
+	{
+		u = (float)((double)cx * (double)by - (double)cy * (double)bx);
+	};
+	if (v == 0)
+	{
+		v = (float)((double)ax * (double)cy - (double)ay * (double)cx);
+	};
+	if (w == 0)
+	{
+		w = (float)((double)bx * (double)ay - (double)by * (double)ax);
+	};
+
+	// The ray is inside when it's on the same side of every edge, whichever way the triangle winds (edges count as inside)
+	// The sides are combined without short-circuiting, as the signs are too random for branches on each to predict well
+	bool anyNegative = (u < 0) | (v < 0) | (w < 0);
+	bool anyPositive = (u > 0) | (v > 0) | (w > 0);
+	if (anyNegative & anyPositive)
+	{
+		return -1;
+	};
+	float determinant = u + v + w;
+	if (determinant == 0)
+	{
+		return -1;
+	};
+
+	// Interpolates the corners' distances along the ray, which has to be ahead of it
+	float t = (u * glm::dot(ray.mRowZ, a) + v * glm::dot(ray.mRowZ, b) + w * glm::dot(ray.mRowZ, c)) / determinant;
+	if (t > 0)
+	{
+		return t;
+	};
+
+	return -1;
+};
+
+
+// Gets if 3D ray intersects 3D triangle
+HitData get_ray_triangle_intersection(const TriangleRay& ray, glm::vec3 pointA, glm::vec3 pointB, glm::vec3 pointC)
+{
+	float t = get_ray_triangle_distance(ray, pointA, pointB, pointC);
+	if (t > 0)
+	{
+		// Return collision detected
+		return HitData{ true, ray.mOrigin + ray.mDirection * t };
+	};
+
+	// Return no collision detected
+	return HitData{ false, glm::vec3(0, 0, 0) };
+};
+
+
+// Gets the normal of a triangle, on whichever side faces back towards the camera (down z)
+glm::vec3 get_triangle_normal(glm::vec3 pointA, glm::vec3 pointB, glm::vec3 pointC)
+{
+	glm::vec3 normal = glm::normalize(glm::cross(pointB - pointA, pointC - pointA));
+
+	return normal.z > 0 ? -normal : normal;
+};
+
+
+// Gets if 3D ray intersects 2D rectangle
+HitData get_ray_rectangle_intersection(Ray ray, glm::vec3 rect_pos, float rect_width, float rect_height)
+{
+	// Gets point at correct z coordinate
+	glm::vec3 intersect_point = get_point_at_z(ray, rect_pos.z);
+
+	// Checks the rectangle's plane is ahead of the ray, if it's not, no intersection
+	if (glm::dot(intersect_point - ray.GetOrigin(), ray.GetDirection()) < 0)
+	{
+		return HitData{ false, intersect_point };
+	};
+
+	// Checks if point is inside boundaries
+	if (is_point_in_rectangle(intersect_point, rect_pos, rect_width, rect_height))
+	{
+		// Returns collision detected
+		return HitData{ true, intersect_point };
+	};
+
+	// Returns no collision detected
+	return HitData{ false, intersect_point };
+};
+
+
+// Gets if 3D ray intersects 2D circle
+HitData get_ray_circle_intersection(Ray ray, glm::vec3 circle_pos, float circle_radius)
+{
+	// Gets point at correct z coordinate
+	HitData rect_hitdata = get_ray_rectangle_intersection(ray, circle_pos, circle_radius * 2, circle_radius * 2);
+
+	// Checks if point is inside the circle
+	if (rect_hitdata.mHit && get_length_between_points(rect_hitdata.mFirstIntersection, circle_pos) <= circle_radius)
+	{
+		// Returns collision detected
+		return rect_hitdata;
+	};
+
+	// Returns no collision detected
+	return HitData{ false, glm::vec3(0, 0, 0) };
+};
+
+
+// Gets if a point on a rectangle's plane is inside it
+bool is_point_in_rectangle(glm::vec3 point, glm::vec3 centre, float width, float height)
+{
+	return point.x >= centre.x - (width / 2) && point.x <= centre.x + (width / 2) && point.y >= centre.y - (height / 2) && point.y <= centre.y + (height / 2);
+};
+
+
+// Gets if a point on a circle's plane is inside it, the same way get_ray_circle_intersection checks
+bool is_point_in_circle(glm::vec3 point, glm::vec3 centre, float radius)
+{
+	return is_point_in_rectangle(point, centre, radius * 2, radius * 2) && get_length_between_points(point, centre) <= radius;
+};
+
+
+// Returns 2D position at given z coordinate
+glm::vec3 get_point_at_z(Ray ray, float z)
+{
+	// Gets ray values
+	glm::vec3 origin = ray.GetOrigin();
+	glm::vec3 direction = ray.GetDirection();
+
+	// Gets z travel distance required
+	float travel_distance = z - origin.z;
+	// Gets vector multiplier needed to reach desired z coordinate
+	float vector_multiplier = travel_distance / direction.z;
+
+	// Gets vector at new position
+	glm::vec3 pos_3d = origin + (direction * vector_multiplier);
+
+	// Returns vector
+	return pos_3d;
+};
+
+
+// Gets difference in direction
+float get_direction_difference(glm::vec3 dir1, glm::vec3 dir2)
+{
+	// Normalises vectors
+	glm::vec3 n_dir1 = glm::normalize(dir1);
+	glm::vec3 n_dir2 = glm::normalize(dir2);
+
+	// Gets difference between vectors
+	float dif = glm::length(n_dir1 - n_dir2) / 2;
+
+	// Returns difference
+	return dif;
+};
+
+
+// Returns normal to the given sphere at given point
+glm::vec3 get_normal_on_sphere(glm::vec3 sphereCentre, glm::vec3 queryPoint)
+{
+	// Calculate normal vector
+	glm::vec3 normal = queryPoint - sphereCentre;
+
+	// Return normal vector
+	return glm::normalize(normal);
+};
+
+
+// 𝒂 = Starting point of the ray
+// 𝑷 = Centre of sphere
+// 𝒏 = Direction of the ray
+// 𝑡 = Distance along the ray (in multiples of 𝒏) to the point closest to 𝑷, (𝑷−𝒂)⋅𝒏
+// 𝑑 = Distance from that closest point to 𝑷
+// 𝑥 = Distance from that closest point back to the surface, √(𝑟² − 𝑑²)
+// Returns the distance from 𝒂 to the first intersection, or -1 if there isn't one
+// Every version of the sphere kernel below follows these exact steps, so they all find the same hits
+float get_ray_sphere_distance(glm::vec3 origin, glm::vec3 direction, float directionLength, glm::vec3 sphereCentre, float sphereRadius)
+{
+	// Radius is used as a whole number
+	float wholeRadius = std::trunc(sphereRadius);
+	float radiusSquared = wholeRadius * wholeRadius;
+	float outerRadiusSquared = (wholeRadius + 1) * (wholeRadius + 1);
+
+	// Gets the vector from the ray origin to the centre
+	glm::vec3 toCentre = sphereCentre - origin;
+	float toCentreSquared = toCentre.x * toCentre.x + toCentre.y * toCentre.y + toCentre.z * toCentre.z;
+
+	// Gets the closest point to the centre, and its distance from it
+	float t = toCentre.x * direction.x + toCentre.y * direction.y + toCentre.z * direction.z;
+	glm::vec3 closestOffset = toCentre - t * direction;
+	float dSquared = closestOffset.x * closestOffset.x + closestOffset.y * closestOffset.y + closestOffset.z * closestOffset.z;
+
+	// Ray origin inside sphere (within a whole unit) is treated as an error, the closest point has to be ahead of the ray, and it has to be inside the sphere
+	if (toCentreSquared >= outerRadiusSquared && t > 0 && dSquared <= radiusSquared)
+	{
+		// Steps back to the surface by a whole number of units
+		float x = std::trunc(std::sqrt(radiusSquared - dSquared));
+
+		return (t - x) * directionLength;
+	};
+
+	// No collision
+	return -1;
+};
+
+
+// Returns if hit and first intersection
+HitData get_ray_sphere_intersection(Ray ray, glm::vec3 sphereCentre, float sphereRadius)
+{
+	// Get ray data
+	glm::vec3 a = ray.GetOrigin();
+	glm::vec3 n = ray.GetDirection();
+	float directionLength = glm::length(n);
+
+	float distance = get_ray_sphere_distance(a, n, directionLength, sphereCentre, sphereRadius);
+	if (distance > 0)
+	{
+		// Valid collision detected
+		return HitData{ true, a + n * (distance / directionLength) };
+	};
+
+	// No collision
+	return HitData{ false, glm::vec3(0,0,0) };
+};
+
+
+// Gets the widest instruction set the sphere kernel can use on this CPU
+SimdLevel get_supported_simd_level()
+{
+#ifdef SIMD_X86
+#ifdef _MSC_VER
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 0);
+	int highestLeaf = cpuInfo[0];
+
+	__cpuid(cpuInfo, 1);
+	bool sse41 = (cpuInfo[2] & (1 << 19)) != 0;
+	// AVX registers also need saving by the OS, which it reports through XGETBV
+	bool avx = (cpuInfo[2] & (1 << 27)) != 0 && (cpuInfo[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+	bool avx2 = false;
+	if (avx && highestLeaf >= 7)
+	{
+		__cpuidex(cpuInfo, 7, 0);
+		avx2 = (cpuInfo[1] & (1 << 5)) != 0;
+	};
+#else
+	__builtin_cpu_init();
+	bool sse41 = __builtin_cpu_supports("sse4.1");
+	bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+	if (avx2)
+	{
+		return SimdLevel::AVX2;
+	};
+	if (sse41)
+	{
+		return SimdLevel::SSE41;
+	};
+#endif
+
+	return SimdLevel::Scalar;
+};
+
+
+// Finds the nearest sphere in a contiguous run the ray hits, one sphere at a time
+// Only hits nearer than nearestDistance count, which is updated to the new nearest
+// Returns the sphere's index in the run, or -1 if none were hit
+int get_nearest_sphere_hit_scalar(Ray ray, const float* centreX, const float* centreY, const float* centreZ, const float* radius, size_t count, float& nearestDistance)
+{
+	glm::vec3 origin = ray.GetOrigin();
+	glm::vec3 direction = ray.GetDirection();
+	float directionLength = glm::length(direction);
+
+	int nearestIndex = -1;
+	for (size_t i = 0; i < count; i++)
+	{
+		float distance = get_ray_sphere_distance(origin, direction, directionLength, glm::vec3(centreX[i], centreY[i], centreZ[i]), radius[i]);
+
+		if (distance > 0 && distance < nearestDistance)
+		{
+			nearestDistance = distance;
+			nearestIndex = (int)i;
+		};
+	};
+
+	return nearestIndex;
+};
+
+
+#ifdef SIMD_X86
+// Same as get_nearest_sphere_hit_scalar, testing 4 spheres per instruction
+TARGET_SSE41 int get_nearest_sphere_hit_sse41(Ray ray, const float* centreX, const float* centreY, const float* centreZ, const float* radius, size_t count, float& nearestDistance)
+{
+	glm::vec3 origin = ray.GetOrigin();
+	glm::vec3 direction = ray.GetDirection();
+
+	// Every lane tests the same ray
+	__m128 originX = _mm_set1_ps(origin.x), originY = _mm_set1_ps(origin.y), originZ = _mm_set1_ps(origin.z);
+	__m128 directionX = _mm_set1_ps(direction.x), directionY = _mm_set1_ps(direction.y), directionZ = _mm_set1_ps(direction.z);
+	__m128 directionLength = _mm_set1_ps(glm::length(direction));
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+
+	// Each lane keeps the nearest hit it has seen
+	__m128 laneDistances = _mm_set1_ps(nearestDistance);
+	__m128i laneIndices = _mm_set1_epi32(-1);
+	__m128i indices = _mm_setr_epi32(0, 1, 2, 3);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 wholeRadius = _mm_round_ps(_mm_loadu_ps(radius + i), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+		__m128 radiusSquared = _mm_mul_ps(wholeRadius, wholeRadius);
+		__m128 outerRadius = _mm_add_ps(wholeRadius, one);
+		__m128 outerRadiusSquared = _mm_mul_ps(outerRadius, outerRadius);
+
+		__m128 toCentreX = _mm_sub_ps(_mm_loadu_ps(centreX + i), originX);
+		__m128 toCentreY = _mm_sub_ps(_mm_loadu_ps(centreY + i), originY);
+		__m128 toCentreZ = _mm_sub_ps(_mm_loadu_ps(centreZ + i), originZ);
+		__m128 toCentreSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(toCentreX, toCentreX), _mm_mul_ps(toCentreY, toCentreY)), _mm_mul_ps(toCentreZ, toCentreZ));
+
+		__m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(toCentreX, directionX), _mm_mul_ps(toCentreY, directionY)), _mm_mul_ps(toCentreZ, directionZ));
+		__m128 offsetX = _mm_sub_ps(toCentreX, _mm_mul_ps(t, directionX));
+		__m128 offsetY = _mm_sub_ps(toCentreY, _mm_mul_ps(t, directionY));
+		__m128 offsetZ = _mm_sub_ps(toCentreZ, _mm_mul_ps(t, directionZ));
+		__m128 dSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(offsetX, offsetX), _mm_mul_ps(offsetY, offsetY)), _mm_mul_ps(offsetZ, offsetZ));
+
+		__m128 hit = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(toCentreSquared, outerRadiusSquared), _mm_cmpgt_ps(t, zero)), _mm_cmple_ps(dSquared, radiusSquared));
+
+		// Missed lanes can take the square root of a negative, they are masked out below
+		__m128 x = _mm_round_ps(_mm_sqrt_ps(_mm_sub_ps(radiusSquared, dSquared)), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+		__m128 distance = _mm_mul_ps(_mm_sub_ps(t, x), directionLength);
+
+		hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(distance, zero), _mm_cmplt_ps(distance, laneDistances)));
+		laneDistances = _mm_blendv_ps(laneDistances, distance, hit);
+		laneIndices = _mm_blendv_epi8(laneIndices, indices, _mm_castps_si128(hit));
+		indices = _mm_add_epi32(indices, _mm_set1_epi32(4));
+	};
+
+	// Picks the nearest lane, the lowest index wins ties so the result matches testing one sphere at a time
+	alignas(16) float distances[4];
+	alignas(16) int hitIndices[4];
+	_mm_store_ps(distances, laneDistances);
+	_mm_store_si128((__m128i*)hitIndices, laneIndices);
+
+	int nearestIndex = -1;
+	for (int lane = 0; lane < 4; lane++)
+	{
+		if (hitIndices[lane] >= 0 && (distances[lane] < nearestDistance || (distances[lane] == nearestDistance && nearestIndex >= 0 && hitIndices[lane] < nearestIndex)))
+		{
+			nearestDistance = distances[lane];
+			nearestIndex = hitIndices[lane];
+		};
+	};
+
+	// Tests the spheres left over one at a time
+	int tailIndex = get_nearest_sphere_hit_scalar(ray, centreX + i, centreY + i, centreZ + i, radius + i, count - i, nearestDistance);
+	if (tailIndex >= 0)
+	{
+		nearestIndex = (int)i + tailIndex;
+	};
+
+	return nearestIndex;
+};
+
+
+// Same as get_nearest_sphere_hit_scalar, testing 8 spheres per instruction
+TARGET_AVX2 int get_nearest_sphere_hit_avx2(Ray ray, const float* centreX, const float* centreY, const float* centreZ, const float* radius, size_t count, float& nearestDistance)
+{
+	glm::vec3 origin = ray.GetOrigin();
+	glm::vec3 direction = ray.GetDirection();
+
+	// Every lane tests the same ray
+	__m256 originX = _mm256_set1_ps(origin.x), originY = _mm256_set1_ps(origin.y), originZ = _mm256_set1_ps(origin.z);
+	__m256 directionX = _mm256_set1_ps(direction.x), directionY = _mm256_set1_ps(direction.y), directionZ = _mm256_set1_ps(direction.z);
+	__m256 directionLength = _mm256_set1_ps(glm::length(direction));
+	__m256 zero = _mm256_setzero_ps();
+	__m256 one = _mm256_set1_ps(1.0f);
+
+	// Each lane keeps the nearest hit it has seen
+	__m256 laneDistances = _mm256_set1_ps(nearestDistance);
+	__m256i laneIndices = _mm256_set1_epi32(-1);
+	__m256i indices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 wholeRadius = _mm256_round_ps(_mm256_loadu_ps(radius + i), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+		__m256 radiusSquared = _mm256_mul_ps(wholeRadius, wholeRadius);
+		__m256 outerRadius = _mm256_add_ps(wholeRadius, one);
+		__m256 outerRadiusSquared = _mm256_mul_ps(outerRadius, outerRadius);
+
+		__m256 toCentreX = _mm256_sub_ps(_mm256_loadu_ps(centreX + i), originX);
+		__m256 toCentreY = _mm256_sub_ps(_mm256_loadu_ps(centreY + i), originY);
+		__m256 toCentreZ = _mm256_sub_ps(_mm256_loadu_ps(centreZ + i), originZ);
+		__m256 toCentreSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toCentreX, toCentreX), _mm256_mul_ps(toCentreY, toCentreY)), _mm256_mul_ps(toCentreZ, toCentreZ));
+
+		__m256 t = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toCentreX, directionX), _mm256_mul_ps(toCentreY, directionY)), _mm256_mul_ps(toCentreZ, directionZ));
+		__m256 offsetX = _mm256_sub_ps(toCentreX, _mm256_mul_ps(t, directionX));
+		__m256 offsetY = _mm256_sub_ps(toCentreY, _mm256_mul_ps(t, directionY));
+		__m256 offsetZ = _mm256_sub_ps(toCentreZ, _mm256_mul_ps(t, directionZ));
+		__m256 dSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(offsetX, offsetX), _mm256_mul_ps(offsetY, offsetY)), _mm256_mul_ps(offsetZ, offsetZ));
+
+		__m256 hit = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(toCentreSquared, outerRadiusSquared, _CMP_GE_OQ), _mm256_cmp_ps(t, zero, _CMP_GT_OQ)), _mm256_cmp_ps(dSquared, radiusSquared, _CMP_LE_OQ));
+
+		// Missed lanes can take the square root of a negative, they are masked out below
+		__m256 x = _mm256_round_ps(_mm256_sqrt_ps(_mm256_sub_ps(radiusSquared, dSquared)), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+		__m256 distance = _mm256_mul_ps(_mm256_sub_ps(t, x), directionLength);
+
+		hit = _mm256_and_ps(hit, _mm256_and_ps(_mm256_cmp_ps(distance, zero, _CMP_GT_OQ), _mm256_cmp_ps(distance, laneDistances, _CMP_LT_OQ)));
+		laneDistances = _mm256_blendv_ps(laneDistances, distance, hit);
+		laneIndices = _mm256_blendv_epi8(laneIndices, indices, _mm256_castps_si256(hit));
+		indices = _mm256_add_epi32(indices, _mm256_set1_epi32(8));
+	};
+
+	// Picks the nearest lane, the lowest index wins ties so the result matches testing one sphere at a time
+	alignas(32) float distances[8];
+	alignas(32) int hitIndices[8];
+	_mm256_store_ps(distances, laneDistances);
+	_mm256_store_si256((__m256i*)hitIndices, laneIndices);
+
+	int nearestIndex = -1;
+	for (int lane = 0; lane < 8; lane++)
+	{
+		if (hitIndices[lane] >= 0 && (distances[lane] < nearestDistance || (distances[lane] == nearestDistance && nearestIndex >= 0 && hitIndices[lane] < nearestIndex)))
+		{
+			nearestDistance = distances[lane];
+			nearestIndex = hitIndices[lane];
+		};
+	};
+
+	// Tests the spheres left over one at a time
+	int tailIndex = get_nearest_sphere_hit_scalar(ray, centreX + i, centreY + i, centreZ + i, radius + i, count - i, nearestDistance);
+	if (tailIndex >= 0)
+	{
+		nearestIndex = (int)i + tailIndex;
+	};
+
+	return nearestIndex;
+};
+#endif
+
+
+// Finds the nearest sphere in a contiguous run the ray hits, with the widest kernel gSphereKernelLevel allows
+// Only hits nearer than nearestDistance count, which is updated to the new nearest
+// Returns the sphere's index in the run, or -1 if none were hit
+int get_nearest_sphere_hit(Ray ray, const float* centreX, const float* centreY, const float* centreZ, const float* radius, size_t count, float& nearestDistance)
+{
+#ifdef SIMD_X86
+	if (gSphereKernelLevel == SimdLevel::AVX2)
+	{
+		return get_nearest_sphere_hit_avx2(ray, centreX, centreY, centreZ, radius, count, nearestDistance);
+	};
+	if (gSphereKernelLevel == SimdLevel::SSE41)
+	{
+		return get_nearest_sphere_hit_sse41(ray, centreX, centreY, centreZ, radius, count, nearestDistance);
+	};
+#endif
+
+	return get_nearest_sphere_hit_scalar(ray, centreX, centreY, centreZ, radius, count, nearestDistance);
+};
+
+
+// Returns how many lanes a packet lane mask has set
+int get_lane_count(int laneMask)
+{
+	int count = 0;
+	for (int lane = 0; lane < kPacketWidth; lane++)
+	{
+		count += (laneMask >> lane) & 1;
+	};
+
+	return count;
+};
+
+
+// Tests one sphere against every ray of a packet in laneMask
+// distances is set for each lane that hits, in the same units get_ray_sphere_distance returns
+// Returns the mask of lanes that hit
+int get_packet_sphere_hits_scalar(const RayPacket& packet, int laneMask, glm::vec3 sphereCentre, float sphereRadius, float* distances)
+{
+	int hitMask = 0;
+	for (int lane = 0; lane < kPacketWidth; lane++)
+	{
+		if (!(laneMask & (1 << lane)))
+		{
+			continue;
+		};
+
+		glm::vec3 origin(packet.mOriginX[lane], packet.mOriginY[lane], packet.mOriginZ[lane]);
+		glm::vec3 direction(packet.mDirectionX[lane], packet.mDirectionY[lane], packet.mDirectionZ[lane]);
+		distances[lane] = get_ray_sphere_distance(origin, direction, packet.mDirectionLength[lane], sphereCentre, sphereRadius);
+		if (distances[lane] > 0)
+		{
+			hitMask |= 1 << lane;
+		};
+	};
+
+	return hitMask;
+};
+
+
+#ifdef SIMD_X86
+// Same as get_packet_sphere_hits_scalar, testing the whole packet in one go
+TARGET_AVX2 int get_packet_sphere_hits_avx2(const RayPacket& packet, int laneMask, glm::vec3 sphereCentre, float sphereRadius, float* distances)
+{
+	// Every lane tests the same sphere
+	float wholeRadius = std::trunc(sphereRadius);
+	__m256 radiusSquared = _mm256_set1_ps(wholeRadius * wholeRadius);
+	__m256 outerRadiusSquared = _mm256_set1_ps((wholeRadius + 1) * (wholeRadius + 1));
+	__m256 zero = _mm256_setzero_ps();
+
+	__m256 directionX = _mm256_load_ps(packet.mDirectionX);
+	__m256 directionY = _mm256_load_ps(packet.mDirectionY);
+	__m256 directionZ = _mm256_load_ps(packet.mDirectionZ);
+
+	__m256 toCentreX = _mm256_sub_ps(_mm256_set1_ps(sphereCentre.x), _mm256_load_ps(packet.mOriginX));
+	__m256 toCentreY = _mm256_sub_ps(_mm256_set1_ps(sphereCentre.y), _mm256_load_ps(packet.mOriginY));
+	__m256 toCentreZ = _mm256_sub_ps(_mm256_set1_ps(sphereCentre.z), _mm256_load_ps(packet.mOriginZ));
+	__m256 toCentreSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toCentreX, toCentreX), _mm256_mul_ps(toCentreY, toCentreY)), _mm256_mul_ps(toCentreZ, toCentreZ));
+
+	__m256 t = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toCentreX, directionX), _mm256_mul_ps(toCentreY, directionY)), _mm256_mul_ps(toCentreZ, directionZ));
+	__m256 offsetX = _mm256_sub_ps(toCentreX, _mm256_mul_ps(t, directionX));
+	__m256 offsetY = _mm256_sub_ps(toCentreY, _mm256_mul_ps(t, directionY));
+	__m256 offsetZ = _mm256_sub_ps(toCentreZ, _mm256_mul_ps(t, directionZ));
+	__m256 dSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(offsetX, offsetX), _mm256_mul_ps(offsetY, offsetY)), _mm256_mul_ps(offsetZ, offsetZ));
+
+	__m256 hit = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(toCentreSquared, outerRadiusSquared, _CMP_GE_OQ), _mm256_cmp_ps(t, zero, _CMP_GT_OQ)), _mm256_cmp_ps(dSquared, radiusSquared, _CMP_LE_OQ));
+
+	// Missed lanes can take the square root of a negative, they are masked out below
+	__m256 x = _mm256_round_ps(_mm256_sqrt_ps(_mm256_sub_ps(radiusSquared, dSquared)), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+	__m256 distance = _mm256_mul_ps(_mm256_sub_ps(t, x), _mm256_load_ps(packet.mDirectionLength));
+
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(distance, zero, _CMP_GT_OQ));
+	_mm256_storeu_ps(distances, distance);
+
+	return _mm256_movemask_ps(hit) & laneMask;
+};
+#endif
+
+
+// Tests one sphere against a packet with the widest kernel gPacketKernelLevel allows
+int get_packet_sphere_hits(const RayPacket& packet, int laneMask, glm::vec3 sphereCentre, float sphereRadius, float* distances)
+{
+#ifdef SIMD_X86
+	if (gPacketKernelLevel == SimdLevel::AVX2)
+	{
+		return get_packet_sphere_hits_avx2(packet, laneMask, sphereCentre, sphereRadius, distances);
+	};
+#endif
+
+	return get_packet_sphere_hits_scalar(packet, laneMask, sphereCentre, sphereRadius, distances);
+};
+
+
+float get_length_between_points(glm::vec3 point1, glm::vec3 point2)
+{
+	// Returns length between two given vectors
+	return glm::length(point1 - point2);
+};
+
+
+// Returns a box containing nothing, growing it by any other box gives that box
+AABB get_empty_aabb()
+{
+	float largest = std::numeric_limits<float>::max();
+
+	return AABB{ glm::vec3(largest), glm::vec3(-largest) };
+};
+
+
+// Returns the smallest box containing both given boxes
+AABB get_aabb_union(AABB box1, AABB box2)
+{
+	return AABB{ glm::min(box1.mMin, box2.mMin), glm::max(box1.mMax, box2.mMax) };
+};
+
+
+// Returns the smallest box containing both given points
+AABB get_aabb_from_points(glm::vec3 point1, glm::vec3 point2)
+{
+	return AABB{ glm::min(point1, point2), glm::max(point1, point2) };
+};
+
+
+// Returns the surface area of a box (flat boxes still have area, empty boxes have none)
+float get_aabb_surface_area(AABB box)
+{
+	glm::vec3 size = glm::max(box.mMax - box.mMin, glm::vec3(0, 0, 0));
+
+	return 2 * (size.x * size.y + size.y * size.z + size.z * size.x);
+};
+
+
+// Returns the centre of a box
+glm::vec3 get_aabb_centre(AABB box)
+{
+	return (box.mMin + box.mMax) * 0.5f;
+};
+
+
+// Gets the box enclosing a box once it has been moved, turned and scaled by transform, from where its eight corners end up
+AABB get_transformed_aabb(AABB box, const glm::mat4x3& transform)
+{
+	AABB transformedBox = get_empty_aabb();
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 point((corner & 1) ? box.mMax.x : box.mMin.x, (corner & 2) ? box.mMax.y : box.mMin.y, (corner & 4) ? box.mMax.z : box.mMin.z);
+		point = transform * glm::vec4(point, 1.0f);
+		transformedBox = get_aabb_union(transformedBox, get_aabb_from_points(point, point));
+	};
+
+	return transformedBox;
+};
+
+
+// Spreads the low 10 bits of a value out to every third bit, ready to be interleaved with two others
+uint32_t get_spread_bits(uint32_t value)
+{
+	value &= 0x3ff;
+	value = (value | (value << 16)) & 0x030000ff;
+	value = (value | (value << 8)) & 0x0300f00f;
+	value = (value | (value << 4)) & 0x030c30c3;
+	value = (value | (value << 2)) & 0x09249249;
+
+	return value;
+};
+
+
+// Returns the 30 bit Morton code of a position given as fractions (0 to 1) of a box along each axis, interleaving 10 bits of each
+// Positions close in space mostly get close codes, so sorting by code groups nearby primitives together
+uint32_t get_morton_code(glm::vec3 position)
+{
+	glm::vec3 cell = glm::clamp(position * 1024.0f, glm::vec3(0, 0, 0), glm::vec3(1023, 1023, 1023));
+
+	return (get_spread_bits((uint32_t)cell.x) << 2) | (get_spread_bits((uint32_t)cell.y) << 1) | get_spread_bits((uint32_t)cell.z);
+};
+
+
+// Returns 1 / direction, with zero components replaced by tiny values so the slab test never multiplies zero by infinity
+glm::vec3 get_safe_inverse_direction(glm::vec3 direction)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (std::abs(direction[axis]) < 1e-20f)
+		{
+			direction[axis] = direction[axis] < 0 ? -1e-20f : 1e-20f;
+		};
+	};
+
+	return 1.0f / direction;
+};
+
+
+// Slab test, gets if the ray enters the box before maxDistance (measured in multiples of the ray direction)
+// entryDistance is set to where the ray enters the box, or zero if it starts inside
+bool get_ray_aabb_entry(glm::vec3 origin, glm::vec3 inverseDirection, AABB box, float maxDistance, float& entryDistance)
+{
+	PROFILE_COUNT(BoxTests, 1);
+
+	// Gets distances to each pair of planes
+	glm::vec3 t0 = (box.mMin - origin) * inverseDirection;
+	glm::vec3 t1 = (box.mMax - origin) * inverseDirection;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+
+	// The ray is inside the box between the last plane it enters and the first it leaves
+	float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	// Exit is pushed out slightly so rounding can't reject hits on the faces of flat boxes
+	float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance)) * 1.0000003f;
+
+	entryDistance = entry;
+	return entry <= exit;
+};
+
+
+// Slab test for every ray of a packet in laneMask, each against its own maxDistances entry
+// entryDistances is set as get_ray_aabb_entry sets entryDistance
+// Returns the mask of lanes that enter the box
+int get_packet_aabb_mask_scalar(const RayPacket& packet, AABB box, int laneMask, const float* maxDistances, float* entryDistances)
+{
+	int hitMask = 0;
+	for (int lane = 0; lane < kPacketWidth; lane++)
+	{
+		if (!(laneMask & (1 << lane)))
+		{
+			continue;
+		};
+
+		glm::vec3 origin(packet.mOriginX[lane], packet.mOriginY[lane], packet.mOriginZ[lane]);
+		glm::vec3 inverseDirection(packet.mInverseDirectionX[lane], packet.mInverseDirectionY[lane], packet.mInverseDirectionZ[lane]);
+		if (get_ray_aabb_entry(origin, inverseDirection, box, maxDistances[lane], entryDistances[lane]))
+		{
+			hitMask |= 1 << lane;
+		};
+	};
+
+	return hitMask;
+};
+
+
+#ifdef SIMD_X86
+// Same as get_packet_aabb_mask_scalar, testing the whole packet in one go
+TARGET_AVX2 int get_packet_aabb_mask_avx2(const RayPacket& packet, AABB box, int laneMask, const float* maxDistances, float* entryDistances)
+{
+	__m256 originX = _mm256_load_ps(packet.mOriginX);
+	__m256 originY = _mm256_load_ps(packet.mOriginY);
+	__m256 originZ = _mm256_load_ps(packet.mOriginZ);
+	__m256 inverseDirectionX = _mm256_load_ps(packet.mInverseDirectionX);
+	__m256 inverseDirectionY = _mm256_load_ps(packet.mInverseDirectionY);
+	__m256 inverseDirectionZ = _mm256_load_ps(packet.mInverseDirectionZ);
+
+	// Gets distances to each pair of planes
+	__m256 t0X = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box.mMin.x), originX), inverseDirectionX);
+	__m256 t0Y = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box.mMin.y), originY), inverseDirectionY);
+	__m256 t0Z = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box.mMin.z), originZ), inverseDirectionZ);
+	__m256 t1X = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box.mMax.x), originX), inverseDirectionX);
+	__m256 t1Y = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box.mMax.y), originY), inverseDirectionY);
+	__m256 t1Z = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box.mMax.z), originZ), inverseDirectionZ);
+
+	// The ray is inside the box between the last plane it enters and the first it leaves
+	__m256 entry = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(t0X, t1X), _mm256_min_ps(t0Y, t1Y)), _mm256_max_ps(_mm256_min_ps(t0Z, t1Z), _mm256_setzero_ps()));
+	__m256 exit = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(t0X, t1X), _mm256_max_ps(t0Y, t1Y)), _mm256_min_ps(_mm256_max_ps(t0Z, t1Z), _mm256_loadu_ps(maxDistances)));
+	exit = _mm256_mul_ps(exit, _mm256_set1_ps(1.0000003f));
+
+	_mm256_storeu_ps(entryDistances, entry);
+
+	return _mm256_movemask_ps(_mm256_cmp_ps(entry, exit, _CMP_LE_OQ)) & laneMask;
+};
+#endif
+
+
+// Slab tests a packet against a box with the widest kernel gPacketKernelLevel allows
+int get_packet_aabb_mask(const RayPacket& packet, AABB box, int laneMask, const float* maxDistances, float* entryDistances)
+{
+	PROFILE_COUNT(BoxTests, get_lane_count(laneMask));
+
+#ifdef SIMD_X86
+	if (gPacketKernelLevel == SimdLevel::AVX2)
+	{
+		return get_packet_aabb_mask_avx2(packet, box, laneMask, maxDistances, entryDistances);
+	};
+#endif
+
+	return get_packet_aabb_mask_scalar(packet, box, laneMask, maxDistances, entryDistances);
+};
+
+
+// Gets where one of a pixel's anti-aliasing samples goes, as an offset from the pixel's own ray within half a pixel either way
+// The pixel is split into a gridSize by gridSize grid (gridSize being a power of two) with one sample jittered within each cell
+// Cells are visited in bit-reversed Morton order, so the first four samples land one in each quarter of the pixel, the first sixteen one in each sixteenth and so on
+glm::vec2 get_sample_offset(int sample, int gridSize, glm::vec2 jitter)
+{
+	int bitCount = 0;
+	while ((1 << bitCount) < gridSize * gridSize)
+	{
+		bitCount++;
+	};
+
+	// Reversing the sample number's bits gives the cell's Morton code, whose even bits are its column and odd bits its row
+	glm::ivec2 cell(0, 0);
+	for (int bit = 0; bit < bitCount; bit++)
+	{
+		int codeBit = (sample >> (bitCount - 1 - bit)) & 1;
+		cell[bit % 2] |= codeBit << (bit / 2);
+	};
+
+	return (glm::vec2(cell) + jitter) / (float)gridSize - 0.5f;
+};
+
+
+// Gets how different two packed colours (see MCG::PackColour) are, as the difference in the channel they differ most in, from 0 to 1
+float get_colour_contrast(uint32_t colourA, uint32_t colourB)
+{
+	int contrast = 0;
+	for (int shift = 8; shift <= 24; shift += 8)
+	{
+		contrast = std::max(contrast, std::abs((int)((colourA >> shift) & 255) - (int)((colourB >> shift) & 255)));
+	};
+
+	return contrast / 255.0f;
+};
+
+
+// Reads a decimal number such as 12, -0.5 or 1e-3 starting at the cursor, without needing it to end with a null
+// Returns the character after the number, or null if there isn't one there
+const char* read_decimal(const char* cursor, float& value)
+{
+	bool negative = *cursor == '-';
+	if (*cursor == '-' || *cursor == '+')
+	{
+		cursor++;
+	};
+
+	// Collects up to 18 significant digits into an integer, remembering where the decimal point goes
+	uint64_t mantissa = 0;
+	int exponent = 0;
+	int digitCount = 0;
+	for (; *cursor >= '0' && *cursor <= '9'; cursor++, digitCount++)
+	{
+		if (mantissa < 100000000000000000ull)
+		{
+			mantissa = mantissa * 10 + (*cursor - '0');
+		}
+		else
+		{
+			exponent++;
+		};
+	};
+	if (*cursor == '.')
+	{
+		for (cursor++; *cursor >= '0' && *cursor <= '9'; cursor++, digitCount++)
+		{
+			if (mantissa < 100000000000000000ull)
+			{
+				mantissa = mantissa * 10 + (*cursor - '0');
+				exponent--;
+			};
+		};
+	};
+	if (digitCount == 0)
+	{
+		return nullptr;
+	};
+
+	// Optional exponent
+	if (*cursor == 'e' || *cursor == 'E')
+	{
+		cursor++;
+		bool negativeExponent = *cursor == '-';
+		if (*cursor == '-' || *cursor == '+')
+		{
+			cursor++;
+		};
+		if (*cursor < '0' || *cursor > '9')
+		{
+			return nullptr;
+		};
+
+		int writtenExponent = 0;
+		for (; *cursor >= '0' && *cursor <= '9'; cursor++)
+		{
+			writtenExponent = std::min(writtenExponent * 10 + (*cursor - '0'), 1000);
+		};
+		exponent += negativeExponent ? -writtenExponent : writtenExponent;
+	};
+
+	// Scales by the power of ten, exact powers up to 1e22 come from a table
+	static const double powersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	double result = (double)mantissa;
+	if (exponent < 0)
+	{
+		result = -exponent <= 22 ? result / powersOfTen[-exponent] : result * std::pow(10.0, exponent);
+	}
+	else if (exponent > 0)
+	{
+		result = exponent <= 22 ? result * powersOfTen[exponent] : result * std::pow(10.0, exponent);
+	};
+
+	value = (float)(negative ? -result : result);
+	return cursor;
+};
+
+
+// Loads a scene file (see SceneFileParser for the format) into the scene, window and viewing sizes
+// Returns false if the file couldn't be read or has a mistake in it
+bool load_scene_file(std::string path, Scene& scene, glm::ivec2& windowSize, glm::ivec2& viewingSize)
+{
+	// Reads the whole file in one go
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file)
+	{
+		std::cout << "Cannot open scene file " << path << std::endl;
+		return false;
+	};
+
+	std::streamsize fileSize = file.tellg();
+	file.seekg(0);
+	std::vector<char> text((size_t)fileSize + 1);
+	if (!file.read(text.data(), fileSize))
+	{
+		std::cout << "Cannot read scene file " << path << std::endl;
+		return false;
+	};
+
+	// The parser relies on the text ending with a null character
+	text[(size_t)fileSize] = '\0';
+
+	SceneFileParser parser(text.data(), path);
+	return parser.Parse(scene, windowSize, viewingSize);
+};
+
+
+// Loads an OBJ file (see ObjFileReader) into the scene as one mesh, centred on centre and scaled so its longest side is size long
+bool load_obj_file(std::string path, Scene& scene, glm::vec3 centre, float size, glm::vec3 colour)
+{
+	ObjFileReader reader(path);
+	return reader.Read(scene, centre, size, colour);
+};
+
+
+// Gets the bounds of every shape in the scene, indexed as in Scene::GetShapeType, across all hardware threads
+std::vector<AABB> get_scene_shape_bounds(const Scene& scene)
+{
+	std::vector<AABB> shapeBounds(scene.GetShapeCount());
+	run_in_parallel(((int)shapeBounds.size() + kGridBuildChunkSize - 1) / kGridBuildChunkSize, [&](int chunk)
+	{
+		for (size_t i = (size_t)chunk * kGridBuildChunkSize; i < std::min((size_t)(chunk + 1) * kGridBuildChunkSize, shapeBounds.size()); i++)
+		{
+			shapeBounds[i] = scene.GetShapeBounds(i);
+		};
+	});
+
+	return shapeBounds;
+};
+
+
+// Builds a BVH over every shape in the scene, indexed as in Scene::GetShapeType
+void build_scene_bvh(const Scene& scene, BVH& bvh, BVHBuilder builder)
+{
+	PROFILE_SCOPE("Build BVH");
+
+	bvh.Build(get_scene_shape_bounds(scene), builder);
+};
+
+
+// Runs task(taskIndex) for every index below taskCount across the hardware threads and waits for all of them to finish
+// For one-off jobs such as building acceleration structures, which happen outside any renderer's worker pool
+void run_in_parallel(int taskCount, const std::function<void(int)>& task)
+{
+	int threadCount = std::min(std::max((int)std::thread::hardware_concurrency(), 1), taskCount);
+
+	// Each thread takes the next task until there are none left, this one included
+	std::atomic<int> nextTask(0);
+	auto work = [&]
+	{
+		for (int taskIndex = nextTask++; taskIndex < taskCount; taskIndex = nextTask++)
+		{
+			task(taskIndex);
+		};
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 1; i < threadCount; i++)
+	{
+		threads.push_back(std::thread(work));
+	};
+	work();
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	};
+};
+
+
+// Checks if the file starts like a binary scene cache
+bool is_scene_cache_file(std::string path)
+{
+	std::ifstream file(path, std::ios::binary);
+	char magic[8] = {};
+	file.read(magic, 8);
+
+	return file && std::char_traits<char>::compare(magic, "RTSCENE", 8) == 0;
+};
+
+
+// Writes a scene as a binary scene cache, along with a BVH built over it so loading doesn't need to build one
+bool write_scene_cache(std::string path, const Scene& scene, glm::ivec2 windowSize, glm::ivec2 viewingSize)
+{
+	BVH bvh;
+	build_scene_bvh(scene, bvh, BVHBuilder::SAH);
+
+	// Lists every array the scene's shapes are stored in, then the mesh pools, then the BVH's
+	std::vector<const PrimitiveArrayBase*> sceneArrays;
+	for (int type = 0; type < kShapeTypeCount; type++)
+	{
+		std::vector<const PrimitiveArrayBase*> typeArrays = scene.GetArrays((ShapeType)type);
+		sceneArrays.insert(sceneArrays.end(), typeArrays.begin(), typeArrays.end());
+	};
+	std::vector<const PrimitiveArrayBase*> poolArrays = scene.GetMeshPoolArrays();
+	sceneArrays.insert(sceneArrays.end(), poolArrays.begin(), poolArrays.end());
+
+	std::vector<const void*> arrayData;
+	std::vector<size_t> arrayCounts, elementSizes;
+	for (const PrimitiveArrayBase* array : sceneArrays)
+	{
+		arrayData.push_back(array->GetRawData());
+		arrayCounts.push_back(array->GetCount());
+		elementSizes.push_back(array->GetElementSize());
+	};
+	arrayData.push_back(bvh.GetNodes());
+	arrayCounts.push_back((size_t)bvh.GetNodeCount());
+	elementSizes.push_back(sizeof(BVHNode));
+	arrayData.push_back(bvh.GetPrimIndices());
+	arrayCounts.push_back((size_t)bvh.GetPrimCount());
+	elementSizes.push_back(sizeof(int));
+
+	// Fills in the header, every array starts on a 16 byte boundary
+	SceneCacheHeader header = {};
+	std::char_traits<char>::copy(header.mMagic, "RTSCENE", 8);
+	header.mVersion = kSceneCacheVersion;
+	header.mWindowSize[0] = windowSize.x;
+	header.mWindowSize[1] = windowSize.y;
+	header.mViewingSize[0] = viewingSize.x;
+	header.mViewingSize[1] = viewingSize.y;
+	header.mLightDirection[0] = scene.GetLightDirection().x;
+	header.mLightDirection[1] = scene.GetLightDirection().y;
+	header.mLightDirection[2] = scene.GetLightDirection().z;
+	header.mArrayCount = (uint32_t)arrayData.size();
+
+	uint64_t offset = (sizeof(SceneCacheHeader) + 15) & ~(uint64_t)15;
+	for (size_t i = 0; i < arrayData.size(); i++)
+	{
+		header.mArrayOffsets[i] = offset;
+		header.mArrayCounts[i] = arrayCounts[i];
+		header.mElementSizes[i] = (uint32_t)elementSizes[i];
+		offset = (offset + arrayCounts[i] * elementSizes[i] + 15) & ~(uint64_t)15;
+	};
+
+	// Writes the header then each array, padding up to its offset
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+	{
+		std::cout << "Cannot open " << path << " for writing" << std::endl;
+		return false;
+	};
+
+	const char padding[16] = {};
+	file.write((const char*)&header, sizeof(header));
+	uint64_t written = sizeof(header);
+	for (size_t i = 0; i < arrayData.size(); i++)
+	{
+		file.write(padding, (std::streamsize)(header.mArrayOffsets[i] - written));
+		file.write((const char*)arrayData[i], (std::streamsize)(arrayCounts[i] * elementSizes[i]));
+		written = header.mArrayOffsets[i] + arrayCounts[i] * elementSizes[i];
+	};
+
+	return (bool)file;
+};
+
+
+// Loads a binary scene cache written by write_scene_cache, replacing the scene's shapes
+// The shapes and BVH are used straight from a mapping of the file, nothing is copied until the scene is changed
+// Every array is checked to have the expected element size, be 16 byte aligned and fit inside the file, and each type's arrays to hold the same count
+// The indices inside them are trusted though (mesh vertex indices, BVH child and primitive indices aren't range-checked), so it should only ever come from write_scene_cache
+bool load_scene_cache(std::string path, Scene& scene, glm::ivec2& windowSize, glm::ivec2& viewingSize)
+{
+	std::shared_ptr<MappedFile> mapping(new MappedFile());
+	if (!mapping->Open(path))
+	{
+		std::cout << "Cannot open scene cache " << path << std::endl;
+		return false;
+	};
+
+	const uint8_t* data = mapping->GetData();
+	size_t fileSize = mapping->GetSize();
+
+	// Checks the header describes this version of the format
+	SceneCacheHeader header;
+	if (fileSize < sizeof(header))
+	{
+		std::cout << path << " is too small to be a scene cache" << std::endl;
+		return false;
+	};
+	std::char_traits<char>::copy((char*)&header, (const char*)data, sizeof(header));
+
+	if (std::char_traits<char>::compare(header.mMagic, "RTSCENE", 8) != 0 || header.mVersion != kSceneCacheVersion)
+	{
+		std::cout << path << " is not a version " << kSceneCacheVersion << " scene cache, rebuild it with --convert-scene" << std::endl;
+		return false;
+	};
+
+	// Checks it holds the arrays this scene expects, and every one fits inside the file
+	// Each type's arrays run from its typeStarts entry up to the next type's
+	std::vector<PrimitiveArrayBase*> sceneArrays;
+	size_t typeStarts[kShapeTypeCount + 1];
+	for (int type = 0; type < kShapeTypeCount; type++)
+	{
+		typeStarts[type] = sceneArrays.size();
+		std::vector<PrimitiveArrayBase*> typeArrays = scene.GetArrays((ShapeType)type);
+		sceneArrays.insert(sceneArrays.end(), typeArrays.begin(), typeArrays.end());
+	};
+	typeStarts[kShapeTypeCount] = sceneArrays.size();
+	std::vector<PrimitiveArrayBase*> poolArrays = scene.GetMeshPoolArrays();
+	sceneArrays.insert(sceneArrays.end(), poolArrays.begin(), poolArrays.end());
+	bool valid = header.mArrayCount == sceneArrays.size() + 2;
+	for (size_t i = 0; valid && i < header.mArrayCount; i++)
+	{
+		uint64_t offset = header.mArrayOffsets[i];
+		uint64_t count = header.mArrayCounts[i];
+		uint32_t elementSize = header.mElementSizes[i];
+		size_t expectedSize = i < sceneArrays.size() ? sceneArrays[i]->GetElementSize() : i == sceneArrays.size() ? sizeof(BVHNode) : sizeof(int);
+
+		valid = elementSize == expectedSize && offset % 16 == 0 && offset <= fileSize && count <= (fileSize - offset) / elementSize;
+	};
+
+	// Every array of a type has to hold one element per shape, checked before the scene is pointed at any of them
+	for (int type = 0; valid && type < kShapeTypeCount; type++)
+	{
+		for (size_t i = typeStarts[type]; valid && i < typeStarts[type + 1]; i++)
+		{
+			valid = header.mArrayCounts[i] == header.mArrayCounts[typeStarts[type]];
+		};
+	};
+	if (!valid)
+	{
+		std::cout << path << " is truncated or corrupt" << std::endl;
+		return false;
+	};
+
+	// Settings
+	scene.SetLightDirection(glm::vec3(header.mLightDirection[0], header.mLightDirection[1], header.mLightDirection[2]));
+	windowSize = glm::ivec2(header.mWindowSize[0], header.mWindowSize[1]);
+	viewingSize = glm::ivec2(header.mViewingSize[0], header.mViewingSize[1]);
+
+	// Points every shape array and mesh pool at its place in the mapping, which the scene keeps alive
+	for (size_t i = 0; i < sceneArrays.size(); i++)
+	{
+		sceneArrays[i]->ViewRaw(data + header.mArrayOffsets[i], (size_t)header.mArrayCounts[i]);
+	};
+	scene.SetBacking(mapping);
+
+	// The BVH is used straight from the mapping too
+	size_t nodeArray = sceneArrays.size();
+	int nodeCount = (int)header.mArrayCounts[nodeArray];
+	size_t primCount = (size_t)header.mArrayCounts[nodeArray + 1];
+	scene.ClearPrebuiltBVH();
+	if (nodeCount > 0 && primCount == scene.GetShapeCount())
+	{
+		scene.SetPrebuiltBVH((const BVHNode*)(data + header.mArrayOffsets[nodeArray]), nodeCount, (const int*)(data + header.mArrayOffsets[nodeArray + 1]));
+	};
+
+	return true;
+};
+
+
+// Writes a scene file with an even mix of every shape type, randomly placed in front of the camera
+bool write_random_scene_file(std::string path, int shapeCount, glm::ivec2 windowSize, std::mt19937& generator)
+{
+	std::ofstream file(path);
+	if (!file)
+	{
+		return false;
+	};
+
+	std::uniform_int_distribution<int> xDistribution(0, windowSize.x);
+	std::uniform_int_distribution<int> yDistribution(0, windowSize.y);
+	std::uniform_int_distribution<int> zDistribution(20, 500);
+	std::uniform_int_distribution<int> sizeDistribution(2, 20);
+	std::uniform_int_distribution<int> colourDistribution(0, 255);
+
+	file << "light 1 -1 -1\nwindow " << windowSize.x << " " << windowSize.y << "\n";
+	for (int i = 0; i < shapeCount; i++)
+	{
+		int x = xDistribution(generator), y = yDistribution(generator), z = zDistribution(generator);
+		int size = sizeDistribution(generator);
+		int r = colourDistribution(generator), g = colourDistribution(generator), b = colourDistribution(generator);
+
+		switch (i % 4)
+		{
+		case 0:
+			file << "sphere " << x << " " << y << " " << z << " " << size;
+			break;
+		case 1:
+			file << "rectangle " << x << " " << y << " " << z << " " << size * 2 << " " << size;
+			break;
+		case 2:
+			file << "circle " << x << " " << y << " " << z << " " << size;
+			break;
+		case 3:
+			file << "triangle " << z << " " << x << " " << y << " " << x + size << " " << y << " " << x << " " << y + size;
+			break;
+		};
+		file << " " << r << " " << g << " " << b << "\n";
+	};
+
+	return (bool)file;
+};
+
+
+// Writes every span recorded so far as Chrome trace-event JSON, one timeline per thread, with each span's counter growth as its args
+// Threads must not be recording while this runs
+bool write_profile_trace(std::string path)
+{
+#ifdef RAYTRACER_PROFILE
+	std::ofstream file(path);
+	if (!file)
+	{
+		std::cout << "Can't open " << path << " for writing" << std::endl;
+		return false;
+	};
+
+	const char* countNames[kProfileCounterCount] = { "rays", "box_tests", "primitive_tests", "hits", "ray_generation_us", "traversal_us", "shading_us" };
+	// Times in the trace are in microseconds
+	bool countIsTime[kProfileCounterCount] = { false, false, false, false, true, true, true };
+
+	std::lock_guard<std::mutex> lock(gProfileLogsMutex);
+	file << "{\"traceEvents\":[";
+	bool firstEvent = true;
+	for (const std::unique_ptr<ProfileThreadLog>& log : gProfileLogs)
+	{
+		for (const ProfileEvent& event : log->mEvents)
+		{
+			file << (firstEvent ? "\n" : ",\n");
+			file << "{\"name\":\"" << event.mName << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << log->mThreadIndex;
+			file << ",\"ts\":" << event.mStartNs / 1000.0 << ",\"dur\":" << event.mDurationNs / 1000.0 << ",\"args\":{";
+
+			// Only counters that moved are written
+			bool firstCount = true;
+			for (int i = 0; i < kProfileCounterCount; i++)
+			{
+				if (event.mCounts[i] != 0)
+				{
+					file << (firstCount ? "" : ",") << "\"" << countNames[i] << "\":";
+					if (countIsTime[i])
+					{
+						file << event.mCounts[i] / 1000.0;
+					}
+					else
+					{
+						file << event.mCounts[i];
+					};
+					firstCount = false;
+				};
+			};
+			file << "}}";
+			firstEvent = false;
+		};
+	};
+	file << "\n]}" << std::endl;
+
+	if (!file)
+	{
+		std::cout << "Failed writing " << path << std::endl;
+		return false;
+	};
+
+	std::cout << "Wrote profile trace to " << path << std::endl;
+	return true;
+#else
+	std::cout << "Profiling isn't built in, define RAYTRACER_PROFILE to write " << path << std::endl;
+	return false;
+#endif
+};
+
+
+// What each pixel of a heatmap measures
+enum class HeatmapMetric
+{
+	Tests,	// Ray-shape intersection tests made for the pixel
+	Steps,	// BVH nodes visited for the pixel
+	Time	// Nanoseconds TraceRay took for the pixel
+};
+
+
+// Gets a path with a 4 digit number put before its extension, such as frame0012.png for frame.png and 12, for numbering frames of an image sequence
+std::string get_numbered_path(std::string path, int number)
+{
+	char digits[16];
+	std::snprintf(digits, sizeof(digits), "%04d", number);
+
+	// Only a dot after the last folder separator starts an extension
+	size_t extensionStart = path.find_last_of('.');
+	size_t folderEnd = path.find_last_of("/\\");
+	if (extensionStart == std::string::npos || (folderEnd != std::string::npos && extensionStart < folderEnd))
+	{
+		extensionStart = path.size();
+	};
+
+	return path.substr(0, extensionStart) + digits + path.substr(extensionStart);
+};
+
+
+// Writes one float per pixel as a greyscale PFM (rows of size.x, top row first in values), readable by most HDR image tools
+// PFM stores the bottom row first, little-endian floats are marked by the negative scale
+bool write_float_image(std::string path, const float* values, glm::ivec2 size)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+	{
+		std::cout << "Can't open " << path << " for writing" << std::endl;
+		return false;
+	};
+
+	file << "Pf\n" << size.x << " " << size.y << "\n-1.0\n";
+	for (int y = size.y - 1; y >= 0; y--)
+	{
+		file.write((const char*)(values + (size_t)y * size.x), sizeof(float) * size.x);
+	};
+
+	if (!file)
+	{
+		std::cout << "Failed writing " << path << std::endl;
+		return false;
+	};
+
+	return true;
+};
+
+
+// Gets the false colour for a heat from 0 to 1, going black, blue, cyan, green, yellow then red
+// Heats above 1 are white, so pixels beyond the colour scale stand out
+glm::vec3 get_heat_colour(float heat)
+{
+	const int stopCount = 6;
+	glm::vec3 stops[stopCount] = { glm::vec3(0, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 1), glm::vec3(0, 1, 0), glm::vec3(1, 1, 0), glm::vec3(1, 0, 0) };
+
+	if (heat > 1)
+	{
+		return glm::vec3(1, 1, 1);
+	};
+
+	float position = std::max(heat, 0.0f) * (stopCount - 1);
+	int stop = std::min((int)position, stopCount - 2);
+
+	return glm::mix(stops[stop], stops[stop + 1], position - stop);
+};
+
+
+// Traces the frame a ray at a time on this thread (so times aren't disturbed by other workers) measuring what each pixel cost
+// The framebuffer is filled with the false-coloured metric (see get_heat_colour) and saved as pathPrefix.png
+// The raw metric goes to pathPrefix.pfm, and each shape type's share of the tests to pathPrefix_<type>.pfm when RAYTRACER_COUNT_TESTS counts them
+// The colour scale tops out at the 99.9th percentile, so a few extreme pixels can't flatten the rest
+bool write_heatmap(const Camera& camera, const RayTracer& rayTracer, glm::ivec2 windowSize, HeatmapMetric metric, std::string pathPrefix)
+{
+	const char* typeNames[kShapeTypeCount] = { "sphere", "rectangle", "circle", "triangle", "mesh" };
+	const char* metricUnits[3] = { "tests", "steps", "ns" };
+	size_t pixelCount = (size_t)windowSize.x * windowSize.y;
+
+	std::vector<float> values(pixelCount);
+	std::vector<float> typeTests[kShapeTypeCount];
+	for (int type = 0; type < kShapeTypeCount; type++)
+	{
+		typeTests[type].resize(pixelCount);
+	};
+
+	for (int y = 0; y < windowSize.y; y++)
+	{
+		for (int x = 0; x < windowSize.x; x++)
+		{
+			Ray ray = camera.GetRay(glm::ivec2(x, y));
+
+			// Reads the counters either side of the trace
+			uint64_t testsBefore[kShapeTypeCount];
+			std::copy(gIntersectionTestCounts, gIntersectionTestCounts + kShapeTypeCount, testsBefore);
+			uint64_t stepsBefore = gTraversalStepCount;
+
+			auto start = std::chrono::high_resolution_clock::now();
+			rayTracer.TraceRay(ray);
+			auto end = std::chrono::high_resolution_clock::now();
+
+			size_t pixel = (size_t)y * windowSize.x + x;
+			uint64_t tests = 0;
+			for (int type = 0; type < kShapeTypeCount; type++)
+			{
+				typeTests[type][pixel] = (float)(gIntersectionTestCounts[type] - testsBefore[type]);
+				tests += gIntersectionTestCounts[type] - testsBefore[type];
+			};
+
+			switch (metric)
+			{
+			case HeatmapMetric::Tests:
+				values[pixel] = (float)tests;
+				break;
+			case HeatmapMetric::Steps:
+				values[pixel] = (float)(gTraversalStepCount - stepsBefore);
+				break;
+			case HeatmapMetric::Time:
+				values[pixel] = (float)std::chrono::duration<double, std::nano>(end - start).count();
+				break;
+			};
+		};
+	};
+
+	// Gets the top of the colour scale
+	std::vector<float> sorted(values);
+	size_t percentile = std::min(pixelCount - 1, pixelCount * 999 / 1000);
+	std::nth_element(sorted.begin(), sorted.begin() + percentile, sorted.end());
+	float scale = std::max(sorted[percentile], 1e-6f);
+
+	uint32_t* framebuffer = MCG::GetFramebuffer();
+	double total = 0;
+	float highest = 0;
+	for (size_t pixel = 0; pixel < pixelCount; pixel++)
+	{
+		framebuffer[pixel] = MCG::PackColour(get_heat_colour(values[pixel] / scale));
+		total += values[pixel];
+		highest = std::max(highest, values[pixel]);
+	};
+
+	std::cout << "Heatmap of " << metricUnits[(int)metric] << " per pixel: mean " << total / pixelCount << ", highest " << highest << ", colour scale 0 to " << scale << std::endl;
+
+	bool written = MCG::SaveImage(pathPrefix + ".png") && write_float_image(pathPrefix + ".pfm", values.data(), windowSize);
+	if (!kCountsIntersectionTests)
+	{
+		return written;
+	};
+
+	// Breaks the tests down by shape type
+	double allTests = 0;
+	double typeTotals[kShapeTypeCount];
+	for (int type = 0; type < kShapeTypeCount; type++)
+	{
+		typeTotals[type] = 0;
+		for (float tests : typeTests[type])
+		{
+			typeTotals[type] += tests;
+		};
+		allTests += typeTotals[type];
+	};
+	for (int type = 0; type < kShapeTypeCount; type++)
+	{
+		std::cout << " " << typeNames[type] << " tests: " << typeTotals[type] << " (" << (allTests > 0 ? typeTotals[type] * 100 / allTests : 0) << "%)" << std::endl;
+	};
+
+	for (int type = 0; type < kShapeTypeCount && written; type++)
+	{
+		written = write_float_image(pathPrefix + "_" + typeNames[type] + ".pfm", typeTests[type].data(), windowSize);
+	};
+
+	return written;
+};
+
+
+// Writes an OBJ file of a bumpy square grid of quads, gridSize quads along each side, with every corner shared
+bool write_grid_obj_file(std::string path, int gridSize)
+{
+	std::ofstream file(path);
+	if (!file)
+	{
+		return false;
+	};
+
+	file << "# " << gridSize << "x" << gridSize << " grid\no grid\n";
+	for (int y = 0; y <= gridSize; y++)
+	{
+		for (int x = 0; x <= gridSize; x++)
+		{
+			float u = (float)x / gridSize * 2 - 1;
+			float v = (float)y / gridSize * 2 - 1;
+			file << "v " << u << " " << v << " " << 0.1f * std::sin(u * 12) * std::cos(v * 9) << "\n";
+		};
+	};
+	for (int y = 0; y < gridSize; y++)
+	{
+		for (int x = 0; x < gridSize; x++)
+		{
+			int corner = y * (gridSize + 1) + x + 1;
+			file << "f " << corner << " " << corner + 1 << " " << corner + gridSize + 2 << " " << corner + gridSize + 1 << "\n";
+		};
+	};
+
+	return (bool)file;
+};
+
+
+// Gets position vector from user
+glm::vec3 get_pos_from_user()
+{
+	int xPos, yPos, zPos;
+
+	std::cout << "Enter position (3D): ";
+	std::cin >> xPos >> yPos >> zPos;
+
+	glm::vec3 pos(xPos, yPos, zPos);
+
+	return pos;
+};
+
+
+// Gets 2D position vector from user
+glm::vec2 get_2d_pos_from_user()
+{
+	int xPos, yPos;
+
+	std::cout << "Enter position (2D): ";
+	std::cin >> xPos >> yPos;
+
+	glm::vec2 pos(xPos, yPos);
+
+	return pos;
+};
+
+
+// Gets z coordinate from user
+int get_z_from_user()
+{
+	int z;
+
+	std::cout << "Enter z coordinate: ";
+	std::cin >> z;
+
+	return z;
+};
+
+
+// Gets colour vector from user
+glm::vec3 get_colour_from_user()
+{
+	int r, g, b;
+
+	std::cout << "Enter colour: ";
+	std::cin >> r >> g >> b;
+
+	glm::vec3 colour((float)r / 255, (float)g / 255, (float)b / 255);
+
+	return colour;
+};
+
+
+// Gets radius from user
+int get_radius_from_user()
+{
+	int radius;
+
+	std::cout << "Enter radius: ";
+	std::cin >> radius;
+
+	return radius;
+};
+
+
+// Gets width value from user
+int get_width_from_user()
+{
+	int width;
+
+	std::cout << "Enter width: ";
+	std::cin >> width;
+
+	return width;
+};
+
+
+// Gets height value from user
+int get_height_from_user()
+{
+	int height;
+
+	std::cout << "Enter height: ";
+	std::cin >> height;
+
+	return height;
+};
+
+
+// Gets light direction vector from user
+glm::vec3 get_light_direction_from_user()
+{
+	float x, y, z;
+
+	std::cout << "Enter light direction vector: ";
+	std::cin >> x >> y >> z;
+
+	glm::vec3 direction(x, y, z);
+
+	return direction;
+};
+
+
+// Adds an even mix of every shape type, randomly placed in front of the camera
+void add_random_shapes(Scene& scene, int shapeCount, glm::ivec2 windowSize, std::mt19937& generator)
+{
+	std::uniform_real_distribution<float> xDistribution(0.0f, (float)windowSize.x);
+	std::uniform_real_distribution<float> yDistribution(0.0f, (float)windowSize.y);
+	std::uniform_real_distribution<float> zDistribution(20.0f, 500.0f);
+	std::uniform_real_distribution<float> sizeDistribution(2.0f, 20.0f);
+	std::uniform_real_distribution<float> colourDistribution(0.0f, 1.0f);
+
+	// Makes room for every shape in one allocation, the types take turns in ShapeType order
+	size_t shapeCounts[kShapeTypeCount] = {};
+	for (int i = 0; i < shapeCount; i++)
+	{
+		shapeCounts[i % 4]++;
+	};
+	scene.ReserveShapes(shapeCounts);
+
+	for (int i = 0; i < shapeCount; i++)
+	{
+		glm::vec3 pos(xDistribution(generator), yDistribution(generator), zDistribution(generator));
+		float size = sizeDistribution(generator);
+		glm::vec3 colour(colourDistribution(generator), colourDistribution(generator), colourDistribution(generator));
+
+		switch (i % 4)
+		{
+		case 0:
+			scene.AddSphere(pos, size, colour);
+			break;
+		case 1:
+			scene.AddRectangle(pos, size * 2, size, colour);
+			break;
+		case 2:
+			scene.AddCircle(pos, size, colour);
+			break;
+		case 3:
+			scene.AddTriangle(pos.z, glm::vec2(pos.x, pos.y), glm::vec2(pos.x + size, pos.y), glm::vec2(pos.x, pos.y + size), colour);
+			break;
+		};
+	};
+};
+
+
+// Adds layers of 2D shapes stacked one behind another, each an even mix of rectangles, circles and triangles sized so a layer covers about a sixth of the view
+void add_layered_shapes(Scene& scene, int layerCount, int shapesPerLayer, glm::ivec2 windowSize, std::mt19937& generator)
+{
+	// Sizes the average shape (about as big as two squares of its size) for the cover wanted
+	float size = std::sqrt((float)windowSize.x * windowSize.y / 6.0f / (2.0f * shapesPerLayer));
+
+	std::uniform_real_distribution<float> xDistribution(0.0f, (float)windowSize.x);
+	std::uniform_real_distribution<float> yDistribution(0.0f, (float)windowSize.y);
+	std::uniform_real_distribution<float> sizeDistribution(size * 0.5f, size * 1.5f);
+	std::uniform_real_distribution<float> colourDistribution(0.0f, 1.0f);
+
+	size_t shapeCounts[kShapeTypeCount] = {};
+	for (int i = 0; i < shapesPerLayer; i++)
+	{
+		shapeCounts[1 + i % 3] += layerCount;
+	};
+	scene.ReserveShapes(shapeCounts);
+
+	for (int layer = 0; layer < layerCount; layer++)
+	{
+		// Spreads the layers over the same depths add_random_shapes uses
+		float z = 20.0f + 480.0f * layer / layerCount;
+
+		for (int i = 0; i < shapesPerLayer; i++)
+		{
+			glm::vec3 pos(xDistribution(generator), yDistribution(generator), z);
+			float shapeSize = sizeDistribution(generator);
+			glm::vec3 colour(colourDistribution(generator), colourDistribution(generator), colourDistribution(generator));
+
+			switch (i % 3)
+			{
+			case 0:
+				scene.AddRectangle(pos, shapeSize * 2, shapeSize, colour);
+				break;
+			case 1:
+				scene.AddCircle(pos, shapeSize, colour);
+				break;
+			case 2:
+				scene.AddTriangle(pos.z, glm::vec2(pos.x, pos.y), glm::vec2(pos.x + shapeSize * 2, pos.y), glm::vec2(pos.x, pos.y + shapeSize * 2), colour);
+				break;
+			};
+		};
+	};
+};
+
+
+// Adds similar-sized spheres filling the same space add_random_shapes uses, either spread evenly or bunched into a few clusters
+// Sphere radii are scaled to the count, so about as much of the view is covered however many there are
+void add_particle_spheres(Scene& scene, int sphereCount, bool clustered, glm::ivec2 windowSize, std::mt19937& generator)
+{
+	glm::vec3 spaceMin(0.0f, 0.0f, 20.0f);
+	glm::vec3 spaceMax((float)windowSize.x, (float)windowSize.y, 500.0f);
+	glm::vec3 spaceSize = spaceMax - spaceMin;
+	float radius = 0.25f * std::cbrt(spaceSize.x * spaceSize.y * spaceSize.z / sphereCount);
+
+	std::uniform_real_distribution<float> unitDistribution(0.0f, 1.0f);
+	std::uniform_real_distribution<float> radiusDistribution(radius * 0.8f, radius * 1.2f);
+	std::normal_distribution<float> clusterDistribution(0.0f, 1.0f);
+
+	// Clusters are spread through the space, each about a twentieth of its size across
+	const int clusterCount = 16;
+	glm::vec3 clusterCentres[clusterCount];
+	for (int i = 0; i < clusterCount; i++)
+	{
+		float x = unitDistribution(generator);
+		float y = unitDistribution(generator);
+		float z = unitDistribution(generator);
+		clusterCentres[i] = spaceMin + spaceSize * glm::vec3(x, y, z);
+	};
+
+	size_t shapeCounts[kShapeTypeCount] = {};
+	shapeCounts[(int)ShapeType::Sphere] = sphereCount;
+	scene.ReserveShapes(shapeCounts);
+
+	for (int i = 0; i < sphereCount; i++)
+	{
+		float x = clustered ? clusterDistribution(generator) : unitDistribution(generator);
+		float y = clustered ? clusterDistribution(generator) : unitDistribution(generator);
+		float z = clustered ? clusterDistribution(generator) : unitDistribution(generator);
+		glm::vec3 centre = clustered ? clusterCentres[i % clusterCount] + spaceSize * 0.05f * glm::vec3(x, y, z) : spaceMin + spaceSize * glm::vec3(x, y, z);
+		glm::vec3 colour(unitDistribution(generator), unitDistribution(generator), unitDistribution(generator));
+
+		scene.AddSphere(centre, radiusDistribution(generator), colour);
+	};
+};
+
+
+// Kinds of procedurally generated scene the benchmark suite renders
+enum class SceneMix
+{
+	Spheres,	// Only spheres
+	Flat,	// Only the 2D shapes, rectangles, circles and triangles
+	Mixed,	// An even mix of every shape type, as add_random_shapes makes
+	Dense,	// Large shapes of every type packed into the middle of the view, overlapping heavily
+	Sparse	// Small shapes of every type scattered far into the view
+};
+
+
+// Adds shapeCount randomly placed shapes of the given mix in front of the camera
+void add_generated_shapes(Scene& scene, SceneMix mix, int shapeCount, glm::ivec2 windowSize, std::mt19937& generator)
+{
+	if (mix == SceneMix::Mixed)
+	{
+		add_random_shapes(scene, shapeCount, windowSize, generator);
+		return;
+	};
+
+	// Gets the area and depth shapes are placed in, and how big they are
+	glm::vec2 areaMin(0, 0);
+	glm::vec2 areaMax(windowSize);
+	float farZ = 500.0f;
+	float minSize = 2.0f;
+	float maxSize = 20.0f;
+	if (mix == SceneMix::Dense)
+	{
+		areaMin = glm::vec2(windowSize) * 0.375f;
+		areaMax = glm::vec2(windowSize) * 0.625f;
+		farZ = 120.0f;
+		minSize = 10.0f;
+		maxSize = 40.0f;
+	}
+	else if (mix == SceneMix::Sparse)
+	{
+		farZ = 5000.0f;
+		maxSize = 5.0f;
+	};
+
+	std::uniform_real_distribution<float> xDistribution(areaMin.x, areaMax.x);
+	std::uniform_real_distribution<float> yDistribution(areaMin.y, areaMax.y);
+	std::uniform_real_distribution<float> zDistribution(20.0f, farZ);
+	std::uniform_real_distribution<float> sizeDistribution(minSize, maxSize);
+	std::uniform_real_distribution<float> colourDistribution(0.0f, 1.0f);
+
+	// Picks the shape type in turn from the types the mix has, numbered in ShapeType order
+	auto getShapeKind = [mix](int i)
+	{
+		return mix == SceneMix::Spheres ? 0 : mix == SceneMix::Flat ? 1 + i % 3 : i % 4;
+	};
+
+	// Makes room for every shape in one allocation
+	size_t shapeCounts[kShapeTypeCount] = {};
+	for (int i = 0; i < shapeCount; i++)
+	{
+		shapeCounts[getShapeKind(i)]++;
+	};
+	scene.ReserveShapes(shapeCounts);
+
+	for (int i = 0; i < shapeCount; i++)
+	{
+		glm::vec3 pos(xDistribution(generator), yDistribution(generator), zDistribution(generator));
+		float size = sizeDistribution(generator);
+		glm::vec3 colour(colourDistribution(generator), colourDistribution(generator), colourDistribution(generator));
+
+		int shapeKind = getShapeKind(i);
+		switch (shapeKind)
+		{
+		case 0:
+			scene.AddSphere(pos, size, colour);
+			break;
+		case 1:
+			scene.AddRectangle(pos, size * 2, size, colour);
+			break;
+		case 2:
+			scene.AddCircle(pos, size, colour);
+			break;
+		case 3:
+			scene.AddTriangle(pos.z, glm::vec2(pos.x, pos.y), glm::vec2(pos.x + size, pos.y), glm::vec2(pos.x, pos.y + size), colour);
+			break;
+		};
+	};
+};
+
+
+// Returns the most memory the process has had resident at once so far, in bytes
+size_t get_peak_memory_usage()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return 0;
+	};
+
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+	{
+		return 0;
+	};
+
+#ifdef __APPLE__
+	return (size_t)usage.ru_maxrss;
+#else
+	// Linux gives kilobytes
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+};
+
+
+// Stores the colours benchmarks hand to keep_traced_colours
+volatile float gTracedColourSink = 0;
+
+// Keeps a benchmark's traced colours alive, so the tracing can't be optimised away
+void keep_traced_colours(glm::vec3 colourSum)
+{
+	gTracedColourSink = colourSum.x + colourSum.y + colourSum.z;
+};
+
+
+// Formats a count per ray for a benchmark's table, or says it wasn't counted when the counter isn't built in
+std::string format_count_per_ray(bool counted, double countPerRay)
+{
+	if (!counted)
+	{
+		return "not counted";
+	};
+
+	std::ostringstream text;
+	text << countPerRay;
+
+	return text.str();
+};
+
+
+// Times tracing a frame with the linear scan and with the BVH over increasing shape counts
+// Prints the time per ray for each and the first shape count where the BVH wins
+int run_bvh_benchmark()
+{
+	// Uses the normal camera, but only traces every fourth pixel in each direction to keep the large linear runs short
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+	int pixelStep = 4;
+	Camera camera(windowSize, viewingSize);
+
+	// Fixed seed so every run measures the same scenes
+	std::mt19937 generator(1234);
+
+	// The linear scan stops being timed once a frame takes longer than this
+	double linearBudgetSeconds = 2.0;
+	bool linearTimed = true;
+	int crossover = -1;
+
+	std::cout << "shapes, linear ns/ray, bvh ns/ray, bvh build ms, bvh nodes" << std::endl;
+
+	for (int shapeCount = 1; shapeCount <= 65536; shapeCount *= 2)
+	{
+		Scene scene(glm::vec3(1, -1, -1));
+		add_random_shapes(scene, shapeCount, windowSize, generator);
+
+		RayTracer rayTracer;
+		auto buildStart = std::chrono::high_resolution_clock::now();
+		rayTracer.SetScene(std::move(scene));
+		auto buildEnd = std::chrono::high_resolution_clock::now();
+		double buildMs = std::chrono::duration<double, std::milli>(buildEnd - buildStart).count();
+
+		// Traces the same rays with each mode
+		double nsPerRay[2] = { -1, -1 };
+		AccelerationMode modes[2] = { AccelerationMode::Linear, AccelerationMode::BVH };
+		for (int m = 0; m < 2; m++)
+		{
+			if (modes[m] == AccelerationMode::Linear && !linearTimed)
+			{
+				continue;
+			};
+
+			rayTracer.SetAccelerationMode(modes[m]);
+			glm::vec3 colourSum(0, 0, 0);
+			int rayCount = 0;
+
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int x = 0; x < windowSize.x; x += pixelStep)
+			{
+				for (int y = 0; y < windowSize.y; y += pixelStep)
+				{
+					colourSum += rayTracer.TraceRay(camera.GetRay(glm::ivec2(x, y)));
+					rayCount++;
+				};
+			};
+			auto end = std::chrono::high_resolution_clock::now();
+			keep_traced_colours(colourSum);
+
+			double seconds = std::chrono::duration<double>(end - start).count();
+			nsPerRay[m] = seconds * 1e9 / rayCount;
+
+			if (modes[m] == AccelerationMode::Linear && seconds > linearBudgetSeconds)
+			{
+				linearTimed = false;
+			};
+		};
+
+		// Records the first size where the BVH beats the linear scan
+		if (crossover == -1 && nsPerRay[0] >= 0 && nsPerRay[1] < nsPerRay[0])
+		{
+			crossover = shapeCount;
+		};
+
+		std::cout << shapeCount << ", " << nsPerRay[0] << ", " << nsPerRay[1] << ", " << buildMs << ", " << rayTracer.GetBVHNodeCount() << std::endl;
+	};
+
+	if (crossover != -1)
+	{
+		std::cout << "BVH is faster from " << crossover << " shapes" << std::endl;
+	}
+	else
+	{
+		std::cout << "BVH was never faster" << std::endl;
+	};
+
+	return 0;
+};
+
+
+// Counts the heap allocations made while tracing a full frame with each acceleration mode
+// Returns non-zero if the trace loop allocated at all
+int run_allocation_benchmark()
 {
-	std::cout << vec.x << ", " << vec.y << ", " << vec.z << std::endl;
+	if (!kCountsHeapAllocations)
+	{
+		std::cout << "Allocation counting isn't built in, define RAYTRACER_COUNT_ALLOCATIONS to run --bench-alloc" << std::endl;
+		return 1;
+	};
+
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+	Camera camera(windowSize, viewingSize);
+
+	// Builds a fixed scene
+	std::mt19937 generator(1234);
+	Scene scene(glm::vec3(1, -1, -1));
+	add_random_shapes(scene, 1000, windowSize, generator);
+
+	RayTracer rayTracer;
+	rayTracer.SetScene(std::move(scene));
+
+	std::cout << "mode, rays, heap allocations" << std::endl;
+
+	long long totalAllocations = 0;
+	AccelerationMode modes[4] = { AccelerationMode::Linear, AccelerationMode::BVH, AccelerationMode::Layers, AccelerationMode::Grid };
+	const char* modeNames[4] = { "linear", "bvh", "layers", "grid" };
+	for (int m = 0; m < 4; m++)
+	{
+		rayTracer.SetAccelerationMode(modes[m]);
+		glm::vec3 colourSum(0, 0, 0);
+
+		// Only the trace loop is counted
+		long long allocationsBefore = gHeapAllocationCount;
+		for (int x = 0; x < windowSize.x; x++)
+		{
+			for (int y = 0; y < windowSize.y; y++)
+			{
+				colourSum += rayTracer.TraceRay(camera.GetRay(glm::ivec2(x, y)));
+			};
+		};
+		long long allocations = gHeapAllocationCount - allocationsBefore;
+		keep_traced_colours(colourSum);
+
+		std::cout << modeNames[m] << ", " << windowSize.x * windowSize.y << ", " << allocations << std::endl;
+		totalAllocations += allocations;
+	};
+
+	return totalAllocations == 0 ? 0 : 1;
+};
+
+
+// Times rendering the same frame with 1 to N worker threads, N being the number of hardware threads
+// Prints the frame time, speedup over one thread and parallel efficiency for each
+int run_thread_scaling_benchmark()
+{
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+	Camera camera(windowSize, viewingSize);
+
+	// Builds a fixed scene big enough that tracing dominates
+	std::mt19937 generator(1234);
+	Scene scene(glm::vec3(1, -1, -1));
+	add_random_shapes(scene, 4096, windowSize, generator);
+
+	RayTracer rayTracer;
+	rayTracer.SetScene(std::move(scene));
+
+	// Tests powers of two, plus the full thread count if that isn't one
+	int maxThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+	std::vector<int> threadCounts;
+	for (int threads = 1; threads < maxThreads; threads *= 2)
+	{
+		threadCounts.push_back(threads);
+	};
+	threadCounts.push_back(maxThreads);
+
+	std::cout << "threads, frame ms, speedup, efficiency" << std::endl;
+
+	std::vector<uint32_t> framebuffer(windowSize.x * windowSize.y);
+	double singleThreadMs = 0;
+	for (int threads : threadCounts)
+	{
+		TileRenderer tileRenderer(threads);
+
+		// Keeps the best of a few frames to reduce noise
+		double bestMs = std::numeric_limits<double>::max();
+		for (int run = 0; run < 3; run++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			tileRenderer.Render(camera, rayTracer, windowSize, framebuffer.data());
+			auto end = std::chrono::high_resolution_clock::now();
+
+			bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(end - start).count());
+		};
+
+		if (threads == 1)
+		{
+			singleThreadMs = bestMs;
+		};
+
+		double speedup = singleThreadMs / bestMs;
+		std::cout << threads << ", " << bestMs << ", " << speedup << ", " << speedup / threads << std::endl;
+	};
+
+	return 0;
+};
+
+
+// Writes a one million shape scene file, then times loading it and freeing the loaded scene, counting the allocations loading makes
+// Allocations are only counted in builds with RAYTRACER_COUNT_ALLOCATIONS defined
+int run_scene_load_benchmark()
+{
+	std::string path = "bench_scene_1m.scene";
+	int shapeCount = 1000000;
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+
+	std::mt19937 generator(1234);
+	if (!write_random_scene_file(path, shapeCount, windowSize, generator))
+	{
+		std::cout << "Cannot write " << path << std::endl;
+		return 1;
+	};
+
+	// Keeps the best of a few loads to reduce noise
+	double bestMs = std::numeric_limits<double>::max();
+	double bestFreeMs = std::numeric_limits<double>::max();
+	long long allocations = 0;
+	size_t loadedShapes = 0;
+	for (int run = 0; run < 3; run++)
+	{
+		std::unique_ptr<Scene> scene(new Scene(glm::vec3(1, -1, -1)));
+
+		long long allocationsBefore = gHeapAllocationCount;
+		auto start = std::chrono::high_resolution_clock::now();
+		bool loaded = load_scene_file(path, *scene, windowSize, viewingSize);
+		auto end = std::chrono::high_resolution_clock::now();
+		allocations = gHeapAllocationCount - allocationsBefore;
+
+		if (!loaded)
+		{
+			return 1;
+		};
+		bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(end - start).count());
+		loadedShapes = scene->GetShapeCount();
+
+		auto freeStart = std::chrono::high_resolution_clock::now();
+		scene.reset();
+		auto freeEnd = std::chrono::high_resolution_clock::now();
+		bestFreeMs = std::min(bestFreeMs, std::chrono::duration<double, std::milli>(freeEnd - freeStart).count());
+	};
+
+	std::remove(path.c_str());
+
+	std::cout << "shapes, load ms, load allocations, free ms" << std::endl;
+	std::cout << loadedShapes << ", " << bestMs << ", " << (kCountsHeapAllocations ? std::to_string(allocations) : "not counted") << ", " << bestFreeMs << std::endl;
+	return 0;
+};
+
+
+// Times starting up (loading and getting a BVH ready) from text scene files and from scene caches of increasing size
+int run_startup_benchmark()
+{
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+	std::string textPath = "bench_startup.scene";
+	std::string cachePath = "bench_startup.rtscene";
+
+	std::cout << "shapes, text load + build ms, cache load ms" << std::endl;
+
+	for (int shapeCount = 10000; shapeCount <= 1000000; shapeCount *= 10)
+	{
+		// Writes the text scene and converts it to a cache
+		std::mt19937 generator(1234);
+		Scene sourceScene(glm::vec3(1, -1, -1));
+		if (!write_random_scene_file(textPath, shapeCount, windowSize, generator) ||
+			!load_scene_file(textPath, sourceScene, windowSize, viewingSize) ||
+			!write_scene_cache(cachePath, sourceScene, windowSize, viewingSize))
+		{
+			return 1;
+		};
+
+		// Times each way of getting a scene ready to trace
+		double startupMs[2];
+		for (int useCache = 0; useCache < 2; useCache++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+
+			Scene scene(glm::vec3(1, -1, -1));
+			bool loaded = useCache ? load_scene_cache(cachePath, scene, windowSize, viewingSize) : load_scene_file(textPath, scene, windowSize, viewingSize);
+			RayTracer rayTracer;
+			rayTracer.SetScene(std::move(scene));
+
+			auto end = std::chrono::high_resolution_clock::now();
+
+			if (!loaded)
+			{
+				return 1;
+			};
+			startupMs[useCache] = std::chrono::duration<double, std::milli>(end - start).count();
+		};
+
+		std::cout << shapeCount << ", " << startupMs[0] << ", " << startupMs[1] << std::endl;
+	};
+
+	std::remove(textPath.c_str());
+	std::remove(cachePath.c_str());
+	return 0;
+};
+
+
+// Times a linear trace over the scene's arrays against the same shapes stored the old way, as a std::list of heap allocated BaseShape objects
+// Returns non-zero if the two layouts ever trace a different colour
+int run_layout_benchmark()
+{
+	// Only traces every sixteenth pixel in each direction to keep the largest scene short
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+	int pixelStep = 16;
+	Camera camera(windowSize, viewingSize);
+
+	std::cout << "shapes, list ns/ray, arrays ns/ray, speedup" << std::endl;
+
+	int mismatches = 0;
+	for (int shapeCount = 1000; shapeCount <= 100000; shapeCount *= 10)
+	{
+		// Fixed seed so every run measures the same scenes
+		std::mt19937 generator(1234);
+		Scene scene(glm::vec3(1, -1, -1));
+		add_random_shapes(scene, shapeCount, windowSize, generator);
+
+		RayTracer rayTracer;
+		rayTracer.SetScene(std::move(scene));
+		rayTracer.SetAccelerationMode(AccelerationMode::Linear);
+
+		// Copies the shapes into the old layout, in the same order the linear scan tests them
+		std::list<BaseShape*> shapeList;
+		const SphereBlock& spheres = rayTracer.GetScene().GetSpheres();
+		for (size_t i = 0; i < spheres.size(); i++)
+		{
+			shapeList.push_back(new Sphere(spheres.GetCentre(i), spheres.mRadius[i], spheres.mColour[i]));
+		};
+		const RectangleBlock& rectangles = rayTracer.GetScene().GetRectangles();
+		for (size_t i = 0; i < rectangles.size(); i++)
+		{
+			shapeList.push_back(new Rectangle(rectangles.GetCentre(i), rectangles.mWidth[i], rectangles.mHeight[i], rectangles.mColour[i]));
+		};
+		const CircleBlock& circles = rayTracer.GetScene().GetCircles();
+		for (size_t i = 0; i < circles.size(); i++)
+		{
+			shapeList.push_back(new Circle(circles.GetCentre(i), circles.mRadius[i], circles.mColour[i]));
+		};
+		const TriangleBlock& triangles = rayTracer.GetScene().GetTriangles();
+		for (size_t i = 0; i < triangles.size(); i++)
+		{
+			shapeList.push_back(new Triangle(triangles.GetPointA(i), triangles.GetPointB(i), triangles.GetPointC(i), triangles.mColour[i]));
+		};
+
+		// Traces the same rays with each layout
+		std::vector<glm::vec3> listColours, arrayColours;
+		double nsPerRay[2];
+		for (int layout = 0; layout < 2; layout++)
+		{
+			std::vector<glm::vec3>& colours = layout == 0 ? listColours : arrayColours;
+			colours.reserve((windowSize.x / pixelStep + 1) * (windowSize.y / pixelStep + 1));
+
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int x = 0; x < windowSize.x; x += pixelStep)
+			{
+				for (int y = 0; y < windowSize.y; y += pixelStep)
+				{
+					Ray ray = camera.GetRay(glm::ivec2(x, y));
+
+					if (layout == 1)
+					{
+						colours.push_back(rayTracer.TraceRay(ray));
+						continue;
+					};
+
+					// The old closest hit search, one virtual call per shape
+					HitData closestHit{ false, glm::vec3(0, 0, 0) };
+					const BaseShape* closestShape = nullptr;
+					for (const BaseShape* currentShape : shapeList)
+					{
+						HitData currentHitData = currentShape->GetHit(ray);
+						if (currentHitData.mHit && (!closestHit.mHit || get_length_between_points(currentHitData.mFirstIntersection, ray.GetOrigin()) < get_length_between_points(closestHit.mFirstIntersection, ray.GetOrigin())))
+						{
+							closestHit = currentHitData;
+							closestShape = currentShape;
+						};
+					};
+
+					colours.push_back(closestShape ? closestShape->GetColour() * closestShape->GetColourModifier(rayTracer.GetScene().GetLightDirection(), closestHit.mFirstIntersection) : glm::vec3(0, 0, 0));
+				};
+			};
+			auto end = std::chrono::high_resolution_clock::now();
+
+			nsPerRay[layout] = std::chrono::duration<double, std::nano>(end - start).count() / colours.size();
+		};
+
+		for (size_t i = 0; i < listColours.size(); i++)
+		{
+			if (listColours[i] != arrayColours[i])
+			{
+				mismatches++;
+			};
+		};
+
+		for (BaseShape* shape : shapeList)
+		{
+			delete shape;
+		};
+
+		std::cout << shapeCount << ", " << nsPerRay[0] << ", " << nsPerRay[1] << ", " << nsPerRay[0] / nsPerRay[1] << std::endl;
+	};
+
+	if (mismatches > 0)
+	{
+		std::cout << mismatches << " rays traced a different colour with each layout" << std::endl;
+		return 1;
+	};
+
+	return 0;
+};
+
+
+// Times a linear trace of sphere-only scenes with every sphere kernel this CPU supports
+// Returns non-zero if any kernel traces a different colour from the scalar one
+int run_sphere_kernel_benchmark()
+{
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+	int pixelStep = 8;
+	Camera camera(windowSize, viewingSize);
+
+	// Tests each level up to the widest supported one
+	SimdLevel supportedLevel = gSphereKernelLevel;
+	std::vector<SimdLevel> levels;
+	levels.push_back(SimdLevel::Scalar);
+	if (supportedLevel != SimdLevel::Scalar)
+	{
+		levels.push_back(SimdLevel::SSE41);
+	};
+	if (supportedLevel == SimdLevel::AVX2)
+	{
+		levels.push_back(SimdLevel::AVX2);
+	};
+	const char* levelNames[3] = { "scalar", "sse4.1", "avx2" };
+
+	std::cout << "spheres";
+	for (SimdLevel level : levels)
+	{
+		std::cout << ", " << levelNames[(int)level] << " ns/ray";
+	};
+	std::cout << ", best speedup" << std::endl;
+
+	int mismatches = 0;
+	for (int sphereCount = 1000; sphereCount <= 100000; sphereCount *= 10)
+	{
+		// Fixed seed so every run measures the same scenes
+		std::mt19937 generator(1234);
+		std::uniform_real_distribution<float> xDistribution(0.0f, (float)windowSize.x);
+		std::uniform_real_distribution<float> yDistribution(0.0f, (float)windowSize.y);
+		std::uniform_real_distribution<float> zDistribution(20.0f, 500.0f);
+		std::uniform_real_distribution<float> sizeDistribution(2.0f, 20.0f);
+		std::uniform_real_distribution<float> colourDistribution(0.0f, 1.0f);
+
+		Scene scene(glm::vec3(1, -1, -1));
+		for (int i = 0; i < sphereCount; i++)
+		{
+			glm::vec3 pos(xDistribution(generator), yDistribution(generator), zDistribution(generator));
+			float size = sizeDistribution(generator);
+			scene.AddSphere(pos, size, glm::vec3(colourDistribution(generator), colourDistribution(generator), colourDistribution(generator)));
+		};
+
+		RayTracer rayTracer;
+		rayTracer.SetScene(std::move(scene));
+		rayTracer.SetAccelerationMode(AccelerationMode::Linear);
+
+		// Traces the same rays with each kernel
+		std::vector<glm::vec3> scalarColours;
+		std::vector<double> nsPerRay;
+		for (SimdLevel level : levels)
+		{
+			gSphereKernelLevel = level;
+			std::vector<glm::vec3> colours;
+			colours.reserve((windowSize.x / pixelStep + 1) * (windowSize.y / pixelStep + 1));
+
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int x = 0; x < windowSize.x; x += pixelStep)
+			{
+				for (int y = 0; y < windowSize.y; y += pixelStep)
+				{
+					colours.push_back(rayTracer.TraceRay(camera.GetRay(glm::ivec2(x, y))));
+				};
+			};
+			auto end = std::chrono::high_resolution_clock::now();
+
+			nsPerRay.push_back(std::chrono::duration<double, std::nano>(end - start).count() / colours.size());
+
+			if (level == SimdLevel::Scalar)
+			{
+				scalarColours = colours;
+			}
+			else
+			{
+				for (size_t i = 0; i < colours.size(); i++)
+				{
+					if (colours[i] != scalarColours[i])
+					{
+						mismatches++;
+					};
+				};
+			};
+		};
+		gSphereKernelLevel = supportedLevel;
+
+		std::cout << sphereCount;
+		for (double time : nsPerRay)
+		{
+			std::cout << ", " << time;
+		};
+		std::cout << ", " << nsPerRay.front() / nsPerRay.back() << std::endl;
+	};
+
+	if (mismatches > 0)
+	{
+		std::cout << mismatches << " rays traced a different colour with a SIMD kernel" << std::endl;
+		return 1;
+	};
+
+	return 0;
+};
+
+
+// Times the triangle test over random triangles, then checks it is watertight by aiming rays at the shared edges and corners of a bumpy mesh
+// Returns non-zero if any of those rays slips through the mesh
+int run_triangle_benchmark()
+{
+	// Fixed seed so every run measures the same triangles
+	std::mt19937 generator(1234);
+	std::uniform_real_distribution<float> unitDistribution(-1.0f, 1.0f);
+
+	// Random triangles in a box in front of random ray origins
+	int triangleCount = 4096;
+	int rayCount = 1024;
+	std::vector<glm::vec3> corners(triangleCount * 3);
+	for (glm::vec3& corner : corners)
+	{
+		corner = glm::vec3(unitDistribution(generator), unitDistribution(generator), unitDistribution(generator)) * 10.0f;
+	};
+	std::vector<TriangleRay> rays;
+	for (int i = 0; i < rayCount; i++)
+	{
+		glm::vec3 origin = glm::vec3(unitDistribution(generator), unitDistribution(generator), -3.0f) * 10.0f;
+		glm::vec3 target = glm::vec3(unitDistribution(generator), unitDistribution(generator), unitDistribution(generator)) * 10.0f;
+		rays.push_back(get_triangle_ray(Ray(origin, glm::normalize(target - origin))));
+	};
+
+	// Tests every ray against every triangle
+	long long hitCount = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (const TriangleRay& ray : rays)
+	{
+		for (int i = 0; i < triangleCount; i++)
+		{
+			if (get_ray_triangle_distance(ray, corners[i * 3], corners[i * 3 + 1], corners[i * 3 + 2]) > 0)
+			{
+				hitCount++;
+			};
+		};
+	};
+	auto end = std::chrono::high_resolution_clock::now();
+
+	long long testCount = (long long)triangleCount * rayCount;
+	std::cout << "tests, ns/test, hit rate" << std::endl;
+	std::cout << testCount << ", " << std::chrono::duration<double, std::nano>(end - start).count() / testCount << ", " << (double)hitCount / testCount << std::endl;
+
+	// Builds a tilted, jittered grid of quads, each split into two triangles, with every corner shared
+	int gridSize = 64;
+	std::vector<glm::vec3> vertices;
+	for (int y = 0; y <= gridSize; y++)
+	{
+		for (int x = 0; x <= gridSize; x++)
+		{
+			float jitterX = unitDistribution(generator) * 0.3f;
+			float jitterY = unitDistribution(generator) * 0.3f;
+			vertices.push_back(glm::vec3(x + jitterX, y + jitterY, 0.37f * x + 0.21f * y + unitDistribution(generator) * 0.2f));
+		};
+	};
+	auto getVertex = [&](int x, int y)
+	{
+		return vertices[y * (gridSize + 1) + x];
+	};
+
+	// Aims rays at random points on quad edges (including the diagonal) and at quad corners, from random points in front of the mesh
+	// Only the triangles of the quads around the target are tested, which always includes every triangle touching it
+	std::uniform_int_distribution<int> quadDistribution(1, gridSize - 2);
+	std::uniform_real_distribution<float> edgeDistribution(0.0f, 1.0f);
+	std::uniform_int_distribution<int> edgeChoice(0, 4);
+	int raysPerKind = 200000;
+	int leaks[2] = { 0, 0 };
+	for (int kind = 0; kind < 2; kind++)
+	{
+		for (int i = 0; i < raysPerKind; i++)
+		{
+			int quadX = quadDistribution(generator);
+			int quadY = quadDistribution(generator);
+
+			// Picks the point to aim at
+			glm::vec3 target;
+			if (kind == 0)
+			{
+				glm::ivec2 edges[5][2] = {
+					{ glm::ivec2(0, 0), glm::ivec2(1, 0) }, { glm::ivec2(1, 0), glm::ivec2(1, 1) }, { glm::ivec2(1, 1), glm::ivec2(0, 1) },
+					{ glm::ivec2(0, 1), glm::ivec2(0, 0) }, { glm::ivec2(0, 0), glm::ivec2(1, 1) }
+				};
+				int edge = edgeChoice(generator);
+				glm::vec3 edgeStart = getVertex(quadX + edges[edge][0].x, quadY + edges[edge][0].y);
+				glm::vec3 edgeEnd = getVertex(quadX + edges[edge][1].x, quadY + edges[edge][1].y);
+				target = edgeStart + (edgeEnd - edgeStart) * edgeDistribution(generator);
+			}
+			else
+			{
+				target = getVertex(quadX, quadY);
+			};
+
+			// Rays stay steep enough that no part of the mesh folds over another from where they start, so every miss is a crack
+			glm::vec3 origin = target + glm::vec3(unitDistribution(generator) * 5.0f, unitDistribution(generator) * 5.0f, -40.0f);
+			TriangleRay ray = get_triangle_ray(Ray(origin, glm::normalize(target - origin)));
+
+			bool hit = false;
+			for (int y = quadY - 1; y <= quadY + 1 && !hit; y++)
+			{
+				for (int x = quadX - 1; x <= quadX + 1 && !hit; x++)
+				{
+					hit = get_ray_triangle_distance(ray, getVertex(x, y), getVertex(x + 1, y), getVertex(x + 1, y + 1)) > 0 ||
+						get_ray_triangle_distance(ray, getVertex(x, y), getVertex(x + 1, y + 1), getVertex(x, y + 1)) > 0;
+				};
+			};
+
+			if (!hit)
+			{
+				leaks[kind]++;
+			};
+		};
+	};
+
+	std::cout << "edge rays, edge leaks, corner rays, corner leaks" << std::endl;
+	std::cout << raysPerKind << ", " << leaks[0] << ", " << raysPerKind << ", " << leaks[1] << std::endl;
+
+	return leaks[0] + leaks[1] == 0 ? 0 : 1;
+};
+
+
+// Loads a generated million triangle OBJ file as a mesh, printing the load time and memory per triangle, then traces it
+// The same triangles are also traced as separate triangle shapes, returns non-zero if the two ever disagree on which rays hit
+int run_mesh_benchmark()
+{
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+	int pixelStep = 2;
+	Camera camera(windowSize, viewingSize);
+	std::string path = "bench_mesh.obj";
+
+	// 708 x 708 quads is just over a million triangles
+	if (!write_grid_obj_file(path, 708))
+	{
+		std::cout << "Cannot write " << path << std::endl;
+		return 1;
+	};
+
+	// Loading includes building the mesh's BVH
+	Scene scene(glm::vec3(1, -1, -1));
+	auto loadStart = std::chrono::high_resolution_clock::now();
+	bool loaded = load_obj_file(path, scene, glm::vec3(320, 240, 400), 400, glm::vec3(1, 1, 1));
+	auto loadEnd = std::chrono::high_resolution_clock::now();
+	std::remove(path.c_str());
+	if (!loaded)
+	{
+		return 1;
+	};
+
+	// Adds up everything the mesh is stored in
+	const MeshBlock& meshes = scene.GetMeshes();
+	size_t triangleCount = meshes.mTriangleCount[0];
+	size_t vertexCount = meshes.mVertexCount[0];
+	size_t meshBytes = 0;
+	std::vector<const PrimitiveArrayBase*> meshArrays = ((const Scene&)scene).GetArrays(ShapeType::Mesh);
+	std::vector<const PrimitiveArrayBase*> poolArrays = ((const Scene&)scene).GetMeshPoolArrays();
+	meshArrays.insert(meshArrays.end(), poolArrays.begin(), poolArrays.end());
+	for (const PrimitiveArrayBase* array : meshArrays)
+	{
+		meshBytes += array->GetCount() * array->GetElementSize();
+	};
+
+	// The same triangles as separate shapes
+	Scene triangleScene(glm::vec3(1, -1, -1));
+	for (uint32_t i = 0; i < triangleCount; i++)
+	{
+		glm::vec3 pointA, pointB, pointC;
+		meshes.GetTriangle(0, i, pointA, pointB, pointC);
+		triangleScene.AddTriangle(pointA, pointB, pointC, glm::vec3(1, 1, 1));
+	};
+
+	// Traces the same rays through each
+	std::vector<bool> hits[2];
+	double nsPerRay[2];
+	size_t triangleBytes = 0;
+	for (int useTriangles = 0; useTriangles < 2; useTriangles++)
+	{
+		RayTracer rayTracer;
+		rayTracer.SetScene(std::move(useTriangles ? triangleScene : scene));
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int x = 0; x < windowSize.x; x += pixelStep)
+		{
+			for (int y = 0; y < windowSize.y; y += pixelStep)
+			{
+				hits[useTriangles].push_back(rayTracer.TraceRay(camera.GetRay(glm::ivec2(x, y))) != glm::vec3(0, 0, 0));
+			};
+		};
+		auto end = std::chrono::high_resolution_clock::now();
+
+		nsPerRay[useTriangles] = std::chrono::duration<double, std::nano>(end - start).count() / hits[useTriangles].size();
+
+		// Separate triangles are stored in the triangle arrays and the scene's BVH
+		if (useTriangles)
+		{
+			for (const PrimitiveArrayBase* array : rayTracer.GetScene().GetArrays(ShapeType::Triangle))
+			{
+				triangleBytes += array->GetCount() * array->GetElementSize();
+			};
+			triangleBytes += rayTracer.GetBVHNodeCount() * sizeof(BVHNode) + triangleCount * sizeof(int);
+		};
+	};
+
+	std::cout << "triangles, vertices, load ms, mesh bytes/triangle, separate triangle bytes/triangle, mesh ns/ray, separate triangles ns/ray" << std::endl;
+	std::cout << triangleCount << ", " << vertexCount << ", " << std::chrono::duration<double, std::milli>(loadEnd - loadStart).count() << ", " << (double)meshBytes / triangleCount << ", " << (double)triangleBytes / triangleCount << ", " << nsPerRay[0] << ", " << nsPerRay[1] << std::endl;
+
+	int mismatches = 0;
+	for (size_t i = 0; i < hits[0].size(); i++)
+	{
+		if (hits[0][i] != hits[1][i])
+		{
+			mismatches++;
+		};
+	};
+	if (mismatches > 0)
+	{
+		std::cout << mismatches << " rays hit only one of the mesh and the separate triangles" << std::endl;
+		return 1;
+	};
+
+	return 0;
 };
 
 
-// Gets the area of a triangle
-float area_of_triangle(int x1, int y1, int x2, int y2, int x3, int y3)
+// Times rendering the same frame a ray at a time and a packet at a time, on one thread so only the tracing differs
+// Returns non-zero if the two frames differ by a single pixel
+int run_packet_benchmark()
 {
-	return abs((x1 * (y2 - y3) + x2 * (y3 - y1) + x3 * (y1 - y2)) / 2.0);
-};
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+	Camera camera(windowSize, viewingSize);
+	int rayCount = windowSize.x * windowSize.y;
 
+	// Fixed seed so every run measures the same scenes
+	std::mt19937 generator(1234);
 
-// Checks if point is inside triangle
-bool point_inside_triangle(int x1, int y1, int x2, int y2, int x3, int y3, int px, int py)
-{
-	// Get area of ABC
-	float A = area_of_triangle(x1, y1, x2, y2, x3, y3);
+	std::cout << "packet kernels: " << (gPacketKernelLevel == SimdLevel::AVX2 ? "avx2" : "scalar") << std::endl;
+	std::cout << "shapes, single ns/ray, packet ns/ray, speedup, mismatched pixels" << std::endl;
 
-	// Get area o PBC
-	float A1 = area_of_triangle(px, py, x2, y2, x3, y3);
+	int totalMismatches = 0;
+	for (int shapeCount = 1000; shapeCount <= 100000; shapeCount *= 10)
+	{
+		Scene scene(glm::vec3(1, -1, -1));
+		add_random_shapes(scene, shapeCount, windowSize, generator);
 
-	// Get area o PAC
-	float A2 = area_of_triangle(x1, y1, px, py, x3, y3);
+		RayTracer rayTracer;
+		rayTracer.SetScene(std::move(scene));
 
-	// Get area o PAB
-	float A3 = area_of_triangle(x1, y1, x2, y2, px, py);
+		// Renders the frame both ways, keeping the best of a few frames to reduce noise
+		std::vector<uint32_t> framebuffers[2] = { std::vector<uint32_t>(rayCount), std::vector<uint32_t>(rayCount) };
+		double nsPerRay[2];
+		TileRenderer tileRenderer(1);
+		for (int usePackets = 0; usePackets < 2; usePackets++)
+		{
+			tileRenderer.SetPacketTracing(usePackets == 1);
 
-	// Checks if sum of A1, A2 and A3 is same as A
-	return (A == A1 + A2 + A3);
-};
+			double bestSeconds = std::numeric_limits<double>::max();
+			for (int run = 0; run < 3; run++)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				tileRenderer.Render(camera, rayTracer, windowSize, framebuffers[usePackets].data());
+				auto end = std::chrono::high_resolution_clock::now();
 
+				bestSeconds = std::min(bestSeconds, std::chrono::duration<double>(end - start).count());
+			};
+			nsPerRay[usePackets] = bestSeconds * 1e9 / rayCount;
+		};
 
-// Gets if 3D ray intersects 2D triangle
-HitData get_ray_triangle_intersection(Ray ray, float z, glm::vec2 pointA, glm::vec2 pointB, glm::vec2 pointC)
-{
-	// Gets point at correct z coordinate
-	glm::vec3 intersect_point = get_point_at_z(ray, z);
+		int mismatches = 0;
+		for (int i = 0; i < rayCount; i++)
+		{
+			if (framebuffers[0][i] != framebuffers[1][i])
+			{
+				mismatches++;
+			};
+		};
+		totalMismatches += mismatches;
+
+		std::cout << shapeCount << ", " << nsPerRay[0] << ", " << nsPerRay[1] << ", " << nsPerRay[0] / nsPerRay[1] << ", " << mismatches << std::endl;
+	};
 
-	// Test if point is inside triangle
-	if (point_inside_triangle(pointA.x, pointA.y, pointB.x, pointB.y, pointC.x, pointC.y, intersect_point.x, intersect_point.y))
+	if (totalMismatches != 0)
 	{
-		// Return collision detected
-		return HitData{ true, intersect_point };
+		std::cout << totalMismatches << " pixels differ between single ray and packet tracing" << std::endl;
+		return 1;
 	};
 
-	// Return no collision detected
-	return HitData{ false, intersect_point };
+	return 0;
 };
 
 
-// Gets if 3D ray intersects 2D rectangle
-HitData get_ray_rectangle_intersection(Ray ray, glm::vec3 rect_pos, float rect_width, float rect_height)
+// Renders generated scenes of every mix and size at each resolution, printing the results as JSON so runs can be compared from release to release
+// Every case has its own fixed seed, so the same scenes are generated every run
+// Frames are rendered on every hardware thread the way main renders them, rays per second comes from the best of 3 frames
+// The frame is then traced again a ray at a time on this thread to count intersection tests, the time per test comes from that trace
+// Peak memory is for the whole process so far, so it only grows from case to case
+int run_benchmark_suite(const std::vector<glm::ivec2>& resolutions)
 {
-	// Gets point at correct z coordinate
-	glm::vec3 intersect_point = get_point_at_z(ray, rect_pos.z);
+	const int mixCount = 5;
+	SceneMix mixes[mixCount] = { SceneMix::Spheres, SceneMix::Flat, SceneMix::Mixed, SceneMix::Dense, SceneMix::Sparse };
+	const char* mixNames[mixCount] = { "spheres", "flat", "mixed", "dense", "sparse" };
+	const int sizeCount = 3;
+	int shapeCounts[sizeCount] = { 1000, 10000, 100000 };
+	const char* levelNames[3] = { "scalar", "sse4.1", "avx2" };
+
+	TileRenderer tileRenderer(std::thread::hardware_concurrency());
+
+	std::cout << "{" << std::endl;
+	std::cout << "\t\"threads\": " << tileRenderer.GetThreadCount() << "," << std::endl;
+	std::cout << "\t\"sphere_kernel\": \"" << levelNames[(int)gSphereKernelLevel] << "\"," << std::endl;
+	std::cout << "\t\"packet_kernel\": \"" << levelNames[(int)gPacketKernelLevel] << "\"," << std::endl;
+	std::cout << "\t\"cases\": [";
+
+	bool firstCase = true;
+	for (glm::ivec2 windowSize : resolutions)
+	{
+		// Keeps the same view as main's default window, a little wider than the window
+		glm::ivec2 viewingSize(windowSize.x * 21 / 20, windowSize.y * 21 / 20);
+		Camera camera(windowSize, viewingSize);
+		int rayCount = windowSize.x * windowSize.y;
+		std::vector<uint32_t> framebuffer(rayCount);
 
-	// Gets rectangle boundaries
-	float left_bd = rect_pos.x - (rect_width / 2);
-	float right_bd = rect_pos.x + (rect_width / 2);
-	float upper_bd = rect_pos.y - (rect_height / 2);
-	float lower_bd = rect_pos.y + (rect_height / 2);
+		for (int m = 0; m < mixCount; m++)
+		{
+			for (int s = 0; s < sizeCount; s++)
+			{
+				uint32_t seed = 1234 + m * sizeCount + s;
+				std::mt19937 generator(seed);
+				Scene scene(glm::vec3(1, -1, -1));
+				add_generated_shapes(scene, mixes[m], shapeCounts[s], windowSize, generator);
+
+				RayTracer rayTracer;
+				auto buildStart = std::chrono::high_resolution_clock::now();
+				rayTracer.SetScene(std::move(scene));
+				auto buildEnd = std::chrono::high_resolution_clock::now();
+				double buildMs = std::chrono::duration<double, std::milli>(buildEnd - buildStart).count();
+
+				// Keeps the best of a few frames to reduce noise
+				double bestSeconds = std::numeric_limits<double>::max();
+				for (int run = 0; run < 3; run++)
+				{
+					auto start = std::chrono::high_resolution_clock::now();
+					tileRenderer.Render(camera, rayTracer, windowSize, framebuffer.data());
+					auto end = std::chrono::high_resolution_clock::now();
 
-	// Checks if point is inside boundaries
-	if (intersect_point.x >= left_bd && intersect_point.x <= right_bd && intersect_point.y >= upper_bd && intersect_point.y <= lower_bd)
-	{
-		// Returns collision detected
-		return HitData{ true, intersect_point };
+					bestSeconds = std::min(bestSeconds, std::chrono::duration<double>(end - start).count());
+				};
+
+				// Traces the frame again on this thread, where the test counter can be read (the tests aren't reported unless RAYTRACER_COUNT_TESTS counts them)
+				glm::vec3 colourSum(0, 0, 0);
+				uint64_t testsBefore = get_intersection_test_count();
+				auto traceStart = std::chrono::high_resolution_clock::now();
+				for (int y = 0; y < windowSize.y; y++)
+				{
+					for (int x = 0; x < windowSize.x; x++)
+					{
+						colourSum += rayTracer.TraceRay(camera.GetRay(glm::ivec2(x, y)));
+					};
+				};
+				auto traceEnd = std::chrono::high_resolution_clock::now();
+				uint64_t tests = get_intersection_test_count() - testsBefore;
+				keep_traced_colours(colourSum);
+
+				double traceNs = std::chrono::duration<double, std::nano>(traceEnd - traceStart).count();
+
+				std::cout << (firstCase ? "" : ",") << std::endl;
+				std::cout << "\t\t{ \"scene\": \"" << mixNames[m] << "\", \"shapes\": " << shapeCounts[s] << ", \"seed\": " << seed;
+				std::cout << ", \"width\": " << windowSize.x << ", \"height\": " << windowSize.y;
+				std::cout << ", \"build_ms\": " << buildMs << ", \"frame_ms\": " << bestSeconds * 1000 << ", \"rays_per_second\": " << rayCount / bestSeconds;
+				if (kCountsIntersectionTests)
+				{
+					std::cout << ", \"tests_per_ray\": " << (double)tests / rayCount << ", \"ns_per_test\": " << (tests > 0 ? traceNs / tests : 0);
+				}
+				else
+				{
+					std::cout << ", \"tests_per_ray\": null, \"ns_per_test\": null";
+				};
+				std::cout << ", \"peak_rss_kb\": " << get_peak_memory_usage() / 1024 << " }";
+				firstCase = false;
+			};
+		};
 	};
 
-	// Returns no collision detected
-	return HitData{ false, intersect_point };
+	std::cout << std::endl << "\t]" << std::endl << "}" << std::endl;
+
+	return 0;
 };
 
 
-// Gets if 3D ray intersects 2D circle
-HitData get_ray_circle_intersection(Ray ray, glm::vec3 circle_pos, float circle_radius)
+// Times rendering the same frame without shadows, with shadows, and with shadows but without the last occluder cache, on one thread
+// Prints the time per pixel of each and how many pixels ended up in shadow
+// Returns non-zero if the cache changed a single pixel
+int run_shadow_benchmark()
 {
-	// Gets point at correct z coordinate
-	HitData rect_hitdata = get_ray_rectangle_intersection(ray, circle_pos, circle_radius * 2, circle_radius * 2);
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+	Camera camera(windowSize, viewingSize);
+	int pixelCount = windowSize.x * windowSize.y;
 
-	// Checks if point is inside the circle
-	if (rect_hitdata.mHit && get_length_between_points(rect_hitdata.mFirstIntersection, circle_pos) <= circle_radius)
+	// Fixed seed so every run measures the same scenes
+	std::mt19937 generator(1234);
+
+	std::cout << "shapes, no shadows ns/pixel, shadows ns/pixel, shadows without cache ns/pixel, shadowed pixels, mismatched pixels" << std::endl;
+
+	int totalMismatches = 0;
+	for (int shapeCount = 1000; shapeCount <= 100000; shapeCount *= 10)
 	{
-		// Returns collision detected
-		return rect_hitdata;
+		Scene scene(glm::vec3(1, -1, -1));
+		add_random_shapes(scene, shapeCount, windowSize, generator);
+
+		RayTracer rayTracer;
+		rayTracer.SetScene(std::move(scene));
+		TileRenderer tileRenderer(1);
+
+		// Renders the frame each way, keeping the best of a few frames to reduce noise
+		const int configCount = 3;
+		bool shadows[configCount] = { false, true, true };
+		bool occluderCache[configCount] = { true, true, false };
+		std::vector<uint32_t> framebuffers[configCount];
+		double nsPerPixel[configCount];
+		for (int c = 0; c < configCount; c++)
+		{
+			rayTracer.SetShadows(shadows[c]);
+			gUseOccluderCache = occluderCache[c];
+			framebuffers[c].resize(pixelCount);
+
+			double bestSeconds = std::numeric_limits<double>::max();
+			for (int run = 0; run < 3; run++)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				tileRenderer.Render(camera, rayTracer, windowSize, framebuffers[c].data());
+				auto end = std::chrono::high_resolution_clock::now();
+
+				bestSeconds = std::min(bestSeconds, std::chrono::duration<double>(end - start).count());
+			};
+			nsPerPixel[c] = bestSeconds * 1e9 / pixelCount;
+		};
+		gUseOccluderCache = true;
+
+		// Pixels darkened by shadows differ from the unshadowed frame, the cache mustn't change any
+		int shadowedPixels = 0;
+		int mismatches = 0;
+		for (int i = 0; i < pixelCount; i++)
+		{
+			shadowedPixels += framebuffers[0][i] != framebuffers[1][i];
+			mismatches += framebuffers[1][i] != framebuffers[2][i];
+		};
+		totalMismatches += mismatches;
+
+		std::cout << shapeCount << ", " << nsPerPixel[0] << ", " << nsPerPixel[1] << ", " << nsPerPixel[2] << ", " << shadowedPixels << ", " << mismatches << std::endl;
 	};
 
-	// Returns no collision detected
-	return HitData{ false, glm::vec3(0, 0, 0) };
+	if (totalMismatches != 0)
+	{
+		std::cout << totalMismatches << " pixels differ with and without the occluder cache" << std::endl;
+		return 1;
+	};
+
+	return 0;
 };
 
 
-// Returns 2D position at given z coordinate
-glm::vec3 get_point_at_z(Ray ray, float z)
+// Times tracing stacked layers of 2D shapes (as UI and diagram scenes are made of) with the linear scan, the BVH and the layer index, splitting the same shape count into more or fewer layers
+// Randomly placed shapes, nearly every one on a z of its own, are timed last as the layer index's worst case
+// Prints the time, intersection tests and traversal steps (BVH nodes or layers) per ray, and how many rays' colours differ from the linear scan's
+// Returns non-zero if the layer index gets any ray's colour wrong
+int run_layer_benchmark()
 {
-	// Gets ray values
-	glm::vec3 origin = ray.GetOrigin();
-	glm::vec3 direction = ray.GetDirection();
+	// Uses the normal camera, but only traces every fourth pixel in each direction to keep the linear runs short
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+	int pixelStep = 4;
+	Camera camera(windowSize, viewingSize);
+	int shapeCount = 10000;
 
-	// Gets z travel distance required
-	float travel_distance = z - origin.z;
-	// Gets vector multiplier needed to reach desired z coordinate
-	float vector_multiplier = travel_distance / direction.z;
+	// Fixed seed so every run measures the same scenes
+	std::mt19937 generator(1234);
 
-	// Gets vector at new position
-	glm::vec3 pos_3d = origin + (direction * vector_multiplier);
+	std::cout << "scene, layers, mode, ns/ray, tests/ray, steps/ray, wrong rays" << std::endl;
 
-	// Returns vector
-	return pos_3d;
-};
+	long long totalWrongRays = 0;
+	const int sceneCount = 5;
+	int layerCounts[sceneCount] = { 1, 10, 100, 1000, 0 };
+	for (int s = 0; s < sceneCount; s++)
+	{
+		Scene scene(glm::vec3(1, -1, -1));
+		if (layerCounts[s] > 0)
+		{
+			add_layered_shapes(scene, layerCounts[s], shapeCount / layerCounts[s], windowSize, generator);
+		}
+		else
+		{
+			add_random_shapes(scene, shapeCount, windowSize, generator);
+		};
 
+		RayTracer rayTracer;
+		rayTracer.SetScene(std::move(scene));
+		rayTracer.SetAccelerationMode(AccelerationMode::Layers);
+		int layerCount = rayTracer.GetLayerCount();
+
+		// Traces the same rays with each mode, the linear scan first as the others are checked against it
+		const int modeCount = 3;
+		AccelerationMode modes[modeCount] = { AccelerationMode::Linear, AccelerationMode::BVH, AccelerationMode::Layers };
+		const char* modeNames[modeCount] = { "linear", "bvh", "layers" };
+		std::vector<uint32_t> linearColours;
+		for (int m = 0; m < modeCount; m++)
+		{
+			rayTracer.SetAccelerationMode(modes[m]);
 
-// Gets difference in direction
-float get_direction_difference(glm::vec3 dir1, glm::vec3 dir2)
-{
-	// Normalises vectors
-	glm::vec3 n_dir1 = glm::normalize(dir1);
-	glm::vec3 n_dir2 = glm::normalize(dir2);
+			std::vector<uint32_t> colours;
+			colours.reserve((windowSize.x / pixelStep) * (windowSize.y / pixelStep));
+			uint64_t testsBefore = get_intersection_test_count();
+			uint64_t stepsBefore = gTraversalStepCount;
 
-	// Gets difference between vectors
-	float dif = glm::length(n_dir1 - n_dir2) / 2;
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int y = 0; y < windowSize.y; y += pixelStep)
+			{
+				for (int x = 0; x < windowSize.x; x += pixelStep)
+				{
+					colours.push_back(MCG::PackColour(rayTracer.TraceRay(camera.GetRay(glm::ivec2(x, y)))));
+				};
+			};
+			auto end = std::chrono::high_resolution_clock::now();
 
-	// Returns difference
-	return dif;
-};
+			double rayCount = (double)colours.size();
+			double nsPerRay = std::chrono::duration<double, std::nano>(end - start).count() / rayCount;
+			double testsPerRay = (double)(get_intersection_test_count() - testsBefore) / rayCount;
+			double stepsPerRay = (double)(gTraversalStepCount - stepsBefore) / rayCount;
 
+			long long wrongRays = 0;
+			if (m == 0)
+			{
+				linearColours = colours;
+			}
+			else
+			{
+				for (size_t i = 0; i < colours.size(); i++)
+				{
+					wrongRays += colours[i] != linearColours[i];
+				};
+			};
 
-// Returns normal to the given sphere at given point
-glm::vec3 get_normal_on_sphere(Sphere sphere, glm::vec3 queryPoint)
-{
-	// Get centre of sphere
-	glm::vec3 sphereCentre = sphere.GetPos();
-	// Calculate normal vector
-	glm::vec3 normal = queryPoint - sphereCentre;
+			// The BVH can pick either of two shapes hit at the same point, which layers sharing a z often have, so only the layer index has to match exactly
+			if (modes[m] == AccelerationMode::Layers)
+			{
+				totalWrongRays += wrongRays;
+			};
 
-	// Return normal vector
-	return glm::normalize(normal);
+			std::cout << (layerCounts[s] > 0 ? "layered" : "random") << ", " << layerCount << ", " << modeNames[m] << ", " << nsPerRay << ", " << format_count_per_ray(kCountsIntersectionTests, testsPerRay) << ", " << format_count_per_ray(kCountsTraversalSteps, stepsPerRay) << ", " << wrongRays << std::endl;
+		};
+	};
+
+	if (totalWrongRays != 0)
+	{
+		std::cout << totalWrongRays << " rays differ between the layer index and the linear scan" << std::endl;
+		return 1;
+	};
+
+	return 0;
 };
 
 
-// Checks if the given point is inside the given sphere
-bool check_inside_sphere(Sphere sphere, glm::vec3 queryPoint)
+// Times tracing particle-like scenes of similar-sized spheres, spread evenly or bunched into clusters, with the linear scan, the BVH and the uniform grid
+// Prints the time to build each structure, the time, intersection tests and traversal steps (BVH nodes or grid cells) per ray, and how many rays' colours differ from the linear scan's
+// Returns non-zero if the grid gets any ray's colour wrong
+int run_grid_benchmark()
 {
-	// Gets centre of sphere
-	glm::vec3 sphereCentre = sphere.GetPos();
+	// Uses the normal camera, but only traces every fourth pixel in each direction to keep the linear runs short
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+	int pixelStep = 4;
+	Camera camera(windowSize, viewingSize);
+
+	// Fixed seed so every run measures the same scenes
+	std::mt19937 generator(1234);
 
-	// Gets distance from point to centre
-	int distanceToCentre = glm::length(sphereCentre - queryPoint);
+	std::cout << "spheres, layout, mode, build ms, ns/ray, tests/ray, steps/ray, wrong rays" << std::endl;
 
-	// Checks if distance is less than or equal to radius
-	if (distanceToCentre <= sphere.GetRadius())
+	long long totalWrongRays = 0;
+	for (int sphereCount = 1000; sphereCount <= 100000; sphereCount *= 10)
 	{
-		// Inside sphere
-		return true;
+		for (int clustered = 0; clustered < 2; clustered++)
+		{
+			Scene scene(glm::vec3(1, -1, -1));
+			add_particle_spheres(scene, sphereCount, clustered != 0, windowSize, generator);
+
+			RayTracer rayTracer;
+			auto buildStart = std::chrono::high_resolution_clock::now();
+			rayTracer.SetScene(std::move(scene));
+			auto buildEnd = std::chrono::high_resolution_clock::now();
+			double bvhBuildMs = std::chrono::duration<double, std::milli>(buildEnd - buildStart).count();
+
+			// Traces the same rays with each mode, the linear scan first as the others are checked against it
+			const int modeCount = 3;
+			AccelerationMode modes[modeCount] = { AccelerationMode::Linear, AccelerationMode::BVH, AccelerationMode::Grid };
+			const char* modeNames[modeCount] = { "linear", "bvh", "grid" };
+			std::vector<uint32_t> linearColours;
+			for (int m = 0; m < modeCount; m++)
+			{
+				buildStart = std::chrono::high_resolution_clock::now();
+				rayTracer.SetAccelerationMode(modes[m]);
+				buildEnd = std::chrono::high_resolution_clock::now();
+				double buildMs = modes[m] == AccelerationMode::BVH ? bvhBuildMs : std::chrono::duration<double, std::milli>(buildEnd - buildStart).count();
+
+				std::vector<uint32_t> colours;
+				colours.reserve((windowSize.x / pixelStep) * (windowSize.y / pixelStep));
+				uint64_t testsBefore = get_intersection_test_count();
+				uint64_t stepsBefore = gTraversalStepCount;
+
+				auto start = std::chrono::high_resolution_clock::now();
+				for (int y = 0; y < windowSize.y; y += pixelStep)
+				{
+					for (int x = 0; x < windowSize.x; x += pixelStep)
+					{
+						colours.push_back(MCG::PackColour(rayTracer.TraceRay(camera.GetRay(glm::ivec2(x, y)))));
+					};
+				};
+				auto end = std::chrono::high_resolution_clock::now();
+
+				double rayCount = (double)colours.size();
+				double nsPerRay = std::chrono::duration<double, std::nano>(end - start).count() / rayCount;
+				double testsPerRay = (double)(get_intersection_test_count() - testsBefore) / rayCount;
+				double stepsPerRay = (double)(gTraversalStepCount - stepsBefore) / rayCount;
+
+				long long wrongRays = 0;
+				if (m == 0)
+				{
+					linearColours = colours;
+				}
+				else
+				{
+					for (size_t i = 0; i < colours.size(); i++)
+					{
+						wrongRays += colours[i] != linearColours[i];
+					};
+				};
+				if (modes[m] == AccelerationMode::Grid)
+				{
+					totalWrongRays += wrongRays;
+				};
+
+				std::cout << sphereCount << ", " << (clustered ? "clustered" : "even") << ", " << modeNames[m] << ", " << buildMs << ", " << nsPerRay << ", " << format_count_per_ray(kCountsIntersectionTests, testsPerRay) << ", " << format_count_per_ray(kCountsTraversalSteps, stepsPerRay) << ", " << wrongRays << std::endl;
+			};
+		};
 	};
 
-	// Not inside sphere
-	return false;
+	if (totalWrongRays != 0)
+	{
+		std::cout << totalWrongRays << " rays differ between the grid and the linear scan" << std::endl;
+		return 1;
+	};
+
+	return 0;
 };
 
 
-// Checks if the given point is ahead of the given ray
-bool check_ahead_ray(Ray ray, glm::vec3 queryPoint)
+// Times building the BVH over random scenes of up to a million shapes with each builder, then tracing through the tree it built, across all hardware threads
+// Prints the best build time of a few, the node count, surface area heuristic cost and traversal steps per ray of each tree, the trace time per ray and how many rays' colours differ from the SAH tree's
+// Returns non-zero if the Morton tree gets any ray's colour different from the SAH tree
+int run_bvh_build_benchmark()
 {
-	float margin = glm::length(glm::normalize(ray.GetDirection()) - glm::normalize(queryPoint - ray.GetOrigin()));
+	// Uses the normal camera, but only traces every fourth pixel in each direction to keep the runs over a million shapes short
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+	int pixelStep = 4;
+	Camera camera(windowSize, viewingSize);
 
-	if (margin < 0.001)
+	// Fixed seed so every run measures the same scenes
+	std::mt19937 generator(1234);
+
+	std::cout << "Building on " << std::max((int)std::thread::hardware_concurrency(), 1) << " threads" << std::endl;
+	std::cout << "shapes, builder, build ms, nodes, sah cost, steps/ray, ns/ray, wrong rays" << std::endl;
+
+	long long totalWrongRays = 0;
+	for (int shapeCount = 10000; shapeCount <= 1000000; shapeCount *= 10)
 	{
-		return true;
+		Scene scene(glm::vec3(1, -1, -1));
+		add_random_shapes(scene, shapeCount, windowSize, generator);
+
+		RayTracer rayTracer;
+		rayTracer.SetScene(std::move(scene));
+
+		// Traces the same rays through each builder's tree, SAH first as the Morton tree is checked against it
+		const int builderCount = 2;
+		BVHBuilder builders[builderCount] = { BVHBuilder::SAH, BVHBuilder::Morton };
+		const char* builderNames[builderCount] = { "sah", "morton" };
+		std::vector<uint32_t> sahColours;
+		for (int b = 0; b < builderCount; b++)
+		{
+			// Keeps the best of a few builds, the first also pays for the memory the rest reuse
+			rayTracer.SetBVHBuilder(builders[b]);
+			double bestBuildMs = std::numeric_limits<double>::max();
+			for (int run = 0; run < 3; run++)
+			{
+				BVH bvh;
+				auto buildStart = std::chrono::high_resolution_clock::now();
+				build_scene_bvh(rayTracer.GetScene(), bvh, builders[b]);
+				auto buildEnd = std::chrono::high_resolution_clock::now();
+				bestBuildMs = std::min(bestBuildMs, std::chrono::duration<double, std::milli>(buildEnd - buildStart).count());
+			};
+
+			std::vector<uint32_t> colours;
+			colours.reserve((windowSize.x / pixelStep) * (windowSize.y / pixelStep));
+			uint64_t stepsBefore = gTraversalStepCount;
+
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int y = 0; y < windowSize.y; y += pixelStep)
+			{
+				for (int x = 0; x < windowSize.x; x += pixelStep)
+				{
+					colours.push_back(MCG::PackColour(rayTracer.TraceRay(camera.GetRay(glm::ivec2(x, y)))));
+				};
+			};
+			auto end = std::chrono::high_resolution_clock::now();
+
+			double rayCount = (double)colours.size();
+			double nsPerRay = std::chrono::duration<double, std::nano>(end - start).count() / rayCount;
+			double stepsPerRay = (double)(gTraversalStepCount - stepsBefore) / rayCount;
+
+			long long wrongRays = 0;
+			if (b == 0)
+			{
+				sahColours = colours;
+			}
+			else
+			{
+				for (size_t i = 0; i < colours.size(); i++)
+				{
+					wrongRays += colours[i] != sahColours[i];
+				};
+			};
+			totalWrongRays += wrongRays;
+
+			std::cout << shapeCount << ", " << builderNames[b] << ", " << bestBuildMs << ", " << rayTracer.GetBVHNodeCount() << ", " << rayTracer.GetBVHCost() << ", " << format_count_per_ray(kCountsTraversalSteps, stepsPerRay) << ", " << nsPerRay << ", " << wrongRays << std::endl;
+		};
 	};
 
-	return false;
+	if (totalWrongRays != 0)
+	{
+		std::cout << totalWrongRays << " rays differ between the Morton and SAH trees" << std::endl;
+		return 1;
+	};
+
+	return 0;
 };
 
 
-// 𝒂 = Starting point of the line
-// 𝑷 = Query point
-// 𝒏 = Direction of the line
-// Closest Point = 𝒂 + ((𝑷−𝒂)⋅𝒏)𝒏
-// Return Closest Point
-glm::vec3 get_closest_point_on_line(Ray line, glm::vec3 queryPoint)
+// Times animating a random scene of drifting shapes frame by frame, refitting the BVH each frame (building it again only when the refits make it too slow) against building it again every frame
+// Prints each frame's BVH update time, the BVH's cost (see BVH::GetCost) and trace time per ray with both, and how many rays' colours differ between them
+// Returns non-zero if the refitted BVH gets any ray's colour different from the one built again
+int run_animation_benchmark()
 {
-	// Getting ray data
-	glm::vec3 a = line.GetOrigin();
-	glm::vec3 n = line.GetDirection();
-	glm::vec3 P = queryPoint;
-	
-	// Working out closest point on ray to given point
-	glm::vec3 closestPoint = a + (glm::dot((P - a), n)) * n;
+	// Uses the normal camera, but only traces every fourth pixel in each direction, on one thread
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+	int pixelStep = 4;
+	Camera camera(windowSize, viewingSize);
+	const int shapeCount = 100000;
+	const int frameCount = 40;
+
+	// Makes the same scene twice with a fixed seed, every shape drifting in a straight line at its own speed from the first frame to the last
+	RayTracer rayTracers[2];
+	for (int r = 0; r < 2; r++)
+	{
+		std::mt19937 generator(1234);
+		Scene scene(glm::vec3(1, -1, -1));
+		add_random_shapes(scene, shapeCount, windowSize, generator);
+
+		std::uniform_real_distribution<float> speedDistribution(-4.0f, 4.0f);
+		for (size_t shapeIndex = 0; shapeIndex < scene.GetShapeCount(); shapeIndex++)
+		{
+			size_t typeIndex;
+			ShapeType type = scene.GetShapeType(shapeIndex, typeIndex);
+			glm::vec3 speed(speedDistribution(generator), speedDistribution(generator), speedDistribution(generator) * 0.25f);
+
+			scene.AddKeyframe(type, typeIndex, 0, glm::vec3(0, 0, 0));
+			scene.AddKeyframe(type, typeIndex, (float)(frameCount - 1), speed * (float)(frameCount - 1));
+		};
+
+		rayTracers[r].SetScene(std::move(scene));
+	};
+	rayTracers[1].SetRefitCostLimit(0);
+
+	std::cout << "frame, refit ms, rebuild ms, refit cost, rebuilt cost, refit ns/ray, rebuilt ns/ray, wrong rays" << std::endl;
+
+	long long totalWrongRays = 0;
+	double totalMs[2] = {};
+	int rebuildCount = 0;
+	for (int frame = 0; frame < frameCount; frame++)
+	{
+		double updateMs[2];
+		double nsPerRay[2];
+		std::vector<uint32_t> colours[2];
+		bool rebuilt = false;
+		for (int r = 0; r < 2; r++)
+		{
+			bool frameRebuilt = rayTracers[r].SetAnimationFrame((float)frame);
+			rebuilt = r == 0 ? frameRebuilt : rebuilt;
+			updateMs[r] = rayTracers[r].GetBVHBuildMs();
+
+			colours[r].reserve((windowSize.x / pixelStep) * (windowSize.y / pixelStep));
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int y = 0; y < windowSize.y; y += pixelStep)
+			{
+				for (int x = 0; x < windowSize.x; x += pixelStep)
+				{
+					colours[r].push_back(MCG::PackColour(rayTracers[r].TraceRay(camera.GetRay(glm::ivec2(x, y)))));
+				};
+			};
+			auto end = std::chrono::high_resolution_clock::now();
+
+			nsPerRay[r] = std::chrono::duration<double, std::nano>(end - start).count() / colours[r].size();
+			totalMs[r] += updateMs[r] + std::chrono::duration<double, std::milli>(end - start).count();
+		};
+
+		long long wrongRays = 0;
+		for (size_t i = 0; i < colours[0].size(); i++)
+		{
+			wrongRays += colours[0][i] != colours[1][i];
+		};
+		totalWrongRays += wrongRays;
+		rebuildCount += rebuilt;
+
+		std::cout << frame << ", " << updateMs[0] << (rebuilt ? " (rebuilt)" : "") << ", " << updateMs[1] << ", " << rayTracers[0].GetBVHCost() << ", " << rayTracers[1].GetBVHCost() << ", " << nsPerRay[0] << ", " << nsPerRay[1] << ", " << wrongRays << std::endl;
+	};
+
+	std::cout << "Refitting took " << totalMs[0] << " ms over " << frameCount << " frames (" << rebuildCount << " rebuilds), building every frame took " << totalMs[1] << " ms" << std::endl;
+
+	if (totalWrongRays != 0)
+	{
+		std::cout << totalWrongRays << " rays differ between the refitted and rebuilt BVHs" << std::endl;
+		return 1;
+	};
 
-	// Returns closest point vector
-	return closestPoint;
+	return 0;
 };
 
 
-// 𝒂 = Starting point of the line
-// 𝑷 = Centre of sphere
-// 𝒏 = Direction of the line
-// 𝑥 = Distance from closest point to intersection
-// 𝑑 = Distance from closest point to centre of sphere
-// Returns if hit and first intersection
-HitData get_ray_sphere_intersection(Ray ray, Sphere sphere)
+// Scatters ten thousand instances of a generated hundred thousand triangle mesh, each turned, scaled and coloured at random, then traces them with the BVH and by testing every instance
+// Prints how much the instanced meshes take up against storing every copy's triangles, and the top level BVH's build time and trace time per ray
+// A smaller scene is also traced against the same instances copied out into meshes of their own
+// Returns non-zero if the two ways of tracing the big scene differ on any ray's colour, or the instances and copies differ on more than a few edge rays
+int run_instancing_benchmark()
 {
-	// Get centre and radius of sphere
-	glm::vec3 sphereCentre = sphere.GetPos();
-	int sphereRadius = sphere.GetRadius();
+	// Uses the normal camera, but only traces some of the pixels, on one thread
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+	Camera camera(windowSize, viewingSize);
+	std::string path = "bench_instances.obj";
 
-	// Get ray data
-	glm::vec3 a = ray.GetOrigin();
-	glm::vec3 n = ray.GetDirection();
-	glm::vec3 P = sphereCentre;
+	// Fixed seed so every run measures the same scenes
+	std::mt19937 generator(1234);
+	std::uniform_real_distribution<float> unitDistribution(0.0f, 1.0f);
+
+	// Adds instances of the scene's first mesh, scattered in front of the camera with random turns, sizes and colours
+	// Each is scaled by a size between minSize and maxSize, then each of its axes by between half and one and a half times that, so most aren't scaled evenly
+	auto add_instances = [&](Scene& scene, int instanceCount, float minSize, float maxSize)
+	{
+		for (int i = 0; i < instanceCount; i++)
+		{
+			float angleX = unitDistribution(generator) * 6.2832f;
+			float angleZ = unitDistribution(generator) * 6.2832f;
+			glm::mat3 rotationX(1, 0, 0, 0, std::cos(angleX), std::sin(angleX), 0, -std::sin(angleX), std::cos(angleX));
+			glm::mat3 rotationZ(std::cos(angleZ), std::sin(angleZ), 0, -std::sin(angleZ), std::cos(angleZ), 0, 0, 0, 1);
+			glm::mat3 rotation = rotationZ * rotationX;
+			float size = minSize + unitDistribution(generator) * (maxSize - minSize);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				rotation[axis] *= size * (0.5f + unitDistribution(generator));
+			};
+
+			glm::mat4x3 transform(rotation[0], rotation[1], rotation[2], glm::vec3(unitDistribution(generator) * windowSize.x, unitDistribution(generator) * windowSize.y, 100 + unitDistribution(generator) * 900));
+			scene.AddMeshInstance(0, transform, glm::vec3(unitDistribution(generator), unitDistribution(generator), unitDistribution(generator)));
+		};
+	};
+	// Traces every pixelStep'th pixel in each direction, returning the time per ray
+	auto trace_frame = [&](const RayTracer& rayTracer, int pixelStep, std::vector<uint32_t>& colours)
+	{
+		colours.clear();
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int y = 0; y < windowSize.y; y += pixelStep)
+		{
+			for (int x = 0; x < windowSize.x; x += pixelStep)
+			{
+				colours.push_back(MCG::PackColour(rayTracer.TraceRay(camera.GetRay(glm::ivec2(x, y)))));
+			};
+		};
+		auto end = std::chrono::high_resolution_clock::now();
+
+		return std::chrono::duration<double, std::nano>(end - start).count() / colours.size();
+	};
 
-	// Checks if ray origin is inside sphere, if so, treats as an error and returns no intersection
-	if (check_inside_sphere(sphere, a))
+	// 224 x 224 quads is just over a hundred thousand triangles
+	// The instances are scaled both down and up from the mesh, which is moved out of view behind the camera once they're added
+	const int instanceCount = 10000;
+	if (!write_grid_obj_file(path, 224))
+	{
+		std::cout << "Cannot write " << path << std::endl;
+		return 1;
+	};
+	Scene scene(glm::vec3(1, -1, -1));
+	auto loadStart = std::chrono::high_resolution_clock::now();
+	bool loaded = load_obj_file(path, scene, glm::vec3(0, 0, 0), 100, glm::vec3(1, 1, 1));
+	auto loadEnd = std::chrono::high_resolution_clock::now();
+	std::remove(path.c_str());
+	if (!loaded)
 	{
-		// Ray origin inside sphere
-		return HitData{ false, glm::vec3(0,0,0) };
+		return 1;
 	};
+	add_instances(scene, instanceCount, 0.2f, 0.8f);
+	scene.MoveShape(scene.GetShapeIndex(ShapeType::Mesh, 0), glm::vec3(0, 0, -1000));
 
-	// Gets closest point to sphere centre
-	glm::vec3 closestPoint = get_closest_point_on_line(ray, sphereCentre);
-	// Gets length between closest point and sphere centre
-	float d = glm::length(sphereCentre - closestPoint);
-	int x = sqrt(pow(sphereRadius, 2) - pow(d, 2));
+	// Adds up the per-mesh arrays, which grow with every instance, and the pools, which hold the mesh once
+	size_t instanceBytes = 0, poolBytes = 0;
+	for (const PrimitiveArrayBase* array : ((const Scene&)scene).GetArrays(ShapeType::Mesh))
+	{
+		instanceBytes += array->GetCount() * array->GetElementSize();
+	};
+	for (const PrimitiveArrayBase* array : ((const Scene&)scene).GetMeshPoolArrays())
+	{
+		poolBytes += array->GetCount() * array->GetElementSize();
+	};
+	size_t triangleCount = scene.GetMeshes().mTriangleCount[0];
 
-	// Checks if the closest point is ahead of the ray, if it's not, no intersection
-	if (!check_ahead_ray(ray, closestPoint))
+	RayTracer rayTracer;
+	rayTracer.SetScene(std::move(scene));
+	size_t topLevelBytes = rayTracer.GetBVHNodeCount() * sizeof(BVHNode) + rayTracer.GetScene().GetShapeCount() * sizeof(int);
+
+	// Every instance is tested by the linear mode, so it only traces a few rays
+	std::vector<uint32_t> colours[2];
+	double nsPerRay[2];
+	const AccelerationMode modes[2] = { AccelerationMode::BVH, AccelerationMode::Linear };
+	for (int m = 0; m < 2; m++)
+	{
+		rayTracer.SetAccelerationMode(modes[m]);
+		nsPerRay[m] = trace_frame(rayTracer, 8, colours[m]);
+	};
+	long long wrongRays = 0;
+	for (size_t i = 0; i < colours[0].size(); i++)
 	{
-		// Ray is heading backwards, ignores collision
-		return HitData{ false, glm::vec3(0,0,0) };
+		wrongRays += colours[0][i] != colours[1][i];
 	};
 
-	// Checks if distance is less than or equal to sphere radius
-	if (d <= sphereRadius)
+	std::cout << "instances, triangles per instance, instanced triangles, load ms, top level build ms, instanced MB, separate copies MB, bvh ns/ray, linear ns/ray, wrong rays" << std::endl;
+	std::cout << instanceCount << ", " << triangleCount << ", " << (long long)triangleCount * instanceCount << ", " << std::chrono::duration<double, std::milli>(loadEnd - loadStart).count() << ", " << rayTracer.GetBVHBuildMs() << ", ";
+	std::cout << (instanceBytes + poolBytes + topLevelBytes) / 1048576.0 << ", " << (double)poolBytes * instanceCount / 1048576.0 << ", " << nsPerRay[0] << ", " << nsPerRay[1] << ", " << wrongRays << std::endl;
+
+	// A small mesh's instances against copies of its triangles moved by the same transforms, which only differ where a ray grazes an edge
+	const int smallInstanceCount = 300;
+	if (!write_grid_obj_file(path, 16))
 	{
-		// Valid collision detected
-		// Gets point of intersection
-		glm::vec3 firstIntersection = a + (glm::dot((P - a), n) - x) * n;
+		std::cout << "Cannot write " << path << std::endl;
+		return 1;
+	};
+	Scene instanceScene(glm::vec3(1, -1, -1));
+	loaded = load_obj_file(path, instanceScene, glm::vec3(0, 0, 0), 100, glm::vec3(1, 1, 1));
+	std::remove(path.c_str());
+	if (!loaded)
+	{
+		return 1;
+	};
+	add_instances(instanceScene, smallInstanceCount, 0.3f, 1.2f);
 
-		// Returns collision data
-		return HitData{ true, firstIntersection };
+	Scene copyScene(glm::vec3(1, -1, -1));
+	const MeshBlock& meshes = instanceScene.GetMeshes();
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		for (uint32_t vertex = 0; vertex < meshes.mVertexCount[i]; vertex++)
+		{
+			copyScene.AddMeshVertex(meshes.mTransform[i] * glm::vec4(meshes.GetVertex(meshes.mFirstVertex[i] + vertex), 1.0f));
+		};
+		const uint32_t* corners = meshes.mIndices.data() + (size_t)meshes.mFirstTriangle[i] * 3;
+		for (uint32_t triangle = 0; triangle < meshes.mTriangleCount[i]; triangle++, corners += 3)
+		{
+			copyScene.AddMeshTriangle(corners[0], corners[1], corners[2]);
+		};
+		copyScene.EndMesh(meshes.mColour[i]);
 	};
 
-	// No collision
-	return HitData{ false, glm::vec3(0,0,0) };
-};
+	std::vector<uint32_t> smallColours[2];
+	for (int copies = 0; copies < 2; copies++)
+	{
+		RayTracer smallRayTracer;
+		smallRayTracer.SetScene(std::move(copies ? copyScene : instanceScene));
+		trace_frame(smallRayTracer, 1, smallColours[copies]);
+	};
+	long long differentRays = 0;
+	for (size_t i = 0; i < smallColours[0].size(); i++)
+	{
+		differentRays += get_colour_contrast(smallColours[0][i], smallColours[1][i]) > 0.02f;
+	};
+	std::cout << smallInstanceCount << " small instances against separate copies: " << differentRays << " of " << smallColours[0].size() << " rays differ" << std::endl;
 
+	if (wrongRays != 0)
+	{
+		std::cout << wrongRays << " rays differ between the BVH and testing every instance" << std::endl;
+		return 1;
+	};
+	if (differentRays * 100 > (long long)smallColours[0].size())
+	{
+		std::cout << "More than 1% of rays differ between the instances and separate copies" << std::endl;
+		return 1;
+	};
 
-float get_length_between_points(glm::vec3 point1, glm::vec3 point2)
-{
-	// Returns length between two given vectors
-	return glm::length(point1 - point2);
+	return 0;
 };
 
 
-// Gets position vector from user
-glm::vec3 get_pos_from_user()
+// Times rendering the same frame without anti-aliasing, with adaptive anti-aliasing and with 16x supersampling of every pixel, on one thread
+// Prints the rays traced per pixel by each and how far each is from the supersampled frame (root mean square, in 0 to 255 colour steps)
+// Returns non-zero if adaptive anti-aliasing doesn't get closer to the supersampled frame than no anti-aliasing, or doesn't trace fewer rays
+int run_antialiasing_benchmark()
 {
-	int xPos, yPos, zPos;
-
-	std::cout << "Enter position (3D): ";
-	std::cin >> xPos >> yPos >> zPos;
-
-	glm::vec3 pos(xPos, yPos, zPos);
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+	Camera camera(windowSize, viewingSize);
+	int pixelCount = windowSize.x * windowSize.y;
+	int maxSamples = 16;
 
-	return pos;
-};
+	// Fixed seed so every run measures the same scenes
+	std::mt19937 generator(1234);
 
+	std::cout << "shapes, mode, rays/pixel, frame ms, rms error" << std::endl;
 
-// Gets 2D position vector from user
-glm::vec2 get_2d_pos_from_user()
-{
-	int xPos, yPos;
+	int failures = 0;
+	for (int shapeCount = 1000; shapeCount <= 10000; shapeCount *= 10)
+	{
+		Scene scene(glm::vec3(1, -1, -1));
+		add_random_shapes(scene, shapeCount, windowSize, generator);
+
+		RayTracer rayTracer;
+		rayTracer.SetScene(std::move(scene));
+		TileRenderer tileRenderer(1);
+
+		// Renders the frame each way, the supersampled frame last as the others are compared with it
+		const int modeCount = 3;
+		const char* modeNames[modeCount] = { "none", "adaptive", "supersampled" };
+		int modeSamples[modeCount] = { 1, maxSamples, maxSamples };
+		bool supersampleAll[modeCount] = { false, false, true };
+		std::vector<uint32_t> framebuffers[modeCount];
+		double frameMs[modeCount];
+		double raysPerPixel[modeCount];
+		for (int m = 0; m < modeCount; m++)
+		{
+			tileRenderer.SetAntiAliasing(modeSamples[m], supersampleAll[m]);
+			framebuffers[m].resize(pixelCount);
 
-	std::cout << "Enter position (2D): ";
-	std::cin >> xPos >> yPos;
+			// Keeps the best of a few frames to reduce noise
+			frameMs[m] = std::numeric_limits<double>::max();
+			for (int run = 0; run < 3; run++)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				tileRenderer.Render(camera, rayTracer, windowSize, framebuffers[m].data());
+				auto end = std::chrono::high_resolution_clock::now();
 
-	glm::vec2 pos(xPos, yPos);
+				frameMs[m] = std::min(frameMs[m], std::chrono::duration<double, std::milli>(end - start).count());
+			};
+			raysPerPixel[m] = (double)tileRenderer.GetRayCount() / pixelCount;
+		};
 
-	return pos;
-};
+		double errors[modeCount];
+		for (int m = 0; m < modeCount; m++)
+		{
+			double squaredError = 0;
+			for (int i = 0; i < pixelCount; i++)
+			{
+				for (int shift = 8; shift <= 24; shift += 8)
+				{
+					double difference = (double)((framebuffers[m][i] >> shift) & 255) - (double)((framebuffers[modeCount - 1][i] >> shift) & 255);
+					squaredError += difference * difference;
+				};
+			};
+			errors[m] = std::sqrt(squaredError / (pixelCount * 3.0));
 
+			std::cout << shapeCount << ", " << modeNames[m] << ", " << raysPerPixel[m] << ", " << frameMs[m] << ", " << errors[m] << std::endl;
+		};
 
-// Gets z coordinate from user
-int get_z_from_user()
-{
-	int z;
+		if (errors[1] >= errors[0] || raysPerPixel[1] >= raysPerPixel[2])
+		{
+			failures++;
+		};
+	};
 
-	std::cout << "Enter z coordinate: ";
-	std::cin >> z;
+	if (failures != 0)
+	{
+		std::cout << "Adaptive anti-aliasing wasn't closer to supersampling than no anti-aliasing, or traced as many rays" << std::endl;
+		return 1;
+	};
 
-	return z;
+	return 0;
 };
 
 
-// Gets colour vector from user
-glm::vec3 get_colour_from_user()
+// Times bringing a frame up to date after single shape edits (moves, recolours, additions and removals) against rendering it again, on one thread, with and without anti-aliasing
+// Prints the rays traced per edit, the mean time taken by the edit itself (mostly rebuilding the BVH), the update and a full frame, and how many pixels the updated frame got wrong
+// Returns non-zero if any updated frame differs from the frame rendered again in full
+int run_scene_edit_benchmark()
 {
-	int r, g, b;
-
-	std::cout << "Enter colour: ";
-	std::cin >> r >> g >> b;
+	glm::ivec2 windowSize(640, 480);
+	glm::ivec2 viewingSize(672, 504);
+	Camera camera(windowSize, viewingSize);
+	int pixelCount = windowSize.x * windowSize.y;
+	int shapeCount = 10000;
+	int editsPerKind = 20;
 
-	glm::vec3 colour((float)r / 255, (float)g / 255, (float)b / 255);
+	std::cout << "aa samples, edit, rays/edit, edit ms, update ms, full frame ms, wrong pixels" << std::endl;
 
-	return colour;
-};
+	long long totalWrongPixels = 0;
+	for (int maxSamples = 1; maxSamples <= 16; maxSamples *= 16)
+	{
+		// Fixed seed so every run measures the same scene and edits
+		std::mt19937 generator(1234);
+		std::uniform_real_distribution<float> xDistribution(0.0f, (float)windowSize.x);
+		std::uniform_real_distribution<float> yDistribution(0.0f, (float)windowSize.y);
+		std::uniform_real_distribution<float> zDistribution(20.0f, 500.0f);
+		std::uniform_real_distribution<float> offsetDistribution(-20.0f, 20.0f);
+		std::uniform_real_distribution<float> sizeDistribution(2.0f, 20.0f);
+		std::uniform_real_distribution<float> colourDistribution(0.0f, 1.0f);
+
+		Scene scene(glm::vec3(1, -1, -1));
+		add_random_shapes(scene, shapeCount, windowSize, generator);
+
+		RayTracer rayTracer;
+		rayTracer.SetScene(std::move(scene));
+
+		// One renderer keeps its frame up to date, the other renders every frame in full to check it against
+		TileRenderer updatingRenderer(1);
+		TileRenderer fullRenderer(1);
+		updatingRenderer.SetAntiAliasing(maxSamples);
+		fullRenderer.SetAntiAliasing(maxSamples);
+		std::vector<uint32_t> updatedFramebuffer(pixelCount);
+		std::vector<uint32_t> fullFramebuffer(pixelCount);
+		updatingRenderer.Render(camera, rayTracer, windowSize, updatedFramebuffer.data());
+
+		const int kindCount = 4;
+		const char* kindNames[kindCount] = { "move", "recolour", "add", "remove" };
+		for (int kind = 0; kind < kindCount; kind++)
+		{
+			long long rayCount = 0;
+			long long wrongPixels = 0;
+			double editMs = 0;
+			double updateMs = 0;
+			double fullMs = 0;
+			for (int i = 0; i < editsPerKind; i++)
+			{
+				std::uniform_int_distribution<size_t> shapeDistribution(0, rayTracer.GetScene().GetShapeCount() - 1);
+				glm::vec3 colour(colourDistribution(generator), colourDistribution(generator), colourDistribution(generator));
 
+				auto start = std::chrono::high_resolution_clock::now();
+				SceneEdit edit;
+				if (kind == 0)
+				{
+					size_t shapeIndex = shapeDistribution(generator);
+					float offsetX = offsetDistribution(generator);
+					float offsetY = offsetDistribution(generator);
+					edit = rayTracer.MoveShape(shapeIndex, glm::vec3(offsetX, offsetY, 0));
+				}
+				else if (kind == 1)
+				{
+					edit = rayTracer.SetShapeColour(shapeDistribution(generator), colour);
+				}
+				else if (kind == 2)
+				{
+					// Takes turns adding each type, as add_random_shapes does
+					float x = xDistribution(generator);
+					float y = yDistribution(generator);
+					float z = zDistribution(generator);
+					float size = sizeDistribution(generator);
+					glm::vec3 pos(x, y, z);
+					switch (i % 4)
+					{
+					case 0:
+						edit = rayTracer.AddSphere(pos, size, colour);
+						break;
+					case 1:
+						edit = rayTracer.AddRectangle(pos, size * 2, size, colour);
+						break;
+					case 2:
+						edit = rayTracer.AddCircle(pos, size, colour);
+						break;
+					default:
+						edit = rayTracer.AddTriangle(pos, pos + glm::vec3(size, 0, 0), pos + glm::vec3(0, size, 0), colour);
+						break;
+					};
+				}
+				else
+				{
+					edit = rayTracer.RemoveShape(shapeDistribution(generator));
+				};
 
-// Gets radius from user
-int get_radius_from_user()
-{
-	int radius;
+				auto end = std::chrono::high_resolution_clock::now();
+				editMs += std::chrono::duration<double, std::milli>(end - start).count();
 
-	std::cout << "Enter radius: ";
-	std::cin >> radius;
+				start = std::chrono::high_resolution_clock::now();
+				updatingRenderer.UpdateFrame(camera, rayTracer, windowSize, updatedFramebuffer.data(), edit);
+				end = std::chrono::high_resolution_clock::now();
+				updateMs += std::chrono::duration<double, std::milli>(end - start).count();
+				rayCount += updatingRenderer.GetRayCount();
 
-	return radius;
-};
+				start = std::chrono::high_resolution_clock::now();
+				fullRenderer.Render(camera, rayTracer, windowSize, fullFramebuffer.data());
+				end = std::chrono::high_resolution_clock::now();
+				fullMs += std::chrono::duration<double, std::milli>(end - start).count();
 
+				for (int pixel = 0; pixel < pixelCount; pixel++)
+				{
+					wrongPixels += updatedFramebuffer[pixel] != fullFramebuffer[pixel];
+				};
+			};
+			totalWrongPixels += wrongPixels;
 
-// Gets width value from user
-int get_width_from_user()
-{
-	int width;
+			std::cout << maxSamples << ", " << kindNames[kind] << ", " << (double)rayCount / editsPerKind << ", " << editMs / editsPerKind << ", " << updateMs / editsPerKind << ", " << fullMs / editsPerKind << ", " << wrongPixels << std::endl;
+		};
+	};
 
-	std::cout << "Enter width: ";
-	std::cin >> width;
+	if (totalWrongPixels != 0)
+	{
+		std::cout << totalWrongPixels << " pixels differ between updated frames and frames rendered again in full" << std::endl;
+		return 1;
+	};
 
-	return width;
+	return 0;
 };
 
 
-// Gets height value from user
-int get_height_from_user()
+int main( int argc, char *argv[] )
 {
-	int height;
-
-	std::cout << "Enter height: ";
-	std::cin >> height;
-
-	return height;
-};
+	// Runs a benchmark instead of rendering when asked
+	if (argc > 1 && std::string(argv[1]) == "--bench-bvh")
+	{
+		return run_bvh_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-alloc")
+	{
+		return run_allocation_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-threads")
+	{
+		return run_thread_scaling_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-load")
+	{
+		return run_scene_load_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-startup")
+	{
+		return run_startup_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-layout")
+	{
+		return run_layout_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-spheres")
+	{
+		return run_sphere_kernel_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-triangles")
+	{
+		return run_triangle_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-mesh")
+	{
+		return run_mesh_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-packets")
+	{
+		return run_packet_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-shadows")
+	{
+		return run_shadow_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-aa")
+	{
+		return run_antialiasing_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-layers")
+	{
+		return run_layer_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-grid")
+	{
+		return run_grid_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-edit")
+	{
+		return run_scene_edit_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-build")
+	{
+		return run_bvh_build_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-animate")
+	{
+		return run_animation_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-instances")
+	{
+		return run_instancing_benchmark();
+	};
+	if (argc > 1 && std::string(argv[1]) == "--bench-suite")
+	{
+		// Renders at the default window size unless resolutions are given, as WIDTHxHEIGHT
+		std::vector<glm::ivec2> resolutions;
+		for (int i = 2; i < argc; i++)
+		{
+			glm::ivec2 resolution;
+			char extra;
+			if (std::sscanf(argv[i], "%dx%d%c", &resolution.x, &resolution.y, &extra) != 2 || resolution.x <= 0 || resolution.y <= 0)
+			{
+				std::cout << "Bad resolution: " << argv[i] << "\nUsage: " << argv[0] << " --bench-suite [WIDTHxHEIGHT ...]" << std::endl;
+				return -1;
+			};
+			resolutions.push_back(resolution);
+		};
+		if (resolutions.empty())
+		{
+			resolutions.push_back(glm::ivec2(640, 480));
+		};
 
+		return run_benchmark_suite(resolutions);
+	};
 
-// Gets light direction vector from user
-glm::vec3 get_light_direction_from_user()
-{
-	float x, y, z;
+	// Converts a text scene file into a binary scene cache when asked
+	if (argc > 1 && std::string(argv[1]) == "--convert-scene")
+	{
+		if (argc != 4)
+		{
+			std::cout << "Usage: " << argv[0] << " --convert-scene input.scene output.rtscene" << std::endl;
+			return -1;
+		};
 
-	std::cout << "Enter light direction vector: ";
-	std::cin >> x >> y >> z;
+		glm::ivec2 windowSize(640, 480);
+		glm::ivec2 viewingSize(672, 504);
+		Scene scene(glm::vec3(1, -1, -1));
+		if (!load_scene_file(argv[2], scene, windowSize, viewingSize) || !write_scene_cache(argv[3], scene, windowSize, viewingSize))
+		{
+			return 1;
+		};
 
-	glm::vec3 direction(x, y, z);
+		return 0;
+	};
 
-	return direction;
-};
+	// Scenes are read from this file when given (OBJ files become a scene of just that mesh), otherwise they are entered through the shape menu
+	std::string scenePath;
+	// Headless mode renders without a window and writes the frame to this file instead
+	std::string headlessOutputPath;
+	// Animation mode renders every frame of the scene's keyframes without a window, writing them to files numbered from this (see get_numbered_path)
+	std::string animationOutputPath;
+	// Spans recorded up to the finished frame are written here as a Chrome trace, when built with RAYTRACER_PROFILE
+	std::string tracePath;
+	// Heatmap mode shows what each pixel cost to trace instead of the frame, writing the heatmap to files starting with this
+	std::string heatmapPrefix;
+	HeatmapMetric heatmapMetric = HeatmapMetric::Tests;
+	// Casts shadows from the scene's light
+	bool shadows = false;
+	// Finds planar shapes through z layers rather than the BVH (see PlanarLayerIndex)
+	bool layers = false;
+	// Finds shapes by stepping through a uniform grid rather than the BVH (see UniformGrid)
+	bool grid = false;
+	// Builds the BVH for tracing speed (SAH) or for build speed (Morton), see BVHBuilder
+	BVHBuilder bvhBuilder = BVHBuilder::SAH;
+	// Most samples anti-aliasing takes in a pixel, below 4 leaves it off
+	int antiAliasingSamples = 1;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
 
+		if (argument == "--headless" && i + 1 < argc)
+		{
+			headlessOutputPath = argv[++i];
+		}
+		else if (argument == "--animate" && i + 1 < argc)
+		{
+			animationOutputPath = argv[++i];
+		}
+		else if (argument == "--shadows")
+		{
+			shadows = true;
+		}
+		else if (argument == "--layers")
+		{
+			layers = true;
+		}
+		else if (argument == "--grid")
+		{
+			grid = true;
+		}
+		else if (argument == "--bvh" && i + 1 < argc && (std::string(argv[i + 1]) == "sah" || std::string(argv[i + 1]) == "morton"))
+		{
+			bvhBuilder = std::string(argv[++i]) == "sah" ? BVHBuilder::SAH : BVHBuilder::Morton;
+		}
+		else if (argument == "--aa" && i + 1 < argc)
+		{
+			antiAliasingSamples = std::atoi(argv[++i]);
+		}
+		else if (argument == "--trace" && i + 1 < argc)
+		{
+			tracePath = argv[++i];
+		}
+		else if (argument == "--heatmap" && i + 2 < argc && (std::string(argv[i + 1]) == "tests" || std::string(argv[i + 1]) == "steps" || std::string(argv[i + 1]) == "time"))
+		{
+			std::string metric = argv[++i];
+			heatmapMetric = metric == "tests" ? HeatmapMetric::Tests : metric == "steps" ? HeatmapMetric::Steps : HeatmapMetric::Time;
+			heatmapPrefix = argv[++i];
+			if ((heatmapMetric == HeatmapMetric::Tests && !kCountsIntersectionTests) || (heatmapMetric == HeatmapMetric::Steps && !kCountsTraversalSteps))
+			{
+				std::cout << "Test and step counting isn't built in, define RAYTRACER_COUNT_TESTS to write a heatmap of " << metric << std::endl;
+				return -1;
+			};
+		}
+		else if (argument.compare(0, 2, "--") != 0 && scenePath.empty())
+		{
+			scenePath = argument;
+		}
+		else
+		{
+			std::cout << "Unknown argument: " << argument << "\nUsage: " << argv[0] << " [scene file, cache or OBJ file] [--headless output.ppm|output.png] [--animate output.ppm|output.png] [--shadows] [--layers|--grid] [--bvh sah|morton] [--aa max_samples] [--trace trace.json] [--heatmap tests|steps|time output_prefix]" << std::endl;
+			return -1;
+		};
+	};
+	bool headless = !headlessOutputPath.empty() || !animationOutputPath.empty();
 
-int main( int argc, char *argv[] )
-{
 	// Variable for storing window dimensions
 	glm::ivec2 windowSize( 640, 480 );
 	glm::ivec2 viewingSize( 672, 504 );
 
-	// Call MCG::Init to initialise and create your window
+	// Loads the scene file (or cache) first, as it can change the window size
+	Scene scene(glm::vec3(1, -1, -1));
+	if (!scenePath.empty())
+	{
+		PROFILE_SCOPE("Load scene");
+
+		auto loadStart = std::chrono::high_resolution_clock::now();
+		bool loaded;
+		if (scenePath.size() > 4 && scenePath.compare(scenePath.size() - 4, 4, ".obj") == 0)
+		{
+			// Fills most of the window, far enough back that none of it is behind the camera
+			float size = std::min(windowSize.x, windowSize.y) * 0.8f;
+			loaded = load_obj_file(scenePath, scene, glm::vec3(windowSize.x / 2, windowSize.y / 2, size), size, glm::vec3(0.8f, 0.8f, 0.8f));
+		}
+		else
+		{
+			loaded = is_scene_cache_file(scenePath) ? load_scene_cache(scenePath, scene, windowSize, viewingSize) : load_scene_file(scenePath, scene, windowSize, viewingSize);
+		};
+		if (!loaded)
+		{
+			return -1;
+		};
+		auto loadEnd = std::chrono::high_resolution_clock::now();
+
+		std::cout << "Loaded " << scene.GetShapeCount() << " shapes from " << scenePath << " in " << std::chrono::duration<double, std::milli>(loadEnd - loadStart).count() << " ms" << std::endl;
+	};
+
+	// Call MCG::Init to initialise and create your window (or just a framebuffer when headless)
 	// Tell it what size you want the window to be
-	if( !MCG::Init( windowSize ) )
+	if( !( headless ? MCG::InitHeadless( windowSize ) : MCG::Init( windowSize ) ) )
 	{
 		// We must check if something went wrong
 		// (this is very unlikely)
@@ -778,22 +9467,31 @@ int main( int argc, char *argv[] )
 	// Creates camera
 	Camera camera(windowSize, viewingSize);
 
-	// Gets light direction vector from user inputs
-	glm::vec3 light_direction = get_light_direction_from_user();
+	// Without a scene file the scene is entered by the user
+	if (scenePath.empty())
+	{
+		// Gets light direction vector from user inputs
+		glm::vec3 light_direction = get_light_direction_from_user();
 
-	// Creates scene using given light direction vector
-	Scene scene(light_direction);
+		// Uses the given light direction vector for the scene
+		scene.SetLightDirection(light_direction);
+	};
 
 	std::string option;
 
 	// User input loop - allows the user to add objects into the scene
-	bool ready{ false };
+	bool ready{ !scenePath.empty() };
 	while (!ready)
 	{
 		std::cout << "Shape menu:\n 1 - Rectangle\n 2 - Triangle\n 3 - Circle\n 4 - Sphere\n 5 - Done\nEnter option: ";
 		std::cin >> option;
 
-		if (option == "1")	// Creates rectangle
+		// Running out of input (e.g. piped in from a file) finishes the scene
+		if (!std::cin)
+		{
+			ready = true;
+		}
+		else if (option == "1")	// Creates rectangle
 		{
 			// Gets necessary data from user
 			glm::vec3 pos = get_pos_from_user();
@@ -840,25 +9538,145 @@ int main( int argc, char *argv[] )
 
 	// Creates ray tracer and provides it with a scene
 	RayTracer rayTracer;
-	rayTracer.SetScene(scene);
+	rayTracer.SetBVHBuilder(bvhBuilder);
+	rayTracer.SetScene(std::move(scene));
+	rayTracer.SetShadows(shadows);
+	rayTracer.SetAccelerationMode(layers ? AccelerationMode::Layers : grid ? AccelerationMode::Grid : AccelerationMode::BVH);
+
+	// Reports the build alongside the trace times below, unless the hierarchy came prebuilt in a scene cache
+	if (rayTracer.GetBVHBuildMs() >= 0)
+	{
+		std::cout << "Built the BVH over " << rayTracer.GetScene().GetShapeCount() << " shapes (" << (bvhBuilder == BVHBuilder::SAH ? "SAH" : "Morton") << ") in " << rayTracer.GetBVHBuildMs() << " ms" << std::endl;
+	};
+
+	// Traces every pixel on the screen across all hardware threads, straight into the window's framebuffer
+	// Workers never touch the window itself, it is only uploaded by ProcessFrame and ShowAndHold from this thread
+	TileRenderer tileRenderer(std::thread::hardware_concurrency());
+	tileRenderer.SetAntiAliasing(antiAliasingSamples);
+
+	// Heatmap mode shows the heatmap in place of the frame, or only writes its files when headless (the frame isn't rendered, so the headless output isn't written)
+	if (!heatmapPrefix.empty())
+	{
+		bool written = write_heatmap(camera, rayTracer, windowSize, heatmapMetric, heatmapPrefix);
+
+		if (headless)
+		{
+			MCG::Cleanup();
+
+			return written ? 0 : 1;
+		};
+
+		return MCG::ShowAndHold();
+	};
+
+	// Animations are traced a frame at a time and saved as an image sequence, the BVH being refitted to the shapes' new positions between frames
+	if (!animationOutputPath.empty())
+	{
+		int frameCount = std::max(rayTracer.GetScene().GetAnimationFrameCount(), 1);
+		bool saved = true;
+		for (int frame = 0; frame < frameCount && saved; frame++)
+		{
+			bool rebuilt = rayTracer.SetAnimationFrame((float)frame);
+
+			auto traceStart = std::chrono::high_resolution_clock::now();
+			tileRenderer.Render(camera, rayTracer, windowSize, MCG::GetFramebuffer());
+			auto traceEnd = std::chrono::high_resolution_clock::now();
+
+			std::cout << "Frame " << frame << ": " << (rebuilt ? "rebuilt" : "refitted") << " the BVH in " << rayTracer.GetBVHBuildMs() << " ms, traced in " << std::chrono::duration<double, std::milli>(traceEnd - traceStart).count() << " ms" << std::endl;
+
+			PROFILE_SCOPE("Save image");
+
+			saved = MCG::SaveImage(get_numbered_path(animationOutputPath, frame));
+		};
+		MCG::Cleanup();
+
+		if (!tracePath.empty())
+		{
+			write_profile_trace(tracePath);
+		};
 
-	// Goes through each pixel on the screen
-	for (int x = 0; x < windowSize.x; x++)
+		return saved ? 0 : 1;
+	};
+
+	// Without a window there is nothing to preview, so the frame is traced in one go and saved, the exit code says if that worked
+	if (headless)
 	{
-		for (int y = 0; y < windowSize.y; y++)
+		auto traceStart = std::chrono::high_resolution_clock::now();
+		tileRenderer.Render(camera, rayTracer, windowSize, MCG::GetFramebuffer());
+		auto traceEnd = std::chrono::high_resolution_clock::now();
+
+		std::cout << "Traced the frame in " << std::chrono::duration<double, std::milli>(traceEnd - traceStart).count() << " ms" << std::endl;
+
+		bool saved;
 		{
-			// Gets pixel position vector
-			glm::ivec2 pixelPosition(x, y);
+			PROFILE_SCOPE("Save image");
+
+			saved = MCG::SaveImage(headlessOutputPath);
+		}
+		MCG::Cleanup();
+
+		if (!tracePath.empty())
+		{
+			write_profile_trace(tracePath);
+		};
+
+		return saved ? 0 : 1;
+	};
+
+	// With a window the frame is rendered progressively on its own thread, while this one keeps showing the framebuffer
+	// Each finished pass is copied into the framebuffer here, so nothing writes the framebuffer while it's uploaded
+	std::atomic<bool> cancelled(false);
+	auto renderStart = std::chrono::high_resolution_clock::now();
+	std::thread renderThread([&]
+	{
+		tileRenderer.RenderProgressive(camera, rayTracer, windowSize, cancelled);
+	});
+
+	// Shows the framebuffer at a fixed rate until the last pass is done, closing the window stops the render
+	bool windowOpen = true;
+	int shownPasses = 0;
+	auto nextPreview = std::chrono::steady_clock::now();
+	while (shownPasses < kProgressivePassCount)
+	{
+		// Takes the latest finished pass, so a pass reported here is complete in the upload
+		int passes = tileRenderer.CopyFinishedPass(MCG::GetFramebuffer(), shownPasses);
 
-			// Creates ray using pixel position vector
-			Ray currentRay = camera.GetRay(pixelPosition);
+		{
+			PROFILE_SCOPE("Present");
 
-			// Gets colour for that ray
-			glm::vec3 pixelColour = rayTracer.TraceRay(currentRay);
+			windowOpen = MCG::ProcessFrame();
+		}
+		if (!windowOpen)
+		{
+			break;
+		};
 
-			// Draws colour at pixel position
-			MCG::DrawPixel(pixelPosition, pixelColour);
+		// Reports each pass once it has been shown
+		for (; shownPasses < passes; shownPasses++)
+		{
+			int blockSize = kProgressiveBlockSizes[shownPasses];
+			double shownMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - renderStart).count();
+			std::cout << blockSize << "x" << blockSize << " pass shown after " << shownMs << " ms" << std::endl;
 		};
+
+		nextPreview += std::chrono::milliseconds(kPreviewIntervalMs);
+		std::this_thread::sleep_until(nextPreview);
+	};
+
+	cancelled = true;
+	renderThread.join();
+
+	// The trace ends with the finished frame, time spent holding the window open isn't worth recording
+	if (!tracePath.empty())
+	{
+		write_profile_trace(tracePath);
+	};
+
+	if (!windowOpen)
+	{
+		MCG::Cleanup();
+
+		return 0;
 	};
 
 	// Displays drawing to screen and holds until user closes window